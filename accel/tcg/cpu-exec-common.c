@@ -82,3 +82,13 @@ void cpu_loop_exit_atomic(CPUState *cpu, uintptr_t pc)
     cpu->exception_index = EXCP_ATOMIC;
     cpu_loop_exit_restore(cpu, pc);
 }
+
+/*
+ * Abandon the current instruction and retry it in the serial phase of
+ * the lockstep icount quantum.
+ */
+void cpu_loop_exit_serial(CPUState *cpu, uintptr_t pc)
+{
+    cpu->exception_index = EXCP_SERIAL;
+    cpu_loop_exit_restore(cpu, pc);
+}
@@ -27,6 +27,7 @@
 #include "exec/cputlb.h"
 #include "exec/memory-internal.h"
 #include "exec/ram_addr.h"
+#include "sysemu/cpu-timers.h"
 #include "tcg/tcg.h"
 #include "qemu/error-report.h"
 #include "exec/log.h"
@@ -213,11 +214,24 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
 }
 
+/*
+ * The clock of the TLB resize windows.  With lockstep icount a vCPU must
+ * not see host time here, or the TLB misses that end its parallel phase
+ * would vary from run to run; the windows then never expire, and the
+ * TLB only grows.
+ */
+static inline int64_t tlb_clock_now(void)
+{
+    return icount_lockstep_enabled() ? 0 : get_clock_realtime();
+}
+
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
+    desc->lpindex = 0;
+    memset(desc->lptable, -1, sizeof(desc->lptable));
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
@@ -255,26 +269,44 @@ static inline void tlb_n_used_entries_dec(CPUArchState *env, uintptr_t mmu_idx)
     env_tlb(env)->d[mmu_idx].n_used_entries--;
 }
 
+static void tlb_lockstep_init(void);
+
 void tlb_init(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
-    int64_t now = get_clock_realtime();
-    int i;
+    int64_t now = tlb_clock_now();
+    int i, k;
 
     qemu_spin_init(&env_tlb(env)->c.lock);
 
     /* All tlbs are initialized flushed. */
     env_tlb(env)->c.dirty = 0;
+    env_tlb(env)->c.asid = TLB_ASID_NONE;
+    env_tlb(env)->c.asid_next = 0;
+    env_tlb(env)->c.asid_ctx = g_new0(CPUTLBASIDContext, CPU_TLB_ASID_CONTEXTS);
+    env_tlb(env)->c.pending_async = false;
+    env_tlb(env)->c.pending_safe = false;
+    env_tlb(env)->c.pending_full = 0;
+    env_tlb(env)->c.n_pending = 0;
+    env_tlb(env)->c.fill_access = MMU_DATA_LOAD;
+    if (icount_lockstep_enabled()) {
+        tlb_lockstep_init();
+    }
 
     for (i = 0; i < NB_MMU_MODES; i++) {
         tlb_mmu_init(&env_tlb(env)->d[i], &env_tlb(env)->f[i], now);
+        for (k = 0; k < CPU_TLB_ASID_CONTEXTS; k++) {
+            CPUTLBASIDContext *ctx = &env_tlb(env)->c.asid_ctx[k];
+
+            tlb_mmu_init(&ctx->d[i], &ctx->f[i], now);
+        }
     }
 }
 
 void tlb_destroy(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
-    int i;
+    int i, k;
 
     qemu_spin_destroy(&env_tlb(env)->c.lock);
     for (i = 0; i < NB_MMU_MODES; i++) {
@@ -283,7 +315,56 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->iotlb);
+        for (k = 0; k < CPU_TLB_ASID_CONTEXTS; k++) {
+            CPUTLBASIDContext *ctx = &env_tlb(env)->c.asid_ctx[k];
+
+            g_free(ctx->f[i].table);
+            g_free(ctx->d[i].iotlb);
+        }
     }
+    g_free(env_tlb(env)->c.asid_ctx);
+}
+
+/*
+ * Flush the MMU indexes in @idxmap from all inactive address spaces,
+ * skipping the tables that are still clean.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_asid_ctx_by_mmuidx_locked(CPUTLB *tlb, uint16_t idxmap,
+                                                int64_t now)
+{
+    uint16_t work;
+    int k;
+
+    for (k = 0; k < CPU_TLB_ASID_CONTEXTS; k++) {
+        CPUTLBASIDContext *ctx = &tlb->c.asid_ctx[k];
+
+        if (!ctx->valid) {
+            continue;
+        }
+        for (work = idxmap & ctx->dirty; work != 0; work &= work - 1) {
+            int mmu_idx = ctz32(work);
+
+            tlb_mmu_resize_locked(&ctx->d[mmu_idx], &ctx->f[mmu_idx], now);
+            tlb_mmu_flush_locked(&ctx->d[mmu_idx], &ctx->f[mmu_idx]);
+        }
+        ctx->dirty &= ~idxmap;
+    }
+}
+
+/* Called with tlb_c.lock held */
+static CPUTLBASIDContext *tlb_find_asid_ctx_locked(CPUTLB *tlb, uint64_t asid)
+{
+    int k;
+
+    for (k = 0; k < CPU_TLB_ASID_CONTEXTS; k++) {
+        CPUTLBASIDContext *ctx = &tlb->c.asid_ctx[k];
+
+        if (ctx->valid && ctx->asid == asid) {
+            return ctx;
+        }
+    }
+    return NULL;
 }
 
 /* flush_all_helper: run fn across all cpus
@@ -327,7 +408,7 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
     CPUArchState *env = cpu->env_ptr;
     uint16_t asked = data.host_int;
     uint16_t all_dirty, work, to_clean;
-    int64_t now = get_clock_realtime();
+    int64_t now = tlb_clock_now();
 
     assert_cpu_is_self(cpu);
 
@@ -335,6 +416,8 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 
     qemu_spin_lock(&env_tlb(env)->c.lock);
 
+    tlb_flush_asid_ctx_by_mmuidx_locked(env_tlb(env), asked, now);
+
     all_dirty = env_tlb(env)->c.dirty;
     to_clean = asked & all_dirty;
     all_dirty &= ~to_clean;
@@ -476,18 +559,77 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
 }
 
-static void tlb_flush_page_locked(CPUArchState *env, int midx,
-                                  target_ulong page)
+/*
+ * Drop @lp and every main and victim TLB entry that was filled from it.
+ * Walk whichever is smaller: the pages of @lp, or the main TLB.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_entry_locked(CPUArchState *env, int midx,
+                                         CPUTLBLargeEntry *lp)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    target_ulong lp_addr = lp->vaddr;
+    target_ulong lp_mask = lp->mask;
+    size_t n_pages = (size_t)((~lp_mask >> TARGET_PAGE_BITS) + 1);
+    size_t n_entries = tlb_n_entries(f);
+    size_t i;
+
+    tlb_debug("flush large page midx %d (" TARGET_FMT_lx "/" TARGET_FMT_lx
+              ")\n", midx, lp_addr, lp_mask);
+    memset(lp, -1, sizeof(*lp));
+
+    if (n_pages <= n_entries) {
+        for (i = 0; i < n_pages; i++) {
+            target_ulong page = lp_addr + ((target_ulong)i << TARGET_PAGE_BITS);
+
+            if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    } else {
+        for (i = 0; i < n_entries; i++) {
+            if (tlb_flush_entry_mask_locked(&f->table[i], lp_addr, lp_mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    }
+    tlb_flush_vtlb_page_mask_locked(env, midx, lp_addr, lp_mask);
+}
 
-    /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
+/*
+ * Flush the large pages that cover @page, comparing the bits in @mask.
+ * Returns false if @page falls in the region of displaced large pages,
+ * in which case the caller must flush the entire tlb.
+ * Called with tlb_c.lock held.
+ */
+static bool tlb_flush_large_pages_locked(CPUArchState *env, int midx,
+                                         target_ulong page, target_ulong mask)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    int k;
+
+    if (((page ^ d->large_page_addr) & d->large_page_mask & mask) == 0) {
         tlb_debug("forcing full flush midx %d ("
                   TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+                  midx, d->large_page_addr, d->large_page_mask);
+        return false;
+    }
+    for (k = 0; k < CPU_LPTLB_SIZE; k++) {
+        CPUTLBLargeEntry *lp = &d->lptable[k];
+
+        if (((page ^ lp->vaddr) & lp->mask & mask) == 0) {
+            tlb_flush_large_entry_locked(env, midx, lp);
+        }
+    }
+    return true;
+}
+
+static void tlb_flush_page_locked(CPUArchState *env, int midx,
+                                  target_ulong page)
+{
+    /* Check if we need to flush due to large pages.  */
+    if (!tlb_flush_large_pages_locked(env, midx, page, -1)) {
+        tlb_flush_one_mmuidx_locked(env, midx, tlb_clock_now());
     } else {
         if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
             tlb_n_used_entries_dec(env, midx);
@@ -496,6 +638,50 @@ static void tlb_flush_page_locked(CPUArchState *env, int midx,
     }
 }
 
+/*
+ * Flush @page from the inactive address space @ctx, for the MMU indexes
+ * in @idxmap.  If @page may be covered by a large page, the address
+ * space is dropped altogether.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_page_asid_ctx_locked(CPUTLBASIDContext *ctx,
+                                           uint16_t idxmap, target_ulong page)
+{
+    int mmu_idx, k;
+
+    if (!ctx->valid) {
+        return;
+    }
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        CPUTLBDesc *d = &ctx->d[mmu_idx];
+        CPUTLBDescFast *f = &ctx->f[mmu_idx];
+        uintptr_t size_mask = f->mask >> CPU_TLB_ENTRY_BITS;
+
+        if (!((idxmap >> mmu_idx) & 1)) {
+            continue;
+        }
+        if ((page & d->large_page_mask) == d->large_page_addr) {
+            ctx->valid = false;
+            return;
+        }
+        for (k = 0; k < CPU_LPTLB_SIZE; k++) {
+            if ((page & d->lptable[k].mask) == d->lptable[k].vaddr) {
+                ctx->valid = false;
+                return;
+            }
+        }
+        if (tlb_flush_entry_locked(
+                &f->table[(page >> TARGET_PAGE_BITS) & size_mask], page)) {
+            d->n_used_entries--;
+        }
+        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+            if (tlb_flush_entry_locked(&d->vtable[k], page)) {
+                d->n_used_entries--;
+            }
+        }
+    }
+}
+
 /**
  * tlb_flush_page_by_mmuidx_async_0:
  * @cpu: cpu on which to flush
@@ -510,7 +696,7 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
                                              uint16_t idxmap)
 {
     CPUArchState *env = cpu->env_ptr;
-    int mmu_idx;
+    int mmu_idx, k;
 
     assert_cpu_is_self(cpu);
 
@@ -522,178 +708,145 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
             tlb_flush_page_locked(env, mmu_idx, addr);
         }
     }
+    for (k = 0; k < CPU_TLB_ASID_CONTEXTS; k++) {
+        tlb_flush_page_asid_ctx_locked(&env_tlb(env)->c.asid_ctx[k],
+                                       idxmap, addr);
+    }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 
     tb_flush_jmp_cache(cpu, addr);
 }
 
-/**
- * tlb_flush_page_by_mmuidx_async_1:
- * @cpu: cpu on which to flush
- * @data: encoded addr + idxmap
- *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The idxmap parameter is encoded in the page
- * offset of the target_ptr field.  This limits the set of mmu_idx
- * that can be passed via this method.
- */
-static void tlb_flush_page_by_mmuidx_async_1(CPUState *cpu,
-                                             run_on_cpu_data data)
+void tlb_switch_asid(CPUState *cpu, uint64_t asid)
 {
-    target_ulong addr_and_idxmap = (target_ulong) data.target_ptr;
-    target_ulong addr = addr_and_idxmap & TARGET_PAGE_MASK;
-    uint16_t idxmap = addr_and_idxmap & ~TARGET_PAGE_MASK;
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLB *tlb = env_tlb(env);
+    CPUTLBASIDContext *ctx;
+    int64_t now = tlb_clock_now();
+    uint16_t dirty;
+    int mmu_idx, k;
 
-    tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-}
+    assert_cpu_is_self(cpu);
 
-typedef struct {
-    target_ulong addr;
-    uint16_t idxmap;
-} TLBFlushPageByMMUIdxData;
+    qemu_spin_lock(&tlb->c.lock);
+    if (asid == tlb->c.asid) {
+        qemu_spin_unlock(&tlb->c.lock);
+        return;
+    }
 
-/**
- * tlb_flush_page_by_mmuidx_async_2:
- * @cpu: cpu on which to flush
- * @data: allocated addr + idxmap
- *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The addr+idxmap parameters are stored in a
- * TLBFlushPageByMMUIdxData structure that has been allocated
- * specifically for this helper.  Free the structure when done.
- */
-static void tlb_flush_page_by_mmuidx_async_2(CPUState *cpu,
-                                             run_on_cpu_data data)
-{
-    TLBFlushPageByMMUIdxData *d = data.host_ptr;
+    tlb_debug("asid: 0x%" PRIx64 " -> 0x%" PRIx64 "\n", tlb->c.asid, asid);
 
-    tlb_flush_page_by_mmuidx_async_0(cpu, d->addr, d->idxmap);
-    g_free(d);
-}
+    ctx = tlb_find_asid_ctx_locked(tlb, asid);
+    if (ctx != NULL) {
+        dirty = ctx->dirty;
+    } else {
+        /* Prefer a free slot, or else displace the oldest address space. */
+        for (k = 0; k < CPU_TLB_ASID_CONTEXTS; k++) {
+            if (!tlb->c.asid_ctx[k].valid) {
+                ctx = &tlb->c.asid_ctx[k];
+                break;
+            }
+        }
+        if (ctx == NULL) {
+            ctx = &tlb->c.asid_ctx[tlb->c.asid_next++ % CPU_TLB_ASID_CONTEXTS];
+        }
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            tlb_mmu_resize_locked(&ctx->d[mmu_idx], &ctx->f[mmu_idx], now);
+            tlb_mmu_flush_locked(&ctx->d[mmu_idx], &ctx->f[mmu_idx]);
+        }
+        dirty = 0;
+    }
 
-void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
-{
-    tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%" PRIx16 "\n", addr, idxmap);
+    /* Swap the tables of the two address spaces. */
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        CPUTLBDesc d = tlb->d[mmu_idx];
+        CPUTLBDescFast f = tlb->f[mmu_idx];
 
-    /* This should already be page aligned */
-    addr &= TARGET_PAGE_MASK;
+        tlb->d[mmu_idx] = ctx->d[mmu_idx];
+        tlb->f[mmu_idx] = ctx->f[mmu_idx];
+        ctx->d[mmu_idx] = d;
+        ctx->f[mmu_idx] = f;
+    }
 
-    if (qemu_cpu_is_self(cpu)) {
-        tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-    } else if (idxmap < TARGET_PAGE_SIZE) {
-        /*
-         * Most targets have only a few mmu_idx.  In the case where
-         * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
-         * allocating memory for this operation.
-         */
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
+    if (tlb->c.asid == TLB_ASID_NONE) {
+        /* Nobody can ask for the outgoing entries; don't keep them. */
+        ctx->valid = false;
     } else {
-        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(d));
+        ctx->valid = true;
+        ctx->asid = tlb->c.asid;
+        ctx->dirty = tlb->c.dirty;
     }
-}
+    tlb->c.asid = asid;
+    tlb->c.dirty = dirty;
+    qemu_spin_unlock(&tlb->c.lock);
 
-void tlb_flush_page(CPUState *cpu, target_ulong addr)
-{
-    tlb_flush_page_by_mmuidx(cpu, addr, ALL_MMUIDX_BITS);
+    cpu_tb_jmp_cache_clear(cpu);
 }
 
-void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
-                                       uint16_t idxmap)
+void tlb_flush_asid(CPUState *cpu, uint64_t asid)
 {
-    tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLB *tlb = env_tlb(env);
+    CPUTLBASIDContext *ctx;
+    bool flush_active;
 
-    /* This should already be page aligned */
-    addr &= TARGET_PAGE_MASK;
+    assert_cpu_is_self(cpu);
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                TLBFlushPageByMMUIdxData *d
-                    = g_new(TLBFlushPageByMMUIdxData, 1);
-
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
+    qemu_spin_lock(&tlb->c.lock);
+    ctx = tlb_find_asid_ctx_locked(tlb, asid);
+    if (ctx != NULL) {
+        ctx->valid = false;
+    }
+    flush_active = tlb->c.asid == asid || tlb->c.asid == TLB_ASID_NONE;
+    if (flush_active) {
+        int64_t now = tlb_clock_now();
+        uint16_t work;
+
+        for (work = tlb->c.dirty; work != 0; work &= work - 1) {
+            tlb_flush_one_mmuidx_locked(env, ctz32(work), now);
         }
+        tlb->c.dirty = 0;
     }
+    qemu_spin_unlock(&tlb->c.lock);
 
-    tlb_flush_page_by_mmuidx_async_0(src_cpu, addr, idxmap);
+    if (flush_active) {
+        cpu_tb_jmp_cache_clear(cpu);
+    }
 }
 
-void tlb_flush_page_all_cpus(CPUState *src, target_ulong addr)
+void tlb_flush_page_asid(CPUState *cpu, target_ulong addr, uint64_t asid)
 {
-    tlb_flush_page_by_mmuidx_all_cpus(src, addr, ALL_MMUIDX_BITS);
-}
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLB *tlb = env_tlb(env);
+    CPUTLBASIDContext *ctx;
+    bool flush_active;
+    int mmu_idx;
 
-void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
-                                              target_ulong addr,
-                                              uint16_t idxmap)
-{
-    tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
+    assert_cpu_is_self(cpu);
 
-    /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
-
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                              RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
+    qemu_spin_lock(&tlb->c.lock);
+    ctx = tlb_find_asid_ctx_locked(tlb, asid);
+    if (ctx != NULL) {
+        tlb_flush_page_asid_ctx_locked(ctx, ALL_MMUIDX_BITS, addr);
+    }
+    flush_active = tlb->c.asid == asid || tlb->c.asid == TLB_ASID_NONE;
+    if (flush_active) {
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            tlb_flush_page_locked(env, mmu_idx, addr);
         }
+    }
+    qemu_spin_unlock(&tlb->c.lock);
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
-                              RUN_ON_CPU_HOST_PTR(d));
+    if (flush_active) {
+        tb_flush_jmp_cache(cpu, addr);
     }
 }
 
-void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
-{
-    tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
-}
 
 static void tlb_flush_page_bits_locked(CPUArchState *env, int midx,
                                        target_ulong page, unsigned bits)
 {
-    CPUTLBDesc *d = &env_tlb(env)->d[midx];
     CPUTLBDescFast *f = &env_tlb(env)->f[midx];
     target_ulong mask = MAKE_64BIT_MASK(0, bits);
 
@@ -709,16 +862,13 @@ static void tlb_flush_page_bits_locked(CPUArchState *env, int midx,
         tlb_debug("forcing full flush midx %d ("
                   TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
                   midx, page, mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+        tlb_flush_one_mmuidx_locked(env, midx, tlb_clock_now());
         return;
     }
 
     /* Check if we need to flush due to large pages.  */
-    if ((page & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+    if (!tlb_flush_large_pages_locked(env, midx, page, mask)) {
+        tlb_flush_one_mmuidx_locked(env, midx, tlb_clock_now());
         return;
     }
 
@@ -728,15 +878,10 @@ static void tlb_flush_page_bits_locked(CPUArchState *env, int midx,
     tlb_flush_vtlb_page_mask_locked(env, midx, page, mask);
 }
 
-typedef struct {
-    target_ulong addr;
-    uint16_t idxmap;
-    uint16_t bits;
-} TLBFlushPageBitsByMMUIdxData;
-
-static void
-tlb_flush_page_bits_by_mmuidx_async_0(CPUState *cpu,
-                                      TLBFlushPageBitsByMMUIdxData d)
+static void tlb_flush_page_bits_by_mmuidx_async_0(CPUState *cpu,
+                                                  target_ulong addr,
+                                                  uint16_t idxmap,
+                                                  unsigned bits)
 {
     CPUArchState *env = cpu->env_ptr;
     int mmu_idx;
@@ -744,61 +889,264 @@ tlb_flush_page_bits_by_mmuidx_async_0(CPUState *cpu,
     assert_cpu_is_self(cpu);
 
     tlb_debug("page addr:" TARGET_FMT_lx "/%u mmu_map:0x%x\n",
-              d.addr, d.bits, d.idxmap);
+              addr, bits, idxmap);
 
     qemu_spin_lock(&env_tlb(env)->c.lock);
+    /*
+     * Not worth doing precisely for inactive address spaces: flush
+     * their tables for @idxmap instead.
+     */
+    tlb_flush_asid_ctx_by_mmuidx_locked(env_tlb(env), idxmap,
+                                        tlb_clock_now());
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        if ((d.idxmap >> mmu_idx) & 1) {
-            tlb_flush_page_bits_locked(env, mmu_idx, d.addr, d.bits);
+        if ((idxmap >> mmu_idx) & 1) {
+            tlb_flush_page_bits_locked(env, mmu_idx, addr, bits);
         }
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-    tb_flush_jmp_cache(cpu, d.addr);
+    tb_flush_jmp_cache(cpu, addr);
 }
 
-static bool encode_pbm_to_runon(run_on_cpu_data *out,
-                                TLBFlushPageBitsByMMUIdxData d)
+/**
+ * tlb_flush_range_by_mmuidx_async_0:
+ * @cpu: cpu on which to flush
+ * @addr: page-aligned start of the range
+ * @len: page-aligned length of the range
+ * @idxmap: set of mmu_idx to flush
+ * @bits: number of significant bits in address
+ *
+ * Flush the pages in [@addr, @addr + @len) from the tlbs indicated by
+ * @idxmap from @cpu.  Ranges larger than the default tlb size are
+ * cheaper to flush by dropping the whole tlb.
+ */
+static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
+                                              target_ulong addr,
+                                              target_ulong len,
+                                              uint16_t idxmap,
+                                              unsigned bits)
 {
-    /* We need 6 bits to hold to hold @bits up to 63. */
-    if (d.idxmap <= MAKE_64BIT_MASK(0, TARGET_PAGE_BITS - 6)) {
-        *out = RUN_ON_CPU_TARGET_PTR(d.addr | (d.idxmap << 6) | d.bits);
-        return true;
+    target_ulong i;
+
+    if (bits < TARGET_PAGE_BITS ||
+        len > ((target_ulong)TARGET_PAGE_SIZE << CPU_TLB_DYN_DEFAULT_BITS)) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(idxmap));
+        return;
+    }
+    for (i = 0; i < len; i += TARGET_PAGE_SIZE) {
+        if (bits >= TARGET_LONG_BITS) {
+            tlb_flush_page_by_mmuidx_async_0(cpu, addr + i, idxmap);
+        } else {
+            tlb_flush_page_bits_by_mmuidx_async_0(cpu, addr + i, idxmap, bits);
+        }
     }
-    return false;
 }
 
-static TLBFlushPageBitsByMMUIdxData
-decode_runon_to_pbm(run_on_cpu_data data)
+/*
+ * Flushes requested by other vCPUs are not run as one work item each.
+ * They are coalesced into the target vCPU's batch of pending ranges,
+ * which a single work item drains before the target executes any more
+ * guest code.  Guests unmapping a large area back to back thus cost one
+ * wakeup per vCPU rather than one per page.
+ */
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_pending_add_locked(CPUTLB *tlb, target_ulong addr,
+                                         target_ulong len, uint16_t idxmap,
+                                         unsigned bits)
 {
-    target_ulong addr_map_bits = (target_ulong) data.target_ptr;
-    return (TLBFlushPageBitsByMMUIdxData){
-        .addr = addr_map_bits & TARGET_PAGE_MASK,
-        .idxmap = (addr_map_bits & ~TARGET_PAGE_MASK) >> 6,
-        .bits = addr_map_bits & 0x3f
+    unsigned i;
+
+    for (i = 0; i < tlb->c.n_pending; i++) {
+        CPUTLBPendingFlush *p = &tlb->c.pending[i];
+
+        if (p->idxmap == idxmap && p->bits == bits &&
+            addr <= p->addr + p->len && p->addr <= addr + len) {
+            target_ulong end = MAX(p->addr + p->len, addr + len);
+
+            p->addr = MIN(p->addr, addr);
+            p->len = end - p->addr;
+            return;
+        }
+    }
+    if (tlb->c.n_pending == CPU_TLB_FLUSH_BATCH) {
+        /* Too many disjoint ranges; degrade to a full flush. */
+        tlb->c.pending_full |= idxmap;
+        return;
+    }
+    tlb->c.pending[tlb->c.n_pending++] = (CPUTLBPendingFlush) {
+        .addr = addr, .len = len, .idxmap = idxmap, .bits = bits
     };
 }
 
-static void tlb_flush_page_bits_by_mmuidx_async_1(CPUState *cpu,
-                                                  run_on_cpu_data runon)
+/*
+ * Drain the batch of pending flushes of @cpu.  @data is true when
+ * run as safe work for a synced flush.
+ */
+static void tlb_flush_pending_work(CPUState *cpu, run_on_cpu_data data)
 {
-    tlb_flush_page_bits_by_mmuidx_async_0(cpu, decode_runon_to_pbm(runon));
+    CPUTLB *tlb = env_tlb((CPUArchState *)cpu->env_ptr);
+    CPUTLBPendingFlush batch[CPU_TLB_FLUSH_BATCH];
+    uint16_t full;
+    unsigned i, n;
+
+    qemu_spin_lock(&tlb->c.lock);
+    if (data.host_int) {
+        tlb->c.pending_safe = false;
+    } else {
+        tlb->c.pending_async = false;
+    }
+    n = tlb->c.n_pending;
+    memcpy(batch, tlb->c.pending, n * sizeof(batch[0]));
+    full = tlb->c.pending_full;
+    tlb->c.n_pending = 0;
+    tlb->c.pending_full = 0;
+    qemu_spin_unlock(&tlb->c.lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        if ((batch[i].idxmap & ~full) == 0) {
+            continue;
+        }
+        tlb_flush_range_by_mmuidx_async_0(cpu, batch[i].addr, batch[i].len,
+                                          batch[i].idxmap, batch[i].bits);
+    }
 }
 
-static void tlb_flush_page_bits_by_mmuidx_async_2(CPUState *cpu,
-                                                  run_on_cpu_data data)
+/*
+ * Add a flush to the batch of @cpu, and make sure a work item will drain
+ * it: as safe work if @safe, otherwise as regular async work.
+ */
+static void tlb_flush_range_queue(CPUState *cpu, target_ulong addr,
+                                  target_ulong len, uint16_t idxmap,
+                                  unsigned bits, bool safe)
 {
-    TLBFlushPageBitsByMMUIdxData *d = data.host_ptr;
-    tlb_flush_page_bits_by_mmuidx_async_0(cpu, *d);
-    g_free(d);
+    CPUTLB *tlb = env_tlb((CPUArchState *)cpu->env_ptr);
+    bool *scheduled;
+    bool schedule;
+
+    qemu_spin_lock(&tlb->c.lock);
+    tlb_flush_pending_add_locked(tlb, addr, len, idxmap, bits);
+    scheduled = safe ? &tlb->c.pending_safe : &tlb->c.pending_async;
+    schedule = !*scheduled;
+    *scheduled = true;
+    qemu_spin_unlock(&tlb->c.lock);
+
+    if (!schedule) {
+        return;
+    }
+    if (safe) {
+        async_safe_run_on_cpu(cpu, tlb_flush_pending_work,
+                              RUN_ON_CPU_HOST_INT(true));
+    } else {
+        async_run_on_cpu(cpu, tlb_flush_pending_work,
+                         RUN_ON_CPU_HOST_INT(false));
+    }
+}
+
+static void tlb_flush_range_queue_others(CPUState *src, target_ulong addr,
+                                         target_ulong len, uint16_t idxmap,
+                                         unsigned bits)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu != src) {
+            tlb_flush_range_queue(cpu, addr, len, idxmap, bits, false);
+        }
+    }
+}
+
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap,
+                               unsigned bits)
+{
+    tlb_debug("addr: "TARGET_FMT_lx"/"TARGET_FMT_lx" mmu_idx:%" PRIx16 "\n",
+              addr, len, idxmap);
+
+    len = ROUND_UP(len + (addr & ~TARGET_PAGE_MASK), TARGET_PAGE_SIZE);
+    addr &= TARGET_PAGE_MASK;
+
+    if (qemu_cpu_is_self(cpu)) {
+        tlb_flush_range_by_mmuidx_async_0(cpu, addr, len, idxmap, bits);
+    } else {
+        tlb_flush_range_queue(cpu, addr, len, idxmap, bits, false);
+    }
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
+                                        target_ulong len, uint16_t idxmap,
+                                        unsigned bits)
+{
+    tlb_debug("addr: "TARGET_FMT_lx"/"TARGET_FMT_lx" mmu_idx:%" PRIx16 "\n",
+              addr, len, idxmap);
+
+    len = ROUND_UP(len + (addr & ~TARGET_PAGE_MASK), TARGET_PAGE_SIZE);
+    addr &= TARGET_PAGE_MASK;
+
+    tlb_flush_range_queue_others(src_cpu, addr, len, idxmap, bits);
+    tlb_flush_range_by_mmuidx_async_0(src_cpu, addr, len, idxmap, bits);
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap,
+                                               unsigned bits)
+{
+    tlb_debug("addr: "TARGET_FMT_lx"/"TARGET_FMT_lx" mmu_idx:%" PRIx16 "\n",
+              addr, len, idxmap);
+
+    len = ROUND_UP(len + (addr & ~TARGET_PAGE_MASK), TARGET_PAGE_SIZE);
+    addr &= TARGET_PAGE_MASK;
+
+    tlb_flush_range_queue_others(src_cpu, addr, len, idxmap, bits);
+    tlb_flush_range_queue(src_cpu, addr, len, idxmap, bits, true);
+}
+
+void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
+{
+    tlb_flush_range_by_mmuidx(cpu, addr & TARGET_PAGE_MASK, TARGET_PAGE_SIZE,
+                              idxmap, TARGET_LONG_BITS);
+}
+
+void tlb_flush_page(CPUState *cpu, target_ulong addr)
+{
+    tlb_flush_page_by_mmuidx(cpu, addr, ALL_MMUIDX_BITS);
+}
+
+void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
+                                       uint16_t idxmap)
+{
+    tlb_flush_range_by_mmuidx_all_cpus(src_cpu, addr & TARGET_PAGE_MASK,
+                                       TARGET_PAGE_SIZE, idxmap,
+                                       TARGET_LONG_BITS);
+}
+
+void tlb_flush_page_all_cpus(CPUState *src, target_ulong addr)
+{
+    tlb_flush_page_by_mmuidx_all_cpus(src, addr, ALL_MMUIDX_BITS);
+}
+
+void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                              target_ulong addr,
+                                              uint16_t idxmap)
+{
+    tlb_flush_range_by_mmuidx_all_cpus_synced(src_cpu, addr & TARGET_PAGE_MASK,
+                                              TARGET_PAGE_SIZE, idxmap,
+                                              TARGET_LONG_BITS);
+}
+
+void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
+{
+    tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
 }
 
 void tlb_flush_page_bits_by_mmuidx(CPUState *cpu, target_ulong addr,
                                    uint16_t idxmap, unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
-
     /* If all bits are significant, this devolves to tlb_flush_page. */
     if (bits >= TARGET_LONG_BITS) {
         tlb_flush_page_by_mmuidx(cpu, addr, idxmap);
@@ -810,24 +1158,8 @@ void tlb_flush_page_bits_by_mmuidx(CPUState *cpu, target_ulong addr,
         return;
     }
 
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
-    if (qemu_cpu_is_self(cpu)) {
-        tlb_flush_page_bits_by_mmuidx_async_0(cpu, d);
-    } else if (encode_pbm_to_runon(&runon, d)) {
-        async_run_on_cpu(cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
-    } else {
-        TLBFlushPageBitsByMMUIdxData *p
-            = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        *p = d;
-        async_run_on_cpu(cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(p));
-    }
+    tlb_flush_range_by_mmuidx(cpu, addr & TARGET_PAGE_MASK, TARGET_PAGE_SIZE,
+                              idxmap, bits);
 }
 
 void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *src_cpu,
@@ -835,9 +1167,6 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *src_cpu,
                                             uint16_t idxmap,
                                             unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
-
     /* If all bits are significant, this devolves to tlb_flush_page. */
     if (bits >= TARGET_LONG_BITS) {
         tlb_flush_page_by_mmuidx_all_cpus(src_cpu, addr, idxmap);
@@ -849,30 +1178,8 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *src_cpu,
         return;
     }
 
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
-    if (encode_pbm_to_runon(&runon, d)) {
-        flush_all_helper(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageBitsByMMUIdxData *p;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-                *p = d;
-                async_run_on_cpu(dst_cpu,
-                                 tlb_flush_page_bits_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(p));
-            }
-        }
-    }
-
-    tlb_flush_page_bits_by_mmuidx_async_0(src_cpu, d);
+    tlb_flush_range_by_mmuidx_all_cpus(src_cpu, addr & TARGET_PAGE_MASK,
+                                       TARGET_PAGE_SIZE, idxmap, bits);
 }
 
 void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
@@ -880,9 +1187,6 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                    uint16_t idxmap,
                                                    unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
-
     /* If all bits are significant, this devolves to tlb_flush_page. */
     if (bits >= TARGET_LONG_BITS) {
         tlb_flush_page_by_mmuidx_all_cpus_synced(src_cpu, addr, idxmap);
@@ -894,34 +1198,8 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
         return;
     }
 
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
-    if (encode_pbm_to_runon(&runon, d)) {
-        flush_all_helper(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1,
-                              runon);
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageBitsByMMUIdxData *p;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-                *p = d;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(p));
-            }
-        }
-
-        p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-        *p = d;
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                              RUN_ON_CPU_HOST_PTR(p));
-    }
+    tlb_flush_range_by_mmuidx_all_cpus_synced(src_cpu, addr & TARGET_PAGE_MASK,
+                                              TARGET_PAGE_SIZE, idxmap, bits);
 }
 
 /* update the TLBs so that writes to code in the virtual page 'addr'
@@ -990,28 +1268,42 @@ static inline void copy_tlb_helper_locked(CPUTLBEntry *d, const CPUTLBEntry *s)
  * We must take tlb_c.lock to avoid racing with another vCPU update. The only
  * thing actually updated is the target TLB entry ->addr_write flags.
  */
-void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
+/* Called with tlb_c.lock held */
+static void tlb_reset_dirty_tables_locked(CPUTLBDesc *d, CPUTLBDescFast *f,
+                                          ram_addr_t start1, ram_addr_t length)
 {
-    CPUArchState *env;
-
     int mmu_idx;
 
-    env = cpu->env_ptr;
-    qemu_spin_lock(&env_tlb(env)->c.lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         unsigned int i;
-        unsigned int n = tlb_n_entries(&env_tlb(env)->f[mmu_idx]);
+        unsigned int n = tlb_n_entries(&f[mmu_idx]);
 
         for (i = 0; i < n; i++) {
-            tlb_reset_dirty_range_locked(&env_tlb(env)->f[mmu_idx].table[i],
-                                         start1, length);
+            tlb_reset_dirty_range_locked(&f[mmu_idx].table[i], start1, length);
         }
 
         for (i = 0; i < CPU_VTLB_SIZE; i++) {
-            tlb_reset_dirty_range_locked(&env_tlb(env)->d[mmu_idx].vtable[i],
+            tlb_reset_dirty_range_locked(&d[mmu_idx].vtable[i],
                                          start1, length);
         }
     }
+}
+
+void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
+{
+    CPUArchState *env;
+    int k;
+
+    env = cpu->env_ptr;
+    qemu_spin_lock(&env_tlb(env)->c.lock);
+    tlb_reset_dirty_tables_locked(env_tlb(env)->d, env_tlb(env)->f,
+                                  start1, length);
+    /* Inactive address spaces must not skip the notdirty slow path either */
+    for (k = 0; k < CPU_TLB_ASID_CONTEXTS; k++) {
+        CPUTLBASIDContext *ctx = &env_tlb(env)->c.asid_ctx[k];
+
+        tlb_reset_dirty_tables_locked(ctx->d, ctx->f, start1, length);
+    }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
@@ -1048,13 +1340,15 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
-static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
-                               target_ulong vaddr, target_ulong size)
+/* Main TLB entries filled from a large page that is displaced from the
+   large page table can no longer be flushed precisely, so remember the
+   area they cover and trigger a full TLB flush if it is invalidated.  */
+static void tlb_retire_large_page(CPUArchState *env, int mmu_idx,
+                                  CPUTLBLargeEntry *lp)
 {
     target_ulong lp_addr = env_tlb(env)->d[mmu_idx].large_page_addr;
-    target_ulong lp_mask = ~(size - 1);
+    target_ulong lp_mask = lp->mask;
+    target_ulong vaddr = lp->vaddr;
 
     if (lp_addr == (target_ulong)-1) {
         /* No previous large page.  */
@@ -1070,11 +1364,209 @@ static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
     }
     env_tlb(env)->d[mmu_idx].large_page_addr = lp_addr & lp_mask;
     env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
+    memset(lp, -1, sizeof(*lp));
 }
 
+/* Record a large page as a single entry, replacing any entry that
+   overlaps it.  */
+static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
+                               target_ulong vaddr, hwaddr paddr,
+                               MemTxAttrs attrs, int prot, target_ulong size)
+{
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    target_ulong lp_mask = ~(size - 1);
+    CPUTLBLargeEntry *lp = NULL;
+    int k;
+
+    for (k = 0; k < CPU_LPTLB_SIZE; k++) {
+        CPUTLBLargeEntry *old = &desc->lptable[k];
+
+        if (old->vaddr == (target_ulong)-1 ||
+            ((old->vaddr ^ vaddr) & old->mask & lp_mask) != 0) {
+            continue;
+        }
+        if (lp == NULL && old->mask == lp_mask) {
+            /* Same page, e.g. refilled with more permissions.  */
+            lp = old;
+        } else {
+            tlb_retire_large_page(env, mmu_idx, old);
+        }
+    }
+    if (lp == NULL) {
+        lp = &desc->lptable[desc->lpindex++ % CPU_LPTLB_SIZE];
+        if (lp->vaddr != (target_ulong)-1) {
+            tlb_retire_large_page(env, mmu_idx, lp);
+        }
+    }
+
+    lp->vaddr = vaddr & lp_mask;
+    lp->mask = lp_mask;
+    lp->paddr = paddr - (vaddr & (size - 1));
+    lp->attrs = attrs;
+    lp->prot = prot;
+}
+
+/*
+ * Lockstep icount page ownership
+ *
+ * In the parallel phase of a lockstep icount quantum (see tcg-cpus.c),
+ * a vCPU may only write the RAM pages it owns, and only read the pages
+ * it owns or that are shared, so no vCPU sees the stores that another
+ * one makes in the same phase.  The TLB enforces this: it is not refilled
+ * in the parallel phase, and the entries added in the serial phase grant
+ * what the owner of the page allows plus what the access needs.  The
+ * latter is recorded as a claim, which is granted at the quantum boundary.
+ *
+ * Owners only change at quantum boundaries, when all vCPUs are stopped;
+ * claims are only made by the one vCPU running the serial phase.
+ */
+#define LOCKSTEP_UNOWNED    -2
+#define LOCKSTEP_SHARED     -1
+
+typedef struct LockstepClaim {
+    ram_addr_t page;
+    int cpu_index;
+    bool write;
+} LockstepClaim;
+
+/* RAM page number -> owning cpu_index, LOCKSTEP_SHARED, or none */
+static GHashTable *lockstep_owners;
+static GArray *lockstep_claims;
+
+static int tlb_lockstep_owner(ram_addr_t page)
+{
+    /* Stored off by two, so that LOCKSTEP_UNOWNED is NULL */
+    return GPOINTER_TO_INT(g_hash_table_lookup(lockstep_owners,
+                                               (gpointer)(uintptr_t)page)) - 2;
+}
+
+static void tlb_lockstep_set_owner(ram_addr_t page, int owner)
+{
+    g_hash_table_insert(lockstep_owners, (gpointer)(uintptr_t)page,
+                        GINT_TO_POINTER(owner + 2));
+}
+
+/*
+ * Restrict the permissions @prot of a new TLB entry for @ram_addr to
+ * what @cpu may use in the next parallel phase, except for the access
+ * that the entry is being added for; claim the page for that one.
+ */
+static int tlb_lockstep_prot(CPUState *cpu, ram_addr_t ram_addr, int prot)
+{
+    ram_addr_t page = ram_addr >> TARGET_PAGE_BITS;
+    int owner = tlb_lockstep_owner(page);
+    int allowed, needed;
+
+    if (owner == cpu->cpu_index) {
+        return prot;
+    }
+    allowed = owner == LOCKSTEP_SHARED ? PAGE_READ | PAGE_EXEC : 0;
+
+    switch (env_tlb(cpu->env_ptr)->c.fill_access) {
+    case MMU_DATA_STORE:
+    case MMU_DATA_CAP_STORE:
+        needed = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
+        break;
+    default:
+        needed = PAGE_READ | PAGE_EXEC;
+        break;
+    }
+
+    if (prot & needed & ~allowed) {
+        LockstepClaim claim = {
+            .page = page,
+            .cpu_index = cpu->cpu_index,
+            .write = prot & needed & PAGE_WRITE,
+        };
+
+        g_assert(!cpu->icount_parallel);
+        g_array_append_val(lockstep_claims, claim);
+    }
+    return prot & (allowed | needed | ~(PAGE_READ | PAGE_WRITE | PAGE_EXEC));
+}
+
+static void tlb_lockstep_init(void)
+{
+    if (!lockstep_owners) {
+        lockstep_owners = g_hash_table_new(NULL, NULL);
+        lockstep_claims = g_array_new(false, false, sizeof(LockstepClaim));
+    }
+}
+
+void tlb_lockstep_end_quantum(void)
+{
+    unsigned long *flush;
+    CPUState *cpu;
+    int n_cpus = 0;
+    guint i;
+
+    if (lockstep_claims->len == 0) {
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        n_cpus = MAX(n_cpus, cpu->cpu_index + 1);
+    }
+    flush = bitmap_new(n_cpus);
+
+    /* Grant the claims in the order they were made */
+    for (i = 0; i < lockstep_claims->len; i++) {
+        LockstepClaim *claim = &g_array_index(lockstep_claims,
+                                              LockstepClaim, i);
+        int owner = tlb_lockstep_owner(claim->page);
+
+        if (owner == claim->cpu_index) {
+            continue;
+        }
+        if (claim->write) {
+            /* Take the page from its owner, or from everybody */
+            if (owner == LOCKSTEP_SHARED) {
+                bitmap_fill(flush, n_cpus);
+                bitmap_clear(flush, claim->cpu_index, 1);
+            } else if (owner != LOCKSTEP_UNOWNED) {
+                set_bit(owner, flush);
+            }
+            tlb_lockstep_set_owner(claim->page, claim->cpu_index);
+        } else if (owner == LOCKSTEP_UNOWNED) {
+            tlb_lockstep_set_owner(claim->page, claim->cpu_index);
+        } else if (owner != LOCKSTEP_SHARED) {
+            /* The owner may still be able to write the page */
+            set_bit(owner, flush);
+            tlb_lockstep_set_owner(claim->page, LOCKSTEP_SHARED);
+        }
+    }
+    g_array_set_size(lockstep_claims, 0);
+
+    CPU_FOREACH(cpu) {
+        if (test_bit(cpu->cpu_index, flush)) {
+            tlb_flush(cpu);
+        }
+    }
+    g_free(flush);
+}
+
+/*
+ * Start a TLB refill for @access_type.  Lockstep icount does not refill
+ * the TLB in the parallel phase, because the page table walk reads guest
+ * memory outside the TLB and the new entry may need to claim the page.
+ */
+static inline void tlb_fill_begin(CPUState *cpu, MMUAccessType access_type,
+                                  uintptr_t retaddr)
+{
+    if (unlikely(cpu->icount_parallel)) {
+        cpu_loop_exit_serial(cpu, retaddr);
+    }
+    env_tlb(cpu->env_ptr)->c.fill_access = access_type;
+}
+
+static void tlb_set_page_one(CPUState *cpu, target_ulong vaddr,
+                             hwaddr paddr, MemTxAttrs attrs, int prot,
+                             int mmu_idx, target_ulong size);
+
 /* Add a new TLB entry. At most one entry for a given virtual address
- * is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
- * supplied size is only used by tlb_flush_page.
+ * is permitted. Only a single TARGET_PAGE_SIZE region is mapped; a
+ * larger size is also recorded in the large page table, from which
+ * the rest of the page is refilled on later misses.
  *
  * Called from TCG-generated code, which is under an RCU read-side
  * critical section.
@@ -1082,6 +1574,19 @@ static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
 void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
                              hwaddr paddr, MemTxAttrs attrs, int prot,
                              int mmu_idx, target_ulong size)
+{
+    assert_cpu_is_self(cpu);
+
+    if (size > TARGET_PAGE_SIZE) {
+        tlb_add_large_page(cpu->env_ptr, mmu_idx, vaddr, paddr, attrs, prot,
+                           size);
+    }
+    tlb_set_page_one(cpu, vaddr, paddr, attrs, prot, mmu_idx, size);
+}
+
+static void tlb_set_page_one(CPUState *cpu, target_ulong vaddr,
+                             hwaddr paddr, MemTxAttrs attrs, int prot,
+                             int mmu_idx, target_ulong size)
 {
     CPUArchState *env = cpu->env_ptr;
     CPUTLB *tlb = env_tlb(env);
@@ -1103,7 +1608,6 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     if (size <= TARGET_PAGE_SIZE) {
         sz = TARGET_PAGE_SIZE;
     } else {
-        tlb_add_large_page(env, mmu_idx, vaddr, size);
         sz = size;
     }
     vaddr_page = vaddr & TARGET_PAGE_MASK;
@@ -1151,6 +1655,9 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     write_address = address;
     if (is_ram) {
         iotlb = memory_region_get_ram_addr(section->mr) + xlat;
+        if (icount_lockstep_enabled()) {
+            prot = tlb_lockstep_prot(cpu, iotlb, prot);
+        }
         /*
          * Computing is_clean is expensive; avoid all that unless
          * the page is actually writable.
@@ -1308,6 +1815,49 @@ static inline ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
     return ram_addr;
 }
 
+/*
+ * Refill the TLB entry for @addr from the large page table, if it holds a
+ * large page covering @addr that permits @access_type.
+ * Capability stores always go to tlb_fill, which may need to allocate
+ * tag memory or raise a fault.
+ */
+static bool tlb_fill_from_large_page(CPUState *cpu, target_ulong addr,
+                                     MMUAccessType access_type, int mmu_idx)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    int prot_needed;
+    int k;
+
+    switch (access_type) {
+    case MMU_DATA_LOAD:
+        prot_needed = PAGE_READ;
+        break;
+    case MMU_DATA_STORE:
+        prot_needed = PAGE_WRITE;
+        break;
+    case MMU_INST_FETCH:
+        prot_needed = PAGE_EXEC;
+        break;
+    default:
+        return false;
+    }
+
+    for (k = 0; k < CPU_LPTLB_SIZE; k++) {
+        CPUTLBLargeEntry *lp = &desc->lptable[k];
+
+        if ((addr & lp->mask) == lp->vaddr && (lp->prot & prot_needed)) {
+            target_ulong vaddr_page = addr & TARGET_PAGE_MASK;
+
+            tlb_set_page_one(cpu, vaddr_page,
+                             lp->paddr + (vaddr_page - lp->vaddr),
+                             lp->attrs, lp->prot, mmu_idx, ~lp->mask + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
 /*
  * Note: tlb_fill() can trigger a resize of the TLB. This means that all of the
  * caller's prior references to the TLB table (e.g. CPUTLBEntry pointers) must
@@ -1319,6 +1869,11 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
     CPUClass *cc = CPU_GET_CLASS(cpu);
     bool ok;
 
+    tlb_fill_begin(cpu, access_type, retaddr);
+    if (tlb_fill_from_large_page(cpu, addr, access_type, mmu_idx)) {
+        return;
+    }
+
     /*
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
@@ -1346,6 +1901,9 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     if (!cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
     }
+    if (unlikely(cpu->icount_parallel)) {
+        cpu_loop_exit_serial(cpu, retaddr);
+    }
 
     if (!qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
@@ -1400,6 +1958,9 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     if (!cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
     }
+    if (unlikely(cpu->icount_parallel)) {
+        cpu_loop_exit_serial(cpu, retaddr);
+    }
     cpu->mem_io_pc = retaddr;
 
     /*
@@ -1550,7 +2111,12 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
 
     trace_memory_notdirty_write_access(mem_vaddr, ram_addr, size);
 
-    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
+    /*
+     * The page holds code, but stores to the parts of it without any
+     * can skip the locking and the invalidation.
+     */
+    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE) &&
+        tb_page_has_code(ram_addr, size)) {
         struct page_collection *pages
             = page_collection_lock(ram_addr, ram_addr + size);
         tb_invalidate_phys_page_fast(pages, ram_addr, size, retaddr);
@@ -1621,7 +2187,9 @@ probe_access_internal(CPUArchState *env, target_ulong addr, int fault_size,
             CPUState *cs = env_cpu(env);
             CPUClass *cc = CPU_GET_CLASS(cs);
 
-            if (!cc->tlb_fill(cs, addr, fault_size, access_type,
+            tlb_fill_begin(cs, access_type, retaddr);
+            if (!tlb_fill_from_large_page(cs, addr, access_type, mmu_idx) &&
+                !cc->tlb_fill(cs, addr, fault_size, access_type,
                               mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
                 *phost = NULL;
@@ -1785,6 +2353,11 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     int s_bits = mop & MO_SIZE;
     void *hostaddr;
 
+    /* Lockstep icount orders atomics between vCPUs in the serial phase */
+    if (unlikely(env_cpu(env)->icount_parallel)) {
+        cpu_loop_exit_serial(env_cpu(env), retaddr);
+    }
+
     /* Adjust the given return address.  */
     retaddr -= GETPC_ADJ;
 
@@ -0,0 +1,206 @@
+/*
+ * Per-TranslationBlock execution statistics
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/qht.h"
+#include "qemu/xxhash.h"
+#include "qemu/qemu-print.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/tb-stats.h"
+
+#define TB_STATS_INITIAL_SIZE 1024
+
+static struct qht tb_stats_ht;
+static bool tb_stats_enabled;
+
+static bool tb_stats_cmp(const void *ap, const void *bp)
+{
+    const TBStatistics *a = ap;
+    const TBStatistics *b = bp;
+
+    return a->phys_pc == b->phys_pc &&
+        a->pc == b->pc &&
+        a->flags == b->flags &&
+        a->cflags == b->cflags;
+}
+
+static void __attribute__((constructor)) tb_stats_init(void)
+{
+    qht_init(&tb_stats_ht, tb_stats_cmp, TB_STATS_INITIAL_SIZE,
+             QHT_MODE_AUTO_RESIZE);
+}
+
+bool tb_stats_is_enabled(void)
+{
+    return qatomic_read(&tb_stats_enabled);
+}
+
+/*
+ * Only TBs translated while collection is enabled carry the instrumentation,
+ * so flush the code cache whenever the setting changes.
+ */
+static void tb_stats_set_enabled(bool enabled)
+{
+    if (qatomic_xchg(&tb_stats_enabled, enabled) != enabled && first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+void tb_stats_enable(void)
+{
+    tb_stats_set_enabled(true);
+}
+
+void tb_stats_disable(void)
+{
+    tb_stats_set_enabled(false);
+}
+
+static void tb_stats_reset_one(void *p, uint32_t h, void *up)
+{
+    TBStatistics *s = p;
+
+    qatomic_set_u64(&s->executions, 0);
+    qatomic_set_u64(&s->exits, 0);
+    qatomic_set_u64(&s->translations, 0);
+}
+
+void tb_stats_reset(void)
+{
+    qht_iter(&tb_stats_ht, tb_stats_reset_one, NULL);
+}
+
+TBStatistics *tb_stats_get(uint64_t phys_pc, uint64_t pc, uint32_t flags,
+                           uint32_t cflags)
+{
+    TBStatistics orig = {
+        .phys_pc = phys_pc,
+        .pc = pc,
+        .flags = flags,
+        .cflags = cflags,
+    };
+    TBStatistics *s;
+    void *existing = NULL;
+    uint32_t hash;
+
+    hash = qemu_xxhash6(phys_pc, pc, flags, cflags);
+    s = qht_lookup(&tb_stats_ht, &orig, hash);
+    if (s) {
+        return s;
+    }
+    s = g_new(TBStatistics, 1);
+    *s = orig;
+    qht_insert(&tb_stats_ht, s, hash, &existing);
+    if (unlikely(existing)) {
+        g_free(s);
+        s = existing;
+    }
+    return s;
+}
+
+static uint64_t tb_stats_key(const TBStatistics *s,
+                             enum TBStatsSortKey sort_by)
+{
+    switch (sort_by) {
+    case TB_STATS_KEY_EXECUTIONS:
+        return s->executions;
+    case TB_STATS_KEY_EXITS:
+        return s->exits;
+    case TB_STATS_KEY_TRANSLATIONS:
+        return s->translations;
+    case TB_STATS_KEY_HOST_BYTES:
+        return s->host_bytes;
+    case TB_STATS_KEY_HELPER_CALLS:
+        return s->helper_calls;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static gint tb_stats_sort_cmp(gconstpointer ap, gconstpointer bp, gpointer up)
+{
+    const TBStatistics *a = ap;
+    const TBStatistics *b = bp;
+    enum TBStatsSortKey sort_by = *(enum TBStatsSortKey *)up;
+    uint64_t ka = tb_stats_key(a, sort_by);
+    uint64_t kb = tb_stats_key(b, sort_by);
+
+    if (ka > kb) {
+        return -1;
+    } else if (ka < kb) {
+        return 1;
+    }
+    return a->pc < b->pc ? -1 : a->pc > b->pc;
+}
+
+/*
+ * The entries are live and may be updated concurrently by vCPU threads;
+ * read each field once (and without tearing) into a private copy.
+ */
+static void tb_stats_snapshot_one(void *p, uint32_t h, void *up)
+{
+    const TBStatistics *s = p;
+    GArray *arr = up;
+    TBStatistics copy = {
+        .phys_pc = s->phys_pc,
+        .pc = s->pc,
+        .flags = s->flags,
+        .cflags = s->cflags,
+        .executions = qatomic_read_u64(&s->executions),
+        .exits = qatomic_read_u64(&s->exits),
+        .translations = qatomic_read_u64(&s->translations),
+        .guest_insns = qatomic_read(&s->guest_insns),
+        .host_bytes = qatomic_read(&s->host_bytes),
+        .ops_before_opt = qatomic_read(&s->ops_before_opt),
+        .ops_after_opt = qatomic_read(&s->ops_after_opt),
+        .helper_calls = qatomic_read(&s->helper_calls),
+    };
+
+    if (copy.executions || copy.translations) {
+        g_array_append_val(arr, copy);
+    }
+}
+
+size_t tb_stats_collect(TBStatistics **snap, size_t max,
+                        enum TBStatsSortKey sort_by)
+{
+    GArray *arr = g_array_new(false, false, sizeof(TBStatistics));
+    size_t n;
+
+    qht_iter(&tb_stats_ht, tb_stats_snapshot_one, arr);
+    g_array_sort_with_data(arr, tb_stats_sort_cmp, &sort_by);
+    n = MIN(arr->len, max);
+    g_array_set_size(arr, n);
+    *snap = (TBStatistics *)g_array_free(arr, false);
+    return n;
+}
+
+void tb_stats_report(size_t max, enum TBStatsSortKey sort_by)
+{
+    TBStatistics *snap;
+    size_t i, n;
+
+    n = tb_stats_collect(&snap, max, sort_by);
+    if (!tb_stats_is_enabled()) {
+        qemu_printf("TB statistics collection is off\n");
+    }
+    qemu_printf("%-18s %-18s %-8s %12s %10s %6s %5s %6s %7s %7s\n",
+                "PC", "Phys PC", "Flags", "Executions", "Exits", "Xlate",
+                "Insns", "Host", "Ops", "Helpers");
+    for (i = 0; i < n; i++) {
+        const TBStatistics *s = &snap[i];
+
+        qemu_printf("0x%016" PRIx64 " 0x%016" PRIx64 " %08" PRIx32
+                    " %12" PRIu64 " %10" PRIu64 " %6" PRIu64 " %5" PRIu32
+                    " %6" PRIu32 " %3" PRIu32 "/%-3" PRIu32 " %7" PRIu32 "\n",
+                    s->pc, s->phys_pc, s->flags, s->executions, s->exits,
+                    s->translations, s->guest_insns, s->host_bytes,
+                    s->ops_before_opt, s->ops_after_opt, s->helper_calls);
+    }
+    g_free(snap);
+}
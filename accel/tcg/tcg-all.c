@@ -27,6 +27,7 @@
 #include "qemu-common.h"
 #include "sysemu/tcg.h"
 #include "sysemu/cpu-timers.h"
+#include "sysemu/replay.h"
 #include "tcg/tcg.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
@@ -112,6 +113,7 @@ static int tcg_init(MachineState *ms)
 
     tcg_exec_init(s->tb_size * 1024 * 1024, s->splitwx_enabled);
     mttcg_enabled = s->mttcg_enabled;
+    icount_lockstep = mttcg_enabled && icount_enabled();
     cpus_register_accel(&tcg_cpus);
 
     return 0;
@@ -131,8 +133,10 @@ static void tcg_set_thread(Object *obj, const char *value, Error **errp)
     if (strcmp(value, "multi") == 0) {
         if (TCG_OVERSIZED_GUEST) {
             error_setg(errp, "No MTTCG when guest word size > hosts");
-        } else if (icount_enabled()) {
-            error_setg(errp, "No MTTCG when icount is enabled");
+        } else if (icount_enabled() && replay_mode != REPLAY_MODE_NONE) {
+            error_setg(errp, "No MTTCG when record/replay is enabled");
+        } else if (icount_enabled() == 2) {
+            error_setg(errp, "Lockstep icount needs a fixed icount shift");
         } else {
 #ifndef TARGET_SUPPORTS_MTTCG
             warn_report("Guest not yet converted to MTTCG - "
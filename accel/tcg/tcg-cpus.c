@@ -462,6 +462,218 @@ static void *tcg_cpu_thread_fn(void *arg)
     return NULL;
 }
 
+/*
+ * Lockstep multi-threaded icount
+ *
+ * Every vCPU has its own thread, but all of them execute quanta of the
+ * same number of instructions and wait for each other at the end of
+ * each quantum. A quantum has three phases:
+ *
+ * - parallel: all vCPUs run without the BQL. The first I/O access,
+ *   atomic operation or TLB miss of a vCPU ends its parallel phase
+ *   (EXCP_SERIAL). The TLB only gives a vCPU access to the RAM pages
+ *   that no other vCPU writes in the meantime (see cputlb.c).
+ * - serial: the vCPUs that stopped early finish their quantum one at a
+ *   time in cpu_index order, with I/O allowed.
+ * - boundary: the last vCPU to finish advances QEMU_CLOCK_VIRTUAL by
+ *   the quantum, runs the expired timers and sizes the next quantum.
+ *
+ * Device accesses, guest atomics, timer events and shared memory are
+ * therefore ordered independently of host timing; input from outside
+ * the guest is not. The state below is protected by the BQL;
+ * all lockstep vCPUs share one halt_cond, so kicks wake every waiter.
+ */
+static struct {
+    QemuCond *halt_cond;
+    /* Number of vCPU threads taking part */
+    int nr_cpus;
+    /* Threads that have not finished the parallel phase */
+    int nr_parallel;
+    /* Length of the current quantum, in instructions */
+    int64_t budget;
+    /* Incremented at every quantum boundary */
+    uint64_t generation;
+    /* vCPU running the serial phase */
+    CPUState *serial_cpu;
+} lockstep = {
+    .budget = 1,
+};
+
+/*
+ * Unlike all_cpu_threads_idle(), only look at guest state, which is the
+ * same on every run at a quantum boundary.
+ */
+static bool tcg_lockstep_all_halted(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (!cpu->halted || cpu_has_work(cpu)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void tcg_lockstep_end_quantum(void)
+{
+    int64_t deadline;
+    int64_t budget;
+
+    tlb_lockstep_end_quantum();
+    icount_lockstep_advance(lockstep.budget);
+    notify_aio_contexts();
+
+    for (;;) {
+        deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                              QEMU_TIMER_ATTR_ALL);
+        if (deadline >= 0 || !all_cpu_threads_idle()) {
+            break;
+        }
+        /* Nothing can happen until an external event wakes a vCPU */
+        qemu_cond_wait_iothread(lockstep.halt_cond);
+    }
+
+    if (deadline < 0) {
+        budget = icount_lockstep_quantum;
+    } else if (tcg_lockstep_all_halted()) {
+        /* Jump to the next deadline, as with icount sleep=off */
+        budget = icount_round(deadline);
+    } else {
+        budget = MIN(icount_lockstep_quantum, icount_round(deadline));
+    }
+    lockstep.budget = MAX(budget, 1);
+    lockstep.nr_parallel = lockstep.nr_cpus;
+    lockstep.generation++;
+}
+
+/* Hand the serial phase to the next vCPU after @cpu that needs it. */
+static void tcg_lockstep_serial_next(CPUState *cpu)
+{
+    cpu = cpu ? CPU_NEXT(cpu) : first_cpu;
+    while (cpu && !cpu->icount_serial) {
+        cpu = CPU_NEXT(cpu);
+    }
+    lockstep.serial_cpu = cpu;
+    if (!cpu) {
+        tcg_lockstep_end_quantum();
+    }
+    qemu_cond_broadcast(lockstep.halt_cond);
+}
+
+static void tcg_lockstep_leave_parallel(void)
+{
+    if (--lockstep.nr_parallel == 0) {
+        tcg_lockstep_serial_next(NULL);
+    }
+}
+
+/*
+ * Run @cpu until it has used its budget for the quantum or halts. In the
+ * parallel phase, also stop at the first operation that has to wait for
+ * the serial phase and return true.
+ */
+static bool tcg_lockstep_run(CPUState *cpu, bool parallel)
+{
+    bool serial = false;
+
+    while (cpu_neg(cpu)->icount_decr.u16.low + cpu->icount_extra != 0) {
+        int r;
+
+        if (!cpu_can_run(cpu)) {
+            qemu_wait_io_event(cpu);
+            continue;
+        }
+
+        qemu_mutex_unlock_iothread();
+        cpu->icount_parallel = parallel;
+        r = tcg_cpu_exec(cpu);
+        cpu->icount_parallel = false;
+        qemu_mutex_lock_iothread();
+
+        if (r == EXCP_HALTED) {
+            break;
+        } else if (r == EXCP_DEBUG) {
+            cpu_handle_guest_debug(cpu);
+        } else if (r == EXCP_SERIAL || (r == EXCP_ATOMIC && parallel)) {
+            serial = true;
+            break;
+        } else if (r == EXCP_ATOMIC) {
+            qemu_mutex_unlock_iothread();
+            cpu_exec_step_atomic(cpu);
+            qemu_mutex_lock_iothread();
+        }
+        qatomic_mb_set(&cpu->exit_request, 0);
+        qemu_wait_io_event_common(cpu);
+    }
+    return serial;
+}
+
+static void *tcg_lockstep_cpu_thread_fn(void *arg)
+{
+    CPUState *cpu = arg;
+    uint64_t generation;
+
+    assert(tcg_enabled());
+    g_assert(icount_lockstep_enabled());
+
+    rcu_register_thread();
+    tcg_register_thread();
+
+    qemu_mutex_lock_iothread();
+    qemu_thread_get_self(cpu->thread);
+
+    cpu->thread_id = qemu_get_thread_id();
+    cpu->can_do_io = 1;
+    current_cpu = cpu;
+    cpu_thread_signal_created(cpu);
+    qemu_guest_random_seed_thread_part2(cpu->random_seed);
+
+    /* Join the current quantum */
+    lockstep.nr_cpus++;
+    lockstep.nr_parallel++;
+    generation = lockstep.generation;
+
+    do {
+        int64_t insns_left;
+
+        cpu->icount_budget = lockstep.budget;
+        cpu->icount_quantum_done = 0;
+        insns_left = MIN(0xffff, cpu->icount_budget);
+        cpu_neg(cpu)->icount_decr.u16.low = insns_left;
+        cpu->icount_extra = cpu->icount_budget - insns_left;
+
+        cpu->icount_serial = tcg_lockstep_run(cpu, true);
+        tcg_lockstep_leave_parallel();
+
+        while (lockstep.generation == generation) {
+            if (lockstep.serial_cpu == cpu) {
+                tcg_lockstep_run(cpu, false);
+                cpu->icount_serial = false;
+                tcg_lockstep_serial_next(cpu);
+            } else {
+                qemu_cond_wait_iothread(cpu->halt_cond);
+                qemu_wait_io_event_common(cpu);
+            }
+        }
+        generation = lockstep.generation;
+
+        /* Whatever is left of the budget was spent idle */
+        cpu_neg(cpu)->icount_decr.u16.low = 0;
+        cpu->icount_extra = 0;
+        cpu->icount_budget = 0;
+    } while (!cpu->unplug || cpu_can_run(cpu));
+
+    lockstep.nr_cpus--;
+    tcg_lockstep_leave_parallel();
+
+    qemu_tcg_destroy_vcpu(cpu);
+    cpu_thread_signal_destroyed(cpu);
+    qemu_mutex_unlock_iothread();
+    rcu_unregister_thread();
+    return NULL;
+}
+
 static void tcg_start_vcpu_thread(CPUState *cpu)
 {
     char thread_name[VCPU_THREAD_NAME_SIZE];
@@ -484,10 +696,23 @@ static void tcg_start_vcpu_thread(CPUState *cpu)
 
     if (qemu_tcg_mttcg_enabled() || !single_tcg_cpu_thread) {
         cpu->thread = g_malloc0(sizeof(QemuThread));
-        cpu->halt_cond = g_malloc0(sizeof(QemuCond));
-        qemu_cond_init(cpu->halt_cond);
+        if (icount_lockstep_enabled() && lockstep.halt_cond) {
+            cpu->halt_cond = lockstep.halt_cond;
+        } else {
+            cpu->halt_cond = g_malloc0(sizeof(QemuCond));
+            qemu_cond_init(cpu->halt_cond);
+        }
+
+        if (icount_lockstep_enabled()) {
+            /* one thread per vCPU, running in lockstep */
+            snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
+                     cpu->cpu_index);
 
-        if (qemu_tcg_mttcg_enabled()) {
+            lockstep.halt_cond = cpu->halt_cond;
+            qemu_thread_create(cpu->thread, thread_name,
+                               tcg_lockstep_cpu_thread_fn,
+                               cpu, QEMU_THREAD_JOINABLE);
+        } else if (qemu_tcg_mttcg_enabled()) {
             /* create a thread per vCPU with TCG (MTTCG) */
             snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
                  cpu->cpu_index);
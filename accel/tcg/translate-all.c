@@ -49,6 +49,7 @@
 
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
+#include "exec/tb-stats.h"
 #include "translate-all.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
@@ -103,6 +104,12 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+/*
+ * Each bit of PageDesc.code_chunks covers 1 << SMC_CHUNK_BITS bytes of the
+ * page: 64 bytes, or more if that would not fit the page in a long.
+ */
+#define SMC_CHUNK_BITS MAX(TARGET_PAGE_BITS - ctz32(BITS_PER_LONG), 6)
+
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
@@ -111,8 +118,8 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned long *code_bitmap;
     unsigned int code_write_count;
-#else
-    unsigned long flags;
+    /* chunks of the page that may hold code, read without the lock */
+    unsigned long code_chunks;
 #endif
 #ifndef CONFIG_USER_ONLY
     QemuSpin lock;
@@ -217,6 +224,168 @@ static int v_l2_levels;
 
 static void *l1_map[V_L1_MAX_SIZE];
 
+#ifdef CONFIG_USER_ONLY
+/*
+ * The flags of guest pages are kept as a set of disjoint ranges, ordered by
+ * address, so that large mappings cost a single node. Unmapped pages are not
+ * covered by any range, and adjacent ranges always have different flags.
+ * l1_map only holds PageDescs for pages that contain translated code.
+ * Both are protected by mmap_lock.
+ *
+ * A range is never modified once inserted, and is freed after an RCU grace
+ * period. This lets page_get_flags() and page_check_range() look ranges up
+ * in pageflags_cache without mmap_lock; on a miss they take the lock, search
+ * the tree and refill the cache.
+ */
+typedef struct PageFlagsNode {
+    struct rcu_head rcu;
+    target_ulong start;
+    target_ulong last;
+    int flags;
+} PageFlagsNode;
+
+static GTree *pageflags_root;
+
+/* Indexed by 64KiB block: the last range found covering an address in it */
+#define PAGEFLAGS_CACHE_BITS 8
+#define PAGEFLAGS_CACHE_SHIFT 16
+
+static PageFlagsNode *pageflags_cache[1 << PAGEFLAGS_CACHE_BITS];
+
+static PageFlagsNode **pageflags_cache_slot(target_ulong addr)
+{
+    return &pageflags_cache[(addr >> PAGEFLAGS_CACHE_SHIFT) &
+                            ((1 << PAGEFLAGS_CACHE_BITS) - 1)];
+}
+
+/* Return the cached range covering @addr, or NULL. Call under RCU. */
+static PageFlagsNode *pageflags_cache_find(target_ulong addr)
+{
+    PageFlagsNode *p = qatomic_rcu_read(pageflags_cache_slot(addr));
+
+    return p && p->start <= addr && addr <= p->last ? p : NULL;
+}
+
+/* GTree key destructor: readers may still hold @data from the cache */
+static void pageflags_free(gpointer data)
+{
+    PageFlagsNode *p = data;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(pageflags_cache); i++) {
+        if (pageflags_cache[i] == p) {
+            qatomic_set(&pageflags_cache[i], NULL);
+        }
+    }
+    g_free_rcu(p, rcu);
+}
+
+/* Overlapping ranges compare equal, so a lookup finds any of them */
+static gint pageflags_cmp(gconstpointer a, gconstpointer b, gpointer data)
+{
+    const PageFlagsNode *m1 = a, *m2 = b;
+
+    if (m1->last < m2->start) {
+        return -1;
+    } else if (m1->start > m2->last) {
+        return 1;
+    }
+    return 0;
+}
+
+struct pageflags_search {
+    target_ulong addr;
+    PageFlagsNode *found;
+};
+
+static gint pageflags_search_cb(gconstpointer key, gconstpointer data)
+{
+    PageFlagsNode *p = (PageFlagsNode *)key;
+    struct pageflags_search *s = (struct pageflags_search *)data;
+
+    if (p->last < s->addr) {
+        return 1;
+    }
+    /* The lowest range ending at or after addr seen so far */
+    s->found = p;
+    return p->start <= s->addr ? 0 : -1;
+}
+
+/* Return the first range that overlaps [start, last], or NULL. */
+static PageFlagsNode *pageflags_find(target_ulong start, target_ulong last)
+{
+    struct pageflags_search s = { .addr = start };
+
+    g_tree_search(pageflags_root, pageflags_search_cb, &s);
+    return s.found && s.found->start <= last ? s.found : NULL;
+}
+
+static void pageflags_insert(target_ulong start, target_ulong last, int flags)
+{
+    PageFlagsNode *p = g_new(PageFlagsNode, 1);
+
+    p->start = start;
+    p->last = last;
+    p->flags = flags;
+    g_tree_insert(pageflags_root, p, p);
+}
+
+/* Return the range covering @addr, or NULL, and cache it for lookups. */
+static PageFlagsNode *pageflags_lookup(target_ulong addr)
+{
+    PageFlagsNode *p = pageflags_find(addr, addr);
+
+    if (p) {
+        qatomic_rcu_set(pageflags_cache_slot(addr), p);
+    }
+    return p;
+}
+
+static int pageflags_get(target_ulong addr)
+{
+    PageFlagsNode *p = pageflags_lookup(addr);
+
+    return p ? p->flags : 0;
+}
+
+/* Set the flags of [start, last] to @flags, dropping the range if zero. */
+static void pageflags_set(target_ulong start, target_ulong last, int flags)
+{
+    PageFlagsNode *p;
+
+    while ((p = pageflags_find(start, last))) {
+        PageFlagsNode old = *p;
+
+        g_tree_remove(pageflags_root, p);
+        if (old.start < start) {
+            pageflags_insert(old.start, start - 1, old.flags);
+        }
+        if (old.last > last) {
+            pageflags_insert(last + 1, old.last, old.flags);
+        }
+    }
+
+    if (flags == 0) {
+        return;
+    }
+    if (start != 0) {
+        p = pageflags_find(start - 1, start - 1);
+        if (p && p->flags == flags) {
+            start = p->start;
+            g_tree_remove(pageflags_root, p);
+        }
+    }
+    if (last + 1 != 0) {
+        p = pageflags_find(last + 1, last + 1);
+        if (p && p->flags == flags) {
+            last = p->last;
+            g_tree_remove(pageflags_root, p);
+        }
+    }
+    pageflags_insert(start, last, flags);
+}
+#endif
+
 /* code generation context */
 TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
@@ -423,6 +592,9 @@ static void page_init(void)
 {
     page_size_init();
     page_table_config_init();
+#ifdef CONFIG_USER_ONLY
+    pageflags_root = g_tree_new_full(pageflags_cmp, NULL, pageflags_free, NULL);
+#endif
 
 #if defined(CONFIG_BSD) && defined(CONFIG_USER_ONLY)
     {
@@ -561,6 +733,45 @@ static inline PageDesc *page_find(tb_page_addr_t index)
     return page_find_alloc(index, 0);
 }
 
+/*
+ * Return the PageDesc of the first page in [*pindex, last] that has one,
+ * storing its index in *pindex. Unallocated parts of l1_map are skipped
+ * without visiting each page.
+ */
+static PageDesc *page_find_next(tb_page_addr_t *pindex, tb_page_addr_t last)
+{
+    tb_page_addr_t index = *pindex;
+
+    while (index <= last) {
+        void **lp = l1_map + ((index >> v_l1_shift) & (v_l1_size - 1));
+        tb_page_addr_t skip = V_L2_SIZE;
+        PageDesc *pd;
+        int i;
+
+        for (i = v_l2_levels; i > 0; i--) {
+            void **p = qatomic_rcu_read(lp);
+
+            if (p == NULL) {
+                skip = (tb_page_addr_t)1 << ((i + 1) * V_L2_BITS);
+                break;
+            }
+            lp = p + ((index >> (i * V_L2_BITS)) & (V_L2_SIZE - 1));
+        }
+        if (i == 0) {
+            pd = qatomic_rcu_read(lp);
+            if (pd) {
+                *pindex = index;
+                return pd + (index & (V_L2_SIZE - 1));
+            }
+        }
+        if ((index | (skip - 1)) >= last) {
+            break;
+        }
+        index = (index | (skip - 1)) + 1;
+    }
+    return NULL;
+}
+
 static void page_lock_pair(PageDesc **ret_p1, tb_page_addr_t phys1,
                            PageDesc **ret_p2, tb_page_addr_t phys2, int alloc);
 
@@ -1358,6 +1569,9 @@ static inline void invalidate_page_bitmap(PageDesc *p)
     g_free(p->code_bitmap);
     p->code_bitmap = NULL;
     p->code_write_count = 0;
+    if (!p->first_tb) {
+        qatomic_set(&p->code_chunks, 0);
+    }
 #endif
 }
 
@@ -1461,6 +1675,42 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+/*
+ * Make room in the code buffer by evicting the oldest region's TBs, and only
+ * flush everything if there is no region that can be evicted.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    bool evicted = false;
+
+    mmap_lock();
+    /* A flush requested meanwhile has already made room; just retry. */
+    if (tb_ctx.tb_flush_count == tb_flush_count.host_int) {
+        qemu_thread_jit_write();
+        evicted = tcg_region_evict_oldest();
+        qemu_thread_jit_execute();
+    } else {
+        evicted = true;
+    }
+    mmap_unlock();
+
+    if (!evicted) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict,
+                              RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1690,6 +1940,38 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 }
 
 #ifdef CONFIG_SOFTMMU
+/* Return the part [*tb_start, *tb_end[ of its @n-th page that @tb covers */
+static void tb_page_range(TranslationBlock *tb, unsigned int n,
+                          int *tb_start, int *tb_end)
+{
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        /* NOTE: tb_end may be after the end of the page, but
+           it is not a problem */
+        *tb_start = tb->pc & ~TARGET_PAGE_MASK;
+        *tb_end = *tb_start + tb->size;
+        if (*tb_end > TARGET_PAGE_SIZE) {
+            *tb_end = TARGET_PAGE_SIZE;
+        }
+    } else {
+        *tb_start = 0;
+        *tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+}
+
+/* Return the mask of the chunks containing bytes [start, end[ of a page */
+static unsigned long page_chunk_mask(int start, int end)
+{
+    int first, last;
+
+    if (end <= start) {
+        return 0;
+    }
+    first = start >> SMC_CHUNK_BITS;
+    last = (end - 1) >> SMC_CHUNK_BITS;
+    return (~0UL << first) & (~0UL >> (BITS_PER_LONG - 1 - last));
+}
+
 /* call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
 {
@@ -1700,22 +1982,28 @@ static void build_page_bitmap(PageDesc *p)
     p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
 
     PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
+        tb_page_range(tb, n, &tb_start, &tb_end);
         bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
     }
 }
+
+/*
+ * Recompute the code chunks of @p, dropping those whose TBs are gone.
+ * call with @p->lock held
+ */
+static void build_page_chunks(PageDesc *p)
+{
+    int n, tb_start, tb_end;
+    TranslationBlock *tb;
+    unsigned long chunks = 0;
+
+    assert_page_locked(p);
+    PAGE_FOR_EACH_TB(p, tb, n) {
+        tb_page_range(tb, n, &tb_start, &tb_end);
+        chunks |= page_chunk_mask(tb_start, tb_end);
+    }
+    qatomic_set(&p->code_chunks, chunks);
+}
 #endif
 
 /* add the tb in the target page and protect it if necessary
@@ -1728,6 +2016,7 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
 {
 #ifndef CONFIG_USER_ONLY
     bool page_already_protected;
+    int tb_start, tb_end;
 #endif
 
     assert_page_locked(p);
@@ -1741,9 +2030,8 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     invalidate_page_bitmap(p);
 
 #if defined(CONFIG_USER_ONLY)
-    if (p->flags & PAGE_WRITE) {
+    if (pageflags_get(page_addr) & PAGE_WRITE) {
         target_ulong addr;
-        PageDesc *p2;
         int prot;
 
         /* force the host page as non writable (writes will have a
@@ -1752,14 +2040,15 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
         prot = 0;
         for (addr = page_addr; addr < page_addr + qemu_host_page_size;
             addr += TARGET_PAGE_SIZE) {
+            int flags = pageflags_get(addr);
 
-            p2 = page_find(addr >> TARGET_PAGE_BITS);
-            if (!p2) {
+            if (!flags) {
                 continue;
             }
-            prot |= p2->flags;
-            p2->flags &= ~PAGE_WRITE;
-          }
+            prot |= flags;
+            pageflags_set(addr, addr + TARGET_PAGE_SIZE - 1,
+                          flags & ~PAGE_WRITE);
+        }
         mprotect(g2h(page_addr), qemu_host_page_size,
                  (prot & PAGE_BITS) & ~PAGE_WRITE);
         if (DEBUG_TB_INVALIDATE_GATE) {
@@ -1767,6 +2056,11 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
         }
     }
 #else
+    /* stores to the other chunks of the page can skip invalidation */
+    tb_page_range(tb, n, &tb_start, &tb_end);
+    qatomic_set(&p->code_chunks,
+                p->code_chunks | page_chunk_mask(tb_start, tb_end));
+
     /* if some code is already present, then the pages are already
        protected. So we handle the case where only the first TB is
        allocated in a physical page */
@@ -1900,10 +2194,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction (or a full flush) must be done */
+        tb_evict(cpu);
         mmap_unlock();
-        /* Make the execution loop process the flush as soon as possible.  */
+        /* Make the execution loop process the eviction as soon as possible. */
         cpu->exception_index = EXCP_INTERRUPT;
         cpu_loop_exit(cpu);
     }
@@ -1918,6 +2212,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
     tb->cflags = cflags;
     tb->orig_tb = NULL;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->tb_stats = NULL;
+    if (unlikely(tb_stats_is_enabled()) && !(cflags & CF_NOCACHE)) {
+        tb->tb_stats = tb_stats_get(phys_pc, pc, flags, cflags & CF_HASH_MASK);
+    }
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -2104,6 +2402,14 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
         return existing_tb;
     }
     tcg_tb_insert(tb);
+
+    if (unlikely(tb->tb_stats)) {
+        TBStatistics *stats = tb->tb_stats;
+
+        qatomic_set_u64(&stats->translations, stats->translations + 1);
+        qatomic_set(&stats->guest_insns, tb->icount);
+        qatomic_set(&stats->host_bytes, gen_code_size);
+    }
     return tb;
 }
 
@@ -2188,6 +2494,8 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
     if (!p->first_tb) {
         invalidate_page_bitmap(p);
         tlb_unprotect_code(start);
+    } else {
+        build_page_chunks(p);
     }
 #endif
 #ifdef TARGET_HAS_PRECISE_SMC
@@ -2242,21 +2550,23 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end)
 #endif
 {
     struct page_collection *pages;
-    tb_page_addr_t next;
+    tb_page_addr_t index, last;
+    PageDesc *pd;
 
     assert_memory_lock();
 
     pages = page_collection_lock(start, end);
-    for (next = (start & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
-         start < end;
-         start = next, next += TARGET_PAGE_SIZE) {
-        PageDesc *pd = page_find(start >> TARGET_PAGE_BITS);
-        tb_page_addr_t bound = MIN(next, end);
-
-        if (pd == NULL) {
-            continue;
-        }
+    index = start >> TARGET_PAGE_BITS;
+    last = (end - 1) >> TARGET_PAGE_BITS;
+    /* Only pages that have a PageDesc can hold translated code */
+    while (start < end && (pd = page_find_next(&index, last))) {
+        tb_page_addr_t addr = index << TARGET_PAGE_BITS;
+        tb_page_addr_t bound = MIN(addr + TARGET_PAGE_SIZE, end);
+
+        start = MAX(start, addr);
         tb_invalidate_phys_page_range__locked(pages, pd, start, bound, 0);
+        start = bound;
+        index++;
     }
     page_collection_unlock(pages);
 }
@@ -2301,6 +2611,27 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
                                               retaddr);
     }
 }
+
+/*
+ * Return false if a store to [@start, @start + len[, which must not cross a
+ * page boundary, does not need tb_invalidate_phys_page_fast because no
+ * translated code overlaps it. No lock is needed: code_chunks only loses
+ * bits once the TBs they cover are gone, and a stale bit merely costs a
+ * trip through the slow path.
+ */
+bool tb_page_has_code(tb_page_addr_t start, int len)
+{
+    PageDesc *p = page_find(start >> TARGET_PAGE_BITS);
+    int offset = start & ~TARGET_PAGE_MASK;
+    unsigned long chunks;
+
+    if (!p) {
+        return false;
+    }
+    chunks = qatomic_read(&p->code_chunks);
+    /* With no code left, the slow path unprotects the page */
+    return !chunks || (chunks & page_chunk_mask(offset, offset + len));
+}
 #else
 /* Called with mmap_lock held. If pc is not 0 then it indicates the
  * host PC of the faulting store instruction that caused this invalidate.
@@ -2636,85 +2967,33 @@ void cpu_interrupt(CPUState *cpu, int mask)
 struct walk_memory_regions_data {
     walk_memory_regions_fn fn;
     void *priv;
-    target_ulong start;
-    int prot;
+    int rc;
 };
 
-static int walk_memory_regions_end(struct walk_memory_regions_data *data,
-                                   target_ulong end, int new_prot)
+static gboolean walk_memory_regions_1(gpointer key, gpointer value,
+                                      gpointer data)
 {
-    if (data->start != -1u) {
-        int rc = data->fn(data->priv, data->start, end, data->prot);
-        if (rc != 0) {
-            return rc;
-        }
-    }
+    PageFlagsNode *p = value;
+    struct walk_memory_regions_data *d = data;
 
-    data->start = (new_prot ? end : -1u);
-    data->prot = new_prot;
-
-    return 0;
-}
-
-static int walk_memory_regions_1(struct walk_memory_regions_data *data,
-                                 target_ulong base, int level, void **lp)
-{
-    target_ulong pa;
-    int i, rc;
-
-    if (*lp == NULL) {
-        return walk_memory_regions_end(data, base, 0);
-    }
-
-    if (level == 0) {
-        PageDesc *pd = *lp;
-
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            int prot = pd[i].flags;
-
-            pa = base | (i << TARGET_PAGE_BITS);
-            if (prot != data->prot) {
-                rc = walk_memory_regions_end(data, pa, prot);
-                if (rc != 0) {
-                    return rc;
-                }
-            }
-        }
-    } else {
-        void **pp = *lp;
-
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            pa = base | ((target_ulong)i <<
-                (TARGET_PAGE_BITS + V_L2_BITS * level));
-            rc = walk_memory_regions_1(data, pa, level - 1, pp + i);
-            if (rc != 0) {
-                return rc;
-            }
-        }
-    }
-
-    return 0;
+    d->rc = d->fn(d->priv, p->start, p->last + 1, p->flags);
+    return d->rc != 0;
 }
 
 int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
 {
     struct walk_memory_regions_data data;
-    uintptr_t i, l1_sz = v_l1_size;
 
     data.fn = fn;
     data.priv = priv;
-    data.start = -1u;
-    data.prot = 0;
+    data.rc = 0;
 
-    for (i = 0; i < l1_sz; i++) {
-        target_ulong base = i << (v_l1_shift + TARGET_PAGE_BITS);
-        int rc = walk_memory_regions_1(&data, base, v_l2_levels, l1_map + i);
-        if (rc != 0) {
-            return rc;
-        }
-    }
+    /* Adjacent ranges never share flags, so each one is a region */
+    mmap_lock();
+    g_tree_foreach(pageflags_root, walk_memory_regions_1, &data);
+    mmap_unlock();
 
-    return walk_memory_regions_end(&data, 0, 0);
+    return data.rc;
 }
 
 static int dump_region(void *priv, target_ulong start,
@@ -2743,13 +3022,20 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageDesc *p;
+    PageFlagsNode *p;
+    int flags;
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        return 0;
+    WITH_RCU_READ_LOCK_GUARD() {
+        p = pageflags_cache_find(address);
+        if (p) {
+            return p->flags;
+        }
     }
-    return p->flags;
+
+    mmap_lock();
+    flags = pageflags_get(address);
+    mmap_unlock();
+    return flags;
 }
 
 /* Modify the flags of a page and invalidate the code if necessary.
@@ -2757,7 +3043,7 @@ int page_get_flags(target_ulong address)
    on PAGE_WRITE.  The mmap_lock should already be held.  */
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
-    target_ulong addr, len;
+    target_ulong last;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2767,33 +3053,68 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     assert_memory_lock();
 
     start = start & TARGET_PAGE_MASK;
-    end = TARGET_PAGE_ALIGN(end);
+    last = TARGET_PAGE_ALIGN(end) - 1;
 
     if (flags & PAGE_WRITE) {
+        tb_page_addr_t index = start >> TARGET_PAGE_BITS;
+        PageDesc *p;
+
         flags |= PAGE_WRITE_ORG;
+
+        /* If the write protection bit is set, then we invalidate
+           the code inside.  Only pages with a PageDesc can hold any.  */
+        while ((p = page_find_next(&index, last >> TARGET_PAGE_BITS))) {
+            target_ulong addr = (target_ulong)index << TARGET_PAGE_BITS;
+
+            if (p->first_tb && !(pageflags_get(addr) & PAGE_WRITE)) {
+                tb_invalidate_phys_page(addr, 0);
+            }
+            index++;
+        }
     }
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
+    pageflags_set(start, last, flags);
+}
 
-        /* If the write protection bit is set, then we invalidate
-           the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0);
+static int page_check_range_locked(target_ulong start, target_ulong last,
+                                   int flags)
+{
+    for (;;) {
+        PageFlagsNode *p = pageflags_lookup(start);
+
+        if (!p || !(p->flags & PAGE_VALID)) {
+            return -1;
+        }
+
+        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
+            return -1;
+        }
+        if (flags & PAGE_WRITE) {
+            if (!(p->flags & PAGE_WRITE_ORG)) {
+                return -1;
+            }
+            /* unprotect the page if it was put read-only because it
+               contains translated code */
+            if (!(p->flags & PAGE_WRITE)) {
+                if (!page_unprotect(start, 0)) {
+                    return -1;
+                }
+                /* The ranges have changed, look up start again */
+                continue;
+            }
+        }
+
+        if (p->last >= last) {
+            return 0;
         }
-        p->flags = flags;
+        start = p->last + 1;
     }
 }
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
-    PageDesc *p;
-    target_ulong end;
-    target_ulong addr;
+    target_ulong last;
+    int ret;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2809,39 +3130,72 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
         /* We've wrapped around.  */
         return -1;
     }
+    last = start + len - 1;
 
-    /* must do before we loose bits in the next step */
-    end = TARGET_PAGE_ALIGN(start + len);
-    start = start & TARGET_PAGE_MASK;
-
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
-        if (!p) {
-            return -1;
-        }
-        if (!(p->flags & PAGE_VALID)) {
-            return -1;
-        }
+    /*
+     * Walk the cached ranges, until one is missing or a page has to be
+     * unprotected: both need mmap_lock.
+     */
+    WITH_RCU_READ_LOCK_GUARD() {
+        PageFlagsNode *p;
 
-        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
-            return -1;
-        }
-        if (flags & PAGE_WRITE) {
-            if (!(p->flags & PAGE_WRITE_ORG)) {
+        while ((p = pageflags_cache_find(start))) {
+            if (!(p->flags & PAGE_VALID)) {
                 return -1;
             }
-            /* unprotect the page if it was put read-only because it
-               contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
-                if (!page_unprotect(addr, 0)) {
+            if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
+                return -1;
+            }
+            if (flags & PAGE_WRITE) {
+                if (!(p->flags & PAGE_WRITE_ORG)) {
                     return -1;
                 }
+                if (!(p->flags & PAGE_WRITE)) {
+                    break;
+                }
             }
+            if (p->last >= last) {
+                return 0;
+            }
+            start = p->last + 1;
+        }
+    }
+
+    mmap_lock();
+    ret = page_check_range_locked(start, last, flags);
+    mmap_unlock();
+    return ret;
+}
+
+/*
+ * Return the lowest address aligned to @align such that the @len bytes from
+ * it lie within [min, max] and are all unmapped, or -1 if there is none.
+ * The mmap_lock should already be held.
+ */
+target_ulong page_find_range_empty(target_ulong min, target_ulong max,
+                                   target_ulong len, target_ulong align)
+{
+    target_ulong addr = ROUND_UP(min, align);
+
+    assert_memory_lock();
+    assert(len != 0);
+
+    for (;;) {
+        PageFlagsNode *p;
+
+        if (addr < min || addr > max || max - addr < len - 1) {
+            return -1;
+        }
+        p = pageflags_find(addr, addr + len - 1);
+        if (!p) {
+            return addr;
+        }
+        /* Retry past the first range in the way */
+        addr = ROUND_UP(p->last + 1, align);
+        if (addr <= p->last) {
+            return -1;
         }
     }
-    return 0;
 }
 
 /* called from signal handler: invalidate the code and unprotect the
@@ -2854,7 +3208,7 @@ int page_unprotect(target_ulong address, uintptr_t pc)
 {
     unsigned int prot;
     bool current_tb_invalidated;
-    PageDesc *p;
+    int flags;
     target_ulong host_start, host_end, addr;
 
     /* Technically this isn't safe inside a signal handler.  However we
@@ -2862,17 +3216,13 @@ int page_unprotect(target_ulong address, uintptr_t pc)
        practice it seems to be ok.  */
     mmap_lock();
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        mmap_unlock();
-        return 0;
-    }
+    flags = pageflags_get(address);
 
     /* if the page was really writable, then we change its
        protection back to writable */
-    if (p->flags & PAGE_WRITE_ORG) {
+    if (flags & PAGE_WRITE_ORG) {
         current_tb_invalidated = false;
-        if (p->flags & PAGE_WRITE) {
+        if (flags & PAGE_WRITE) {
             /* If the page is actually marked WRITE then assume this is because
              * this thread raced with another one which got here first and
              * set the page to PAGE_WRITE and did the TB invalidate for us.
@@ -2889,9 +3239,12 @@ int page_unprotect(target_ulong address, uintptr_t pc)
 
             prot = 0;
             for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
-                p = page_find(addr >> TARGET_PAGE_BITS);
-                p->flags |= PAGE_WRITE;
-                prot |= p->flags;
+                flags = pageflags_get(addr);
+                if (flags) {
+                    flags |= PAGE_WRITE;
+                    pageflags_set(addr, addr + TARGET_PAGE_SIZE - 1, flags);
+                    prot |= flags;
+                }
 
                 /* and since the content will be modified, we must invalidate
                    the corresponding translated code. */
@@ -17,6 +17,7 @@
 #include "exec/log.h"
 #include "exec/log_instr.h"
 #include "exec/translator.h"
+#include "exec/tb-stats.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
 
@@ -57,6 +58,19 @@ static void qemu_log_gen_printf_flush(DisasContextBase *base, bool flush_early,
 #endif
 }
 
+/* Count entries into the TB; see TBStatistics for the accuracy caveats. */
+static void gen_tb_exec_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(&tb->tb_stats->executions);
+    TCGv_i64 count = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
@@ -87,6 +101,13 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     cheri_debug_assert(db->pcc_top ==
                        cap_get_top(cheri_get_recent_pcc(cpu->env_ptr)));
     db->cheri_flags = tb->cheri_flags;
+#ifdef CONFIG_PLUGIN
+    /* The TBs are flushed when this changes, see plugin_cpu_update__async */
+    db->plugin_cap_reg_enabled =
+        test_bit(QEMU_PLUGIN_EV_VCPU_CAP_REG, cpu->plugin_mask);
+#else
+    db->plugin_cap_reg_enabled = false;
+#endif
     disas_capreg_reset_all(db);
     // TODO: verify cheri_flags are correct?
 #endif
@@ -106,6 +127,9 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     /* Start translating.  */
     gen_tb_start(db->tb);
+    if (unlikely(db->tb->tb_stats)) {
+        gen_tb_exec_count(db->tb);
+    }
 #ifdef CONFIG_DEBUG_TCG
     // On TB entry pc is up-to-date.
     if (_pc_is_current) {
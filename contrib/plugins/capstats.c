@@ -0,0 +1,115 @@
+/*
+ * Cap Stats - aggregate CHERI capability loads, stores and register writes.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t loads;
+    uint64_t loads_tagged;
+    uint64_t stores;
+    uint64_t stores_tagged;
+} CapMemCounters;
+
+typedef struct {
+    const char *name;
+    uint64_t writes;
+    uint64_t writes_tagged;
+} CapRegCounters;
+
+static GMutex lock;
+static CapMemCounters mem_counts;
+static GHashTable *regs;
+
+static gint cmp_write_count(gconstpointer a, gconstpointer b)
+{
+    CapRegCounters *ea = (CapRegCounters *) a;
+    CapRegCounters *eb = (CapRegCounters *) b;
+    return ea->writes > eb->writes ? -1 : 1;
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new("");
+    GList *it, *counts;
+
+    g_mutex_lock(&lock);
+    g_string_printf(report, "cap loads: %" PRIu64 " (%" PRIu64 " tagged)\n",
+                    mem_counts.loads, mem_counts.loads_tagged);
+    g_string_append_printf(report,
+                           "cap stores: %" PRIu64 " (%" PRIu64 " tagged)\n",
+                           mem_counts.stores, mem_counts.stores_tagged);
+
+    counts = g_hash_table_get_values(regs);
+    if (counts) {
+        g_string_append_printf(report, "Register, Writes, Tagged\n");
+        counts = g_list_sort(counts, cmp_write_count);
+        for (it = counts; it; it = it->next) {
+            CapRegCounters *rec = (CapRegCounters *) it->data;
+            g_string_append_printf(report, "%s, %" PRIu64 ", %" PRIu64 "\n",
+                                   rec->name, rec->writes, rec->writes_tagged);
+        }
+        g_list_free(counts);
+    }
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_outs(report->str);
+}
+
+static void vcpu_cap_mem(qemu_plugin_id_t id, unsigned int vcpu_index,
+                         uint64_t vaddr, bool is_store,
+                         const qemu_plugin_cap_t *cap)
+{
+    g_mutex_lock(&lock);
+    if (is_store) {
+        mem_counts.stores++;
+        mem_counts.stores_tagged += cap->tag;
+    } else {
+        mem_counts.loads++;
+        mem_counts.loads_tagged += cap->tag;
+    }
+    g_mutex_unlock(&lock);
+}
+
+static void vcpu_cap_reg(qemu_plugin_id_t id, unsigned int vcpu_index,
+                         const char *reg_name, const qemu_plugin_cap_t *cap)
+{
+    CapRegCounters *cnt;
+
+    g_mutex_lock(&lock);
+    /* Register names are static strings so the pointer is a stable key */
+    cnt = g_hash_table_lookup(regs, reg_name);
+    if (!cnt) {
+        cnt = g_new0(CapRegCounters, 1);
+        cnt->name = reg_name;
+        g_hash_table_insert(regs, (gpointer) reg_name, cnt);
+    }
+    cnt->writes++;
+    cnt->writes_tagged += cap->tag;
+    g_mutex_unlock(&lock);
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    regs = g_hash_table_new(NULL, g_direct_equal);
+
+    qemu_plugin_register_vcpu_cap_mem_cb(id, vcpu_cap_mem);
+    qemu_plugin_register_vcpu_cap_reg_cb(id, vcpu_cap_reg);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
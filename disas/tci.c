@@ -22,13 +22,22 @@
 #include "disas/dis-asm.h"
 #include "tcg/tcg.h"
 
+static const char *const tci_superop_names[TCI_NB_OPS - NB_OPS] = {
+    [TCI_OP_ld_add_i32 - NB_OPS] = "ld_i32+add_i32",
+    [TCI_OP_ld_add_i64 - NB_OPS] = "ld_i64+add_i64",
+    [TCI_OP_setcond_brcond_i32 - NB_OPS] = "setcond_i32+brcond_i32",
+    [TCI_OP_setcond_brcond_i64 - NB_OPS] = "setcond_i64+brcond_i64",
+    [TCI_OP_add_qemu_ld_i32 - NB_OPS] = "add+qemu_ld_i32",
+    [TCI_OP_add_qemu_ld_i64 - NB_OPS] = "add+qemu_ld_i64",
+};
+
 /* Disassemble TCI bytecode. */
 int print_insn_tci(bfd_vma addr, disassemble_info *info)
 {
     int length;
     uint8_t byte;
     int status;
-    TCGOpcode op;
+    int op;
 
     status = info->read_memory_func(addr, &byte, 1, info);
     if (status != 0) {
@@ -45,8 +54,11 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
     }
     length = byte;
 
-    if (op >= tcg_op_defs_max) {
+    if (op >= TCI_NB_OPS) {
         info->fprintf_func(info->stream, "illegal opcode %d", op);
+    } else if (op >= tcg_op_defs_max) {
+        info->fprintf_func(info->stream, "%s",
+                           tci_superop_names[op - NB_OPS]);
     } else {
         const TCGOpDef *def = &tcg_op_defs[op];
         int nb_oargs = def->nb_oargs;
@@ -2007,13 +2007,38 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(pr, s, fmt16);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts p = float64_unpack_canonical(a, s);
     FloatParts pr = float_to_float(p, &float32_params, s);
     return float32_round_pack_canonical(pr, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    if (likely(!QEMU_NO_HARDFLOAT && float64_is_normal(a))) {
+        union_float64 ud;
+        union_float32 uf;
+
+        ud.s = a;
+        uf.h = ud.h;
+        /*
+         * A finite result above FLT_MIN raises no flag other than inexact:
+         * take it if the conversion was exact or inexact is already set.
+         * Overflow, (possible) underflow and other rounding modes go
+         * through softfloat.
+         */
+        if (likely(isfinite(uf.h) && fabsf(uf.h) > FLT_MIN) &&
+            ((double)uf.h == ud.h || can_use_fpu(s))) {
+            return uf.s;
+        }
+    } else if (float64_is_zero(a)) {
+        return float32_set_sign(float32_zero, float64_is_neg(a));
+    }
+    return soft_float64_to_float32(a, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts p = bfloat16_unpack_canonical(a, s);
@@ -2335,13 +2360,86 @@ int16_t float32_to_int16(float32 a, float_status *s)
     return float32_to_int16_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
+/*
+ * Hardfloat conversion to an integer in [min, max] of a zero or normal
+ * input (float32 inputs are widened exactly).  Only round-to-zero and
+ * round-to-nearest-even, the host default, are handled; inexact is the
+ * only flag that can be raised within range, and it is cheap to compute.
+ * Returns false if softfloat must do the conversion.
+ */
+static inline bool hard_to_int(double a, FloatRoundMode rmode,
+                               double min, double max, int64_t *ret,
+                               float_status *s)
+{
+    double r;
+
+    switch (rmode) {
+    case float_round_nearest_even:
+        r = nearbyint(a);
+        break;
+    case float_round_to_zero:
+        r = trunc(a);
+        break;
+    default:
+        return false;
+    }
+    if (unlikely(!(r >= min && r <= max))) {
+        return false;
+    }
+    if (r != a) {
+        s->float_exception_flags |= float_flag_inexact;
+    }
+    *ret = r;
+    return true;
+}
+
+static inline bool f32_to_int(float32 a, FloatRoundMode rmode,
+                              double min, double max, int64_t *ret,
+                              float_status *s)
+{
+    union_float32 ua;
+
+    if (QEMU_NO_HARDFLOAT || unlikely(!float32_is_zero_or_normal(a))) {
+        return false;
+    }
+    ua.s = a;
+    return hard_to_int(ua.h, rmode, min, max, ret, s);
+}
+
+static inline bool f64_to_int(float64 a, FloatRoundMode rmode,
+                              double min, double max, int64_t *ret,
+                              float_status *s)
+{
+    union_float64 ua;
+
+    if (QEMU_NO_HARDFLOAT || unlikely(!float64_is_zero_or_normal(a))) {
+        return false;
+    }
+    ua.s = a;
+    return hard_to_int(ua.h, rmode, min, max, ret, s);
+}
+
+/* The largest double not above INT64_MAX */
+#define HARD_INT64_MAX 0x1.fffffffffffffp62
+
 int32_t float32_to_int32(float32 a, float_status *s)
 {
+    int64_t r;
+
+    if (f32_to_int(a, s->float_rounding_mode, INT32_MIN, INT32_MAX, &r, s)) {
+        return r;
+    }
     return float32_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
 int64_t float32_to_int64(float32 a, float_status *s)
 {
+    int64_t r;
+
+    if (f32_to_int(a, s->float_rounding_mode, INT64_MIN, HARD_INT64_MAX,
+                   &r, s)) {
+        return r;
+    }
     return float32_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
@@ -2352,11 +2450,22 @@ int16_t float64_to_int16(float64 a, float_status *s)
 
 int32_t float64_to_int32(float64 a, float_status *s)
 {
+    int64_t r;
+
+    if (f64_to_int(a, s->float_rounding_mode, INT32_MIN, INT32_MAX, &r, s)) {
+        return r;
+    }
     return float64_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
 int64_t float64_to_int64(float64 a, float_status *s)
 {
+    int64_t r;
+
+    if (f64_to_int(a, s->float_rounding_mode, INT64_MIN, HARD_INT64_MAX,
+                   &r, s)) {
+        return r;
+    }
     return float64_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
 }
 
@@ -2382,11 +2491,21 @@ int16_t float32_to_int16_round_to_zero(float32 a, float_status *s)
 
 int32_t float32_to_int32_round_to_zero(float32 a, float_status *s)
 {
+    int64_t r;
+
+    if (f32_to_int(a, float_round_to_zero, INT32_MIN, INT32_MAX, &r, s)) {
+        return r;
+    }
     return float32_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
 int64_t float32_to_int64_round_to_zero(float32 a, float_status *s)
 {
+    int64_t r;
+
+    if (f32_to_int(a, float_round_to_zero, INT64_MIN, HARD_INT64_MAX, &r, s)) {
+        return r;
+    }
     return float32_to_int64_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2397,11 +2516,21 @@ int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
 
 int32_t float64_to_int32_round_to_zero(float64 a, float_status *s)
 {
+    int64_t r;
+
+    if (f64_to_int(a, float_round_to_zero, INT32_MIN, INT32_MAX, &r, s)) {
+        return r;
+    }
     return float64_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
 int64_t float64_to_int64_round_to_zero(float64 a, float_status *s)
 {
+    int64_t r;
+
+    if (f64_to_int(a, float_round_to_zero, INT64_MIN, HARD_INT64_MAX, &r, s)) {
+        return r;
+    }
     return float64_to_int64_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2827,13 +2956,39 @@ float32 int16_to_float32_scalbn(int16_t a, int scale, float_status *status)
     return int64_to_float32_scalbn(a, scale, status);
 }
 
+/*
+ * Integers of up to 24 (float32) or 53 (float64) significant bits convert
+ * exactly and raise no flags; wider ones are rounded by the host, which
+ * is only correct if inexact is already set and the mode is the default.
+ */
+static inline bool hard_from_int_ok(int64_t a, int bits, float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return likely(a >= -(INT64_C(1) << bits) && a <= INT64_C(1) << bits) ||
+           can_use_fpu(s);
+}
+
 float32 int64_to_float32(int64_t a, float_status *status)
 {
+    if (hard_from_int_ok(a, 24, status)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
 float32 int32_to_float32(int32_t a, float_status *status)
 {
+    if (hard_from_int_ok(a, 24, status)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
@@ -2860,11 +3015,23 @@ float64 int16_to_float64_scalbn(int16_t a, int scale, float_status *status)
 
 float64 int64_to_float64(int64_t a, float_status *status)
 {
+    if (hard_from_int_ok(a, 53, status)) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float64_scalbn(a, 0, status);
 }
 
 float64 int32_to_float64(int32_t a, float_status *status)
 {
+    if (!QEMU_NO_HARDFLOAT) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float64_scalbn(a, 0, status);
 }
 
@@ -3025,11 +3192,24 @@ float64 uint16_to_float64_scalbn(uint16_t a, int scale, float_status *status)
 
 float64 uint64_to_float64(uint64_t a, float_status *status)
 {
+    if (!QEMU_NO_HARDFLOAT &&
+        (likely(a <= UINT64_C(1) << 53) || can_use_fpu(status))) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float64_scalbn(a, 0, status);
 }
 
 float64 uint32_to_float64(uint32_t a, float_status *status)
 {
+    if (!QEMU_NO_HARDFLOAT) {
+        union_float64 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float64_scalbn(a, 0, status);
 }
 
@@ -3179,6 +3359,109 @@ MINMAX(16, max, false, false, false)
 MINMAX(16, maxnum, false, true, false)
 MINMAX(16, maxnummag, false, true, true)
 
+#undef MINMAX
+
+#define SOFT_MINMAX(sz)                                                 \
+static float ## sz QEMU_SOFTFLOAT_ATTR                                  \
+soft_f ## sz ## _minmax(float ## sz a, float ## sz b, bool ismin,       \
+                        bool isiee, bool ismag, float_status *s)        \
+{                                                                       \
+    FloatParts pa = float ## sz ## _unpack_canonical(a, s);             \
+    FloatParts pb = float ## sz ## _unpack_canonical(b, s);             \
+    FloatParts pr = minmax_floats(pa, pb, ismin, isiee, ismag, s);      \
+                                                                        \
+    return float ## sz ## _round_pack_canonical(pr, s);                 \
+}
+
+SOFT_MINMAX(32)
+SOFT_MINMAX(64)
+
+#undef SOFT_MINMAX
+
+/*
+ * Without NaNs and denormals the result is always one of the inputs,
+ * unchanged, and no flags are raised, so the host comparison suffices.
+ * Denormals are left to softfloat since it may flush them on output.
+ */
+static float32 QEMU_FLATTEN
+f32_minmax(float32 xa, float32 xb, bool ismin, bool isiee, bool ismag,
+           float_status *s)
+{
+    union_float32 ua, ub;
+
+    ua.s = xa;
+    ub.s = xb;
+
+    if (QEMU_NO_HARDFLOAT) {
+        goto soft;
+    }
+
+    float32_input_flush2(&ua.s, &ub.s, s);
+    if (unlikely(float32_is_denormal(ua.s) || float32_is_denormal(ub.s) ||
+                 isunordered(ua.h, ub.h))) {
+        goto soft;
+    }
+    if (ismag) {
+        float fa = fabsf(ua.h);
+        float fb = fabsf(ub.h);
+
+        if (fa != fb) {
+            return isless(fa, fb) ^ ismin ? ub.s : ua.s;
+        }
+    }
+    if (ua.h != ub.h) {
+        return isless(ua.h, ub.h) ^ ismin ? ub.s : ua.s;
+    }
+    /* Equal values: only +0 and -0 differ, and the sign decides */
+    return float32_is_neg(ua.s) ^ ismin ? ub.s : ua.s;
+
+ soft:
+    return soft_f32_minmax(ua.s, ub.s, ismin, isiee, ismag, s);
+}
+
+static float64 QEMU_FLATTEN
+f64_minmax(float64 xa, float64 xb, bool ismin, bool isiee, bool ismag,
+           float_status *s)
+{
+    union_float64 ua, ub;
+
+    ua.s = xa;
+    ub.s = xb;
+
+    if (QEMU_NO_HARDFLOAT) {
+        goto soft;
+    }
+
+    float64_input_flush2(&ua.s, &ub.s, s);
+    if (unlikely(float64_is_denormal(ua.s) || float64_is_denormal(ub.s) ||
+                 isunordered(ua.h, ub.h))) {
+        goto soft;
+    }
+    if (ismag) {
+        double fa = fabs(ua.h);
+        double fb = fabs(ub.h);
+
+        if (fa != fb) {
+            return isless(fa, fb) ^ ismin ? ub.s : ua.s;
+        }
+    }
+    if (ua.h != ub.h) {
+        return isless(ua.h, ub.h) ^ ismin ? ub.s : ua.s;
+    }
+    /* Equal values: only +0 and -0 differ, and the sign decides */
+    return float64_is_neg(ua.s) ^ ismin ? ub.s : ua.s;
+
+ soft:
+    return soft_f64_minmax(ua.s, ub.s, ismin, isiee, ismag, s);
+}
+
+#define MINMAX(sz, name, ismin, isiee, ismag)                           \
+float ## sz float ## sz ## _ ## name(float ## sz a, float ## sz b,      \
+                                     float_status *s)                   \
+{                                                                       \
+    return f ## sz ## _minmax(a, b, ismin, isiee, ismag, s);            \
+}
+
 MINMAX(32, min, true, false, false)
 MINMAX(32, minnum, true, true, false)
 MINMAX(32, minnummag, true, true, true)
@@ -298,6 +298,27 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "max:i?,sort_by:s?",
+        .params     = "[max [executions|exits|translations|host-bytes|helper-calls]]",
+        .help       = "show per-TB execution statistics, up to max entries "
+                      "(default: 10), sorted by the given key (default: "
+                      "executions)",
+        .cmd        = hmp_info_tb_stats,
+    },
+#endif
+
+SRST
+  ``info tb-stats`` [*max* [*key*]]
+    Show the translation blocks with the highest value of *key*, as collected
+    since ``tb-stats on``. For each block this shows the number of executions,
+    exits to the main loop and translations, and for the latest translation
+    the number of guest instructions, host code bytes, TCG ops before and
+    after optimization, and helper calls.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
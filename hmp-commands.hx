@@ -627,6 +627,24 @@ SRST
   whether profiling is on or off.
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "op:s?",
+        .params     = "[on|off|reset]",
+        .help       = "enable, disable or reset per-TB execution statistics. "
+                      "With no arguments, prints whether collection is on or off.",
+        .cmd        = hmp_tb_stats,
+    },
+#endif
+
+SRST
+``tb-stats [on|off|reset]``
+  Enable, disable or reset the collection of per-TranslationBlock execution
+  statistics. Turning collection on or off flushes the translated code. With
+  no arguments, prints whether collection is on or off.
+ERST
+
     {
         .name       = "system_reset",
         .args_type  = "",
@@ -81,6 +81,8 @@ typedef uint64_t target_ulong;
 
 /* use a fully associative victim tlb of 8 entries */
 #define CPU_VTLB_SIZE 8
+/* and a fully associative table of 8 guest large pages */
+#define CPU_LPTLB_SIZE 8
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -189,19 +191,37 @@ typedef struct CPUIOTLBEntry {
     })
 #define IOTLB_GET_TAGMEM_FLAGS(iotlbentry, rw)                                 \
     ((uintptr_t)iotlbentry->tagmem_##rw & TLBENTRYCAP_MASK);
+/*
+ * A guest large page, kept as a single entry. Misses in the main and victim
+ * TLBs that fall within it are refilled from here without calling tlb_fill.
+ * The entry is matched if (addr & mask) == vaddr; an unused entry is all -1.
+ */
+typedef struct CPUTLBLargeEntry {
+    target_ulong vaddr;
+    target_ulong mask;
+    hwaddr paddr;
+    MemTxAttrs attrs;
+    int prot;
+} CPUTLBLargeEntry;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
+     * Describe a region covering all of the large pages that were
+     * displaced from lptable while TLB entries may still refer to them.
+     * When any page within this region is flushed, we must flush the
+     * entire tlb.  The region is matched if
      * (addr & large_page_mask) == large_page_addr.
      */
     target_ulong large_page_addr;
     target_ulong large_page_mask;
+    /* The next index to use in the large page table.  */
+    size_t lpindex;
+    /* The large page table.  */
+    CPUTLBLargeEntry lptable[CPU_LPTLB_SIZE];
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -227,18 +247,71 @@ typedef struct CPUTLBDescFast {
     CPUTLBEntry *table;
 } CPUTLBDescFast QEMU_ALIGNED(2 * sizeof(void *));
 
+/* keep the tlb of up to 4 inactive address spaces */
+#define CPU_TLB_ASID_CONTEXTS 4
+/* the address space of the tlb is not known */
+#define TLB_ASID_NONE UINT64_MAX
+
+/*
+ * The tlb of an address space that is not the active one, set aside by
+ * tlb_switch_asid() so that switching back to it needs no refills.
+ */
+typedef struct CPUTLBASIDContext {
+    bool valid;
+    uint64_t asid;
+    /* The MMU indexes modified since they were flushed, as in c.dirty */
+    uint16_t dirty;
+    CPUTLBDesc d[NB_MMU_MODES];
+    CPUTLBDescFast f[NB_MMU_MODES];
+} CPUTLBASIDContext;
+
+/* coalesce up to 16 disjoint page ranges flushed by other vCPUs */
+#define CPU_TLB_FLUSH_BATCH 16
+
+/* A range of pages whose flush was requested by another vCPU. */
+typedef struct CPUTLBPendingFlush {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+    uint16_t bits;
+} CPUTLBPendingFlush;
+
 /*
  * Data elements that are shared between all MMU modes.
  */
 typedef struct CPUTLBCommon {
     /* Serialize updates to f.table and d.vtable, and others as noted. */
     QemuSpin lock;
+    /*
+     * The address space that d and f belong to, or TLB_ASID_NONE.
+     * Protected by tlb_c.lock.
+     */
+    uint64_t asid;
+    /* The next index to use in asid_ctx.  Protected by tlb_c.lock.  */
+    unsigned asid_next;
+    /* Inactive address spaces.  Protected by tlb_c.lock.  */
+    CPUTLBASIDContext *asid_ctx;
+    /*
+     * Flushes requested by other vCPUs and not done yet, and whether
+     * async or safe work to drain them has been queued.
+     * Protected by tlb_c.lock.
+     */
+    bool pending_async;
+    bool pending_safe;
+    uint16_t pending_full;
+    unsigned n_pending;
+    CPUTLBPendingFlush pending[CPU_TLB_FLUSH_BATCH];
     /*
      * Within dirty, for each bit N, modifications have been made to
      * mmu_idx N since the last time that mmu_idx was flushed.
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * The access that the TLB refill in progress was started for, as
+     * seen by tlb_set_page_with_attrs.  Only used by the vCPU itself.
+     */
+    MMUAccessType fill_access;
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
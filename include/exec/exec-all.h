@@ -73,6 +73,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
 void QEMU_NORETURN cpu_loop_exit(CPUState *cpu);
 void QEMU_NORETURN cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc);
 void QEMU_NORETURN cpu_loop_exit_atomic(CPUState *cpu, uintptr_t pc);
+void QEMU_NORETURN cpu_loop_exit_serial(CPUState *cpu, uintptr_t pc);
 
 /**
  * cpu_loop_exit_requested:
@@ -269,6 +270,74 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *cpu, target_ulong addr,
 void tlb_flush_page_bits_by_mmuidx_all_cpus_synced
     (CPUState *cpu, target_ulong addr, uint16_t idxmap, unsigned bits);
 
+/**
+ * tlb_flush_range_by_mmuidx
+ * @cpu: CPU whose TLB should be flushed
+ * @addr: virtual address of the start of the range to be flushed
+ * @len: length of range to be flushed
+ * @idxmap: bitmap of mmu indexes to flush
+ * @bits: number of significant bits in address
+ *
+ * For each mmuidx in @idxmap, flush all pages within [@addr,@addr+@len),
+ * comparing only the low @bits worth of each virtual page.  Flushes
+ * for other CPUs are batched with the other flushes pending for them,
+ * and done before they execute more guest code.
+ */
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap,
+                               unsigned bits);
+
+/* Similarly, with broadcast and syncing. */
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *cpu, target_ulong addr,
+                                        target_ulong len, uint16_t idxmap,
+                                        unsigned bits);
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap,
+                                               unsigned bits);
+
+/**
+ * tlb_switch_asid:
+ * @cpu: CPU whose TLB should be switched
+ * @asid: target-defined identifier of the new address space
+ *
+ * Make @asid the active address space of the TLB of the specified CPU,
+ * for all MMU indexes. The entries of the outgoing address space are
+ * set aside rather than flushed, so that switching back to it does not
+ * need to refill them. Flushes that do not name an address space apply
+ * to all of them. Must be called on @cpu's own thread.
+ */
+void tlb_switch_asid(CPUState *cpu, uint64_t asid);
+/**
+ * tlb_flush_asid:
+ * @cpu: CPU whose TLB should be flushed
+ * @asid: address space to flush
+ *
+ * Flush all entries of address space @asid from the TLB of the
+ * specified CPU. Must be called on @cpu's own thread.
+ */
+void tlb_flush_asid(CPUState *cpu, uint64_t asid);
+/**
+ * tlb_flush_page_asid:
+ * @cpu: CPU whose TLB should be flushed
+ * @addr: virtual address of page to be flushed
+ * @asid: address space to flush
+ *
+ * Flush one page of address space @asid from the TLB of the specified
+ * CPU. Must be called on @cpu's own thread.
+ */
+void tlb_flush_page_asid(CPUState *cpu, target_ulong addr, uint64_t asid);
+/**
+ * tlb_lockstep_end_quantum:
+ *
+ * Hand over the RAM pages that vCPUs claimed in the serial phase of a
+ * lockstep icount quantum, and flush the TLBs that may still allow the
+ * previous owners to use them. Called at the quantum boundary, with all
+ * vCPUs stopped.
+ */
+void tlb_lockstep_end_quantum(void);
+
 /**
  * tlb_set_page_with_attrs:
  * @cpu: CPU to add this TLB entry for
@@ -288,8 +357,9 @@ void tlb_flush_page_bits_by_mmuidx_all_cpus_synced
  * which provoked the TLB miss.
  *
  * At most one entry for a given virtual address is permitted. Only a
- * single TARGET_PAGE_SIZE region is mapped; the supplied @size is only
- * used by tlb_flush_page.
+ * single TARGET_PAGE_SIZE region is mapped; a larger @size is recorded
+ * so that the rest of the page can be refilled without tlb_fill(), and
+ * is flushed as a whole by tlb_flush_page.
  */
 void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
                              hwaddr paddr, MemTxAttrs attrs,
@@ -372,6 +442,38 @@ tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *cpu, target_ulong addr,
                                               uint16_t idxmap, unsigned bits)
 {
 }
+static inline void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                                             target_ulong len, uint16_t idxmap,
+                                             unsigned bits)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus(CPUState *cpu,
+                                                      target_ulong addr,
+                                                      target_ulong len,
+                                                      uint16_t idxmap,
+                                                      unsigned bits)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                                             target_ulong addr,
+                                                             target_ulong len,
+                                                             uint16_t idxmap,
+                                                             unsigned bits)
+{
+}
+static inline void tlb_switch_asid(CPUState *cpu, uint64_t asid)
+{
+}
+static inline void tlb_flush_asid(CPUState *cpu, uint64_t asid)
+{
+}
+static inline void tlb_flush_page_asid(CPUState *cpu, target_ulong addr,
+                                       uint64_t asid)
+{
+}
+static inline void tlb_lockstep_end_quantum(void)
+{
+}
 #endif
 /**
  * probe_access:
@@ -524,6 +626,9 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /* Execution statistics, or NULL if not collected for this TB */
+    struct TBStatistics *tb_stats;
 };
 
 extern bool parallel_cpus;
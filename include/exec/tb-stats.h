@@ -0,0 +1,67 @@
+/*
+ * Per-TranslationBlock execution statistics
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef EXEC_TB_STATS_H
+#define EXEC_TB_STATS_H
+
+/*
+ * One entry per piece of guest code, identified the same way the TB hash
+ * table identifies TBs. Entries survive retranslation, TB flushes and code
+ * region eviction, so a block that keeps getting retranslated accumulates
+ * its counters in a single place. Entries are never freed.
+ *
+ * The runtime counters are updated without atomic read-modify-write
+ * operations to keep the overhead low; with MTTCG they are approximate.
+ */
+typedef struct TBStatistics {
+    uint64_t phys_pc;
+    uint64_t pc;
+    uint32_t flags;
+    uint32_t cflags;
+
+    /* Number of times the generated code was entered */
+    uint64_t executions;
+    /* Number of returns to the execution loop from this block */
+    uint64_t exits;
+    /* Number of times this block was translated */
+    uint64_t translations;
+
+    /* The following describe the most recent translation */
+    uint32_t guest_insns;
+    uint32_t host_bytes;
+    uint32_t ops_before_opt;
+    uint32_t ops_after_opt;
+    uint32_t helper_calls;
+} TBStatistics;
+
+enum TBStatsSortKey {
+    TB_STATS_KEY_EXECUTIONS,
+    TB_STATS_KEY_EXITS,
+    TB_STATS_KEY_TRANSLATIONS,
+    TB_STATS_KEY_HOST_BYTES,
+    TB_STATS_KEY_HELPER_CALLS,
+};
+
+bool tb_stats_is_enabled(void);
+void tb_stats_enable(void);
+void tb_stats_disable(void);
+void tb_stats_reset(void);
+
+/* Return the (possibly new) entry for the given TB key. */
+TBStatistics *tb_stats_get(uint64_t phys_pc, uint64_t pc, uint32_t flags,
+                           uint32_t cflags);
+
+/*
+ * Copy up to @max entries, sorted by @sort_by in descending order, into a
+ * newly allocated array stored in *@snap. Returns the number of entries
+ * copied. The caller must g_free() *@snap.
+ */
+size_t tb_stats_collect(TBStatistics **snap, size_t max,
+                        enum TBStatsSortKey sort_by);
+
+void tb_stats_report(size_t max, enum TBStatsSortKey sort_by);
+
+#endif /* EXEC_TB_STATS_H */
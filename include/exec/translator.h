@@ -78,6 +78,8 @@ typedef struct DisasContextBase {
     // TIME. Within a basic block, this is possible to track for any runtime
     // use.
     uint8_t cap_compression_states[NUM_LAZY_CAP_REGS];
+    // Cached like log_instr_enabled: a plugin wants capreg write events
+    bool plugin_cap_reg_enabled;
 #endif
     DisasJumpType is_jmp;
     int num_insns;
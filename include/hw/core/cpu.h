@@ -335,6 +335,12 @@ struct qemu_work_item;
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
  * @icount_extra: Instructions until next timer event.
+ * @icount_quantum_done: Instructions executed so far in the current
+ * lockstep icount quantum.
+ * @icount_parallel: Set while running the parallel phase of a lockstep
+ * icount quantum; I/O and atomic operations must wait for the serial phase.
+ * @icount_serial: The vCPU has to finish its lockstep icount quantum in
+ * the serial phase.
  * @can_do_io: Nonzero if memory-mapped IO is safe. Deterministic execution
  * requires that IO only be performed on the last instruction of a TB
  * so that interrupts take effect immediately.
@@ -398,6 +404,9 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    int64_t icount_quantum_done;
+    bool icount_parallel;
+    bool icount_serial;
     uint64_t breakcount;
     uint64_t random_seed;
     sigjmp_buf jmp_env;
@@ -24,6 +24,8 @@ enum qemu_plugin_event {
     QEMU_PLUGIN_EV_VCPU_RESUME,
     QEMU_PLUGIN_EV_VCPU_SYSCALL,
     QEMU_PLUGIN_EV_VCPU_SYSCALL_RET,
+    QEMU_PLUGIN_EV_VCPU_CAP_MEM,
+    QEMU_PLUGIN_EV_VCPU_CAP_REG,
     QEMU_PLUGIN_EV_FLUSH,
     QEMU_PLUGIN_EV_ATEXIT,
     QEMU_PLUGIN_EV_MAX, /* total number of plugin events we support */
@@ -56,6 +58,8 @@ union qemu_plugin_cb_sig {
     qemu_plugin_vcpu_mem_cb_t        vcpu_mem;
     qemu_plugin_vcpu_syscall_cb_t    vcpu_syscall;
     qemu_plugin_vcpu_syscall_ret_cb_t vcpu_syscall_ret;
+    qemu_plugin_vcpu_cap_mem_cb_t    vcpu_cap_mem;
+    qemu_plugin_vcpu_cap_reg_cb_t    vcpu_cap_reg;
     void *generic;
 };
 
@@ -176,6 +180,10 @@ qemu_plugin_vcpu_syscall(CPUState *cpu, int64_t num, uint64_t a1,
                          uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5,
                          uint64_t a6, uint64_t a7, uint64_t a8);
 void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret);
+void qemu_plugin_vcpu_cap_mem_cb(CPUState *cpu, uint64_t vaddr, bool is_store,
+                                 const qemu_plugin_cap_t *cap);
+void qemu_plugin_vcpu_cap_reg_cb(CPUState *cpu, const char *reg_name,
+                                 const qemu_plugin_cap_t *cap);
 
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr, uint32_t meminfo);
 
@@ -230,6 +238,16 @@ static inline
 void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
 { }
 
+static inline
+void qemu_plugin_vcpu_cap_mem_cb(CPUState *cpu, uint64_t vaddr, bool is_store,
+                                 const qemu_plugin_cap_t *cap)
+{ }
+
+static inline
+void qemu_plugin_vcpu_cap_reg_cb(CPUState *cpu, const char *reg_name,
+                                 const qemu_plugin_cap_t *cap)
+{ }
+
 static inline void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                                            uint32_t meminfo)
 { }
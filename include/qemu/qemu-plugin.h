@@ -371,6 +371,62 @@ qemu_plugin_register_vcpu_syscall_ret_cb(qemu_plugin_id_t id,
                                          qemu_plugin_vcpu_syscall_ret_cb_t cb);
 
 
+/*
+ * CHERI Capability Instrumentation
+ *
+ * On CHERI targets QEMU can report capability loads and stores as well
+ * as updates to capability registers. The capability is passed in its
+ * decoded form; @top is saturated to UINT64_MAX if the capability
+ * covers the whole 64-bit address space. On non-CHERI targets these
+ * callbacks are never invoked.
+ *
+ * The qemu_plugin_cap_t pointer is *only* valid for the duration of
+ * the callback.
+ */
+typedef struct {
+    uint64_t cursor;
+    uint64_t base;
+    uint64_t top;
+    uint64_t otype;
+    uint32_t perms;
+    uint32_t uperms;
+    uint8_t flags;
+    bool tag;
+} qemu_plugin_cap_t;
+
+typedef void
+(*qemu_plugin_vcpu_cap_mem_cb_t)(qemu_plugin_id_t id, unsigned int vcpu_index,
+                                 uint64_t vaddr, bool is_store,
+                                 const qemu_plugin_cap_t *cap);
+
+/**
+ * qemu_plugin_register_vcpu_cap_mem_cb() - register a capability memory cb
+ * @id: plugin ID
+ * @cb: callback function
+ *
+ * The @cb function is called every time a capability (data and tag) is
+ * loaded from or stored to memory.
+ */
+void qemu_plugin_register_vcpu_cap_mem_cb(qemu_plugin_id_t id,
+                                          qemu_plugin_vcpu_cap_mem_cb_t cb);
+
+typedef void
+(*qemu_plugin_vcpu_cap_reg_cb_t)(qemu_plugin_id_t id, unsigned int vcpu_index,
+                                 const char *reg_name,
+                                 const qemu_plugin_cap_t *cap);
+
+/**
+ * qemu_plugin_register_vcpu_cap_reg_cb() - register a capability register cb
+ * @id: plugin ID
+ * @cb: callback function
+ *
+ * The @cb function is called every time an instruction or an exception
+ * writes a full capability to a capability register (general purpose or
+ * special). Registering it while vCPUs run flushes the translated code.
+ */
+void qemu_plugin_register_vcpu_cap_reg_cb(qemu_plugin_id_t id,
+                                          qemu_plugin_vcpu_cap_reg_cb_t cb);
+
 /**
  * qemu_plugin_insn_disas() - return disassembly string for instruction
  * @insn: instruction reference
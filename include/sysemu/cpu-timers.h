@@ -31,12 +31,31 @@ extern int use_icount;
 #define icount_enabled() 0
 #endif
 
+/*
+ * Lockstep icount: with multi-threaded TCG, all vCPUs execute quanta of
+ * icount_lockstep_quantum instructions in parallel and synchronise at
+ * every quantum boundary (see accel/tcg/tcg-cpus.c).
+ */
+#ifdef CONFIG_TCG
+extern bool icount_lockstep;
+#define icount_lockstep_enabled() (icount_lockstep)
+#else
+#define icount_lockstep_enabled() false
+#endif
+extern int64_t icount_lockstep_quantum;
+
 /*
  * Update the icount with the executed instructions. Called by
  * cpus-tcg vCPU thread so the main-loop can see time has moved forward.
  */
 void icount_update(CPUState *cpu);
 
+/*
+ * Move QEMU_CLOCK_VIRTUAL forward by @count instructions at the end of
+ * a lockstep quantum.
+ */
+void icount_lockstep_advance(int64_t count);
+
 /* get raw icount value */
 int64_t icount_get_raw(void);
 
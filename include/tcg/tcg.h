@@ -679,6 +679,10 @@ struct TCGContext {
 #ifdef TCG_TARGET_NEED_POOL_LABELS
     struct TCGLabelPoolData *pool_labels;
 #endif
+#ifdef TCG_TARGET_INTERPRETER
+    /* Last bytecode instruction, if it may start a superinstruction */
+    tcg_insn_unit *tci_fuse_ptr;
+#endif
 
     TCGLabel *exitreq_label;
 
@@ -914,6 +918,7 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 void tcg_region_init(void);
 void tb_destroy(TranslationBlock *tb);
 void tcg_region_reset_all(void);
+bool tcg_region_evict_oldest(void);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -1314,6 +1319,24 @@ static inline unsigned get_mmuidx(TCGMemOpIdx oi)
 #define TB_EXIT_REQUESTED 3
 
 #ifdef CONFIG_TCG_INTERPRETER
+/*
+ * TCI superinstructions. Two operations which are often adjacent share a
+ * single bytecode instruction: the opcode byte and size byte are followed
+ * by the operands of the first operation, then by those of the second one.
+ */
+typedef enum TCIOpcode {
+    TCI_OP_ld_add_i32 = NB_OPS,
+    TCI_OP_ld_add_i64,
+    TCI_OP_setcond_brcond_i32,
+    TCI_OP_setcond_brcond_i64,
+    /* Address computation followed by a guest memory access */
+    TCI_OP_add_qemu_ld_i32,
+    TCI_OP_add_qemu_ld_i64,
+    TCI_NB_OPS
+} TCIOpcode;
+
+QEMU_BUILD_BUG_ON(TCI_NB_OPS > (1 << 8));
+
 uintptr_t tcg_qemu_tb_exec(CPUArchState *env, const void *tb_ptr);
 #else
 typedef uintptr_t tcg_prologue_fn(CPUArchState *env, const void *tb_ptr);
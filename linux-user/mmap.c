@@ -253,49 +253,19 @@ unsigned long last_brk;
 static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size,
                                         abi_ulong align)
 {
-    abi_ulong addr, end_addr, incr = qemu_host_page_size;
-    int prot;
-    bool looped = false;
-
-    if (size > reserved_va) {
-        return (abi_ulong)-1;
-    }
-
-    /* Note that start and size have already been aligned by mmap_find_vma. */
+    abi_ulong addr;
 
-    end_addr = start + size;
-    if (start > reserved_va - size) {
-        /* Start at the top of the address space.  */
-        end_addr = ((reserved_va - size) & -align) + size;
-        looped = true;
+    /* Note that start and size have already been aligned by mmap_find_vma.
+       Page 0 is never handed out.  */
+    addr = page_find_range_empty(start, reserved_va - 1, size, align);
+    if (addr == (abi_ulong)-1 && start > align) {
+        /* Re-start at the bottom of the address space.  */
+        addr = page_find_range_empty(align, reserved_va - 1, size, align);
     }
-
-    /* Search downward from END_ADDR, checking to see if a page is in use.  */
-    addr = end_addr;
-    while (1) {
-        addr -= incr;
-        if (addr > end_addr) {
-            if (looped) {
-                /* Failure.  The entire address space has been searched.  */
-                return (abi_ulong)-1;
-            }
-            /* Re-start at the top of the address space.  */
-            addr = end_addr = ((reserved_va - size) & -align) + size;
-            looped = true;
-        } else {
-            prot = page_get_flags(addr);
-            if (prot) {
-                /* Page in use.  Restart below this page.  */
-                addr = end_addr = ((addr - size) & -align) + size;
-            } else if (addr && addr + size == end_addr) {
-                /* Success!  All pages between ADDR and END_ADDR are free.  */
-                if (start == mmap_next_start) {
-                    mmap_next_start = addr;
-                }
-                return addr;
-            }
-        }
+    if (addr != (abi_ulong)-1 && start == mmap_next_start) {
+        mmap_next_start = addr + size;
     }
+    return addr;
 }
 
 /*
@@ -326,7 +296,11 @@ abi_ulong mmap_find_vma(abi_ulong start, abi_ulong size, abi_ulong align)
         return mmap_find_vma_reserved(start, size, align);
     }
 
-    addr = start;
+    /* The kernel only takes a hint: skip the guest mappings in the way.  */
+    addr = page_find_range_empty(start, GUEST_ADDR_MAX, size, align);
+    if (addr == (abi_ulong)-1) {
+        addr = start;
+    }
     wrapped = repeat = 0;
     prev = 0;
 
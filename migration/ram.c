@@ -56,6 +56,9 @@
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#if defined(TARGET_CHERI)
+#include "cheri_tagmem.h"
+#endif
 
 /***********************************************************/
 /* ram save/restore */
@@ -81,6 +84,24 @@ static inline bool is_zero_range(uint8_t *p, uint64_t size)
     return buffer_is_zero(p, size);
 }
 
+/*
+ * A page can only be sent as a zero page if both the data and (for CHERI
+ * targets) all capability tags covering it are zero. The tag check is
+ * done second since it only needs to look at the (usually unallocated)
+ * tag block for pages whose data is already known to be zero.
+ */
+static inline bool is_zero_page(RAMBlock *block, ram_addr_t offset)
+{
+    if (!is_zero_range(block->host + offset, TARGET_PAGE_SIZE)) {
+        return false;
+    }
+#if defined(TARGET_CHERI)
+    return cheri_tag_range_empty(block, offset, TARGET_PAGE_SIZE);
+#else
+    return true;
+#endif
+}
+
 XBZRLECacheStats xbzrle_counters;
 
 /* struct contains XBZRLE cache and a static page
@@ -1048,10 +1069,9 @@ static void migration_bitmap_sync_precopy(RAMState *rs)
 static int save_zero_page_to_file(RAMState *rs, QEMUFile *file,
                                   RAMBlock *block, ram_addr_t offset)
 {
-    uint8_t *p = block->host + offset;
     int len = 0;
 
-    if (is_zero_range(p, TARGET_PAGE_SIZE)) {
+    if (is_zero_page(block, offset)) {
         len += save_page_header(rs, file, block, offset | RAM_SAVE_FLAG_ZERO);
         qemu_put_byte(file, 0);
         len += 1;
@@ -70,6 +70,7 @@
 #include "qapi/qapi-commands-control.h"
 #include "qapi/qapi-commands-migration.h"
 #include "qapi/qapi-commands-misc.h"
+#include "qapi/qapi-commands-misc-target.h"
 #include "qapi/qapi-commands-qom.h"
 #include "qapi/qapi-commands-trace.h"
 #include "qapi/qapi-init-commands.h"
@@ -78,6 +79,7 @@
 #include "sysemu/cpus.h"
 #include "qemu/cutils.h"
 #include "tcg/tcg.h"
+#include "exec/tb-stats.h"
 #include "qemu/log_instr.h"
 
 #if defined(TARGET_S390X)
@@ -347,6 +349,132 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info();
 }
+
+static enum TBStatsSortKey tb_stats_sort_by(TbStatsSortBy sort_by)
+{
+    switch (sort_by) {
+    case TB_STATS_SORT_BY_EXECUTIONS:
+        return TB_STATS_KEY_EXECUTIONS;
+    case TB_STATS_SORT_BY_EXITS:
+        return TB_STATS_KEY_EXITS;
+    case TB_STATS_SORT_BY_TRANSLATIONS:
+        return TB_STATS_KEY_TRANSLATIONS;
+    case TB_STATS_SORT_BY_HOST_BYTES:
+        return TB_STATS_KEY_HOST_BYTES;
+    case TB_STATS_SORT_BY_HELPER_CALLS:
+        return TB_STATS_KEY_HELPER_CALLS;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+void qmp_x_tb_stats(TbStatsOp op, Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "TB statistics are only available with accel=tcg");
+        return;
+    }
+
+    switch (op) {
+    case TB_STATS_OP_ON:
+        tb_stats_enable();
+        break;
+    case TB_STATS_OP_OFF:
+        tb_stats_disable();
+        break;
+    case TB_STATS_OP_RESET:
+        tb_stats_reset();
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+TbStatsInfoList *qmp_x_query_tb_stats(bool has_max, int64_t max,
+                                      bool has_sort_by, TbStatsSortBy sort_by,
+                                      Error **errp)
+{
+    TbStatsInfoList *head = NULL, **tail = &head;
+    TBStatistics *snap;
+    size_t i, n;
+
+    if (!has_max) {
+        max = 10;
+    } else if (max < 0) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "max",
+                   "a non-negative number");
+        return NULL;
+    }
+    if (!has_sort_by) {
+        sort_by = TB_STATS_SORT_BY_EXECUTIONS;
+    }
+
+    n = tb_stats_collect(&snap, max, tb_stats_sort_by(sort_by));
+    for (i = 0; i < n; i++) {
+        TbStatsInfoList *entry = g_new0(TbStatsInfoList, 1);
+        TbStatsInfo *info = g_new0(TbStatsInfo, 1);
+        const TBStatistics *s = &snap[i];
+
+        info->pc = s->pc;
+        info->phys_pc = s->phys_pc;
+        info->flags = s->flags;
+        info->executions = s->executions;
+        info->exits = s->exits;
+        info->translations = s->translations;
+        info->guest_insns = s->guest_insns;
+        info->host_bytes = s->host_bytes;
+        info->ops_before_opt = s->ops_before_opt;
+        info->ops_after_opt = s->ops_after_opt;
+        info->helper_calls = s->helper_calls;
+
+        entry->value = info;
+        *tail = entry;
+        tail = &entry->next;
+    }
+    g_free(snap);
+    return head;
+}
+
+static void hmp_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+    Error *err = NULL;
+    int val;
+
+    if (op == NULL) {
+        bool on = tb_stats_is_enabled();
+
+        monitor_printf(mon, "tb-stats is %s\n", on ? "on" : "off");
+        return;
+    }
+    val = qapi_enum_parse(&TbStatsOp_lookup, op, -1, &err);
+    if (val >= 0) {
+        qmp_x_tb_stats(val, &err);
+    }
+    hmp_handle_error(mon, err);
+}
+
+static void hmp_info_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    int64_t max = qdict_get_try_int(qdict, "max", 10);
+    const char *key = qdict_get_try_str(qdict, "sort_by");
+    Error *err = NULL;
+    int sort_by = TB_STATS_SORT_BY_EXECUTIONS;
+
+    if (!tcg_enabled()) {
+        error_report("TB statistics are only available with accel=tcg");
+        return;
+    }
+    if (key) {
+        sort_by = qapi_enum_parse(&TbStatsSortBy_lookup, key, -1, &err);
+        if (sort_by < 0) {
+            hmp_handle_error(mon, err);
+            return;
+        }
+    }
+
+    tb_stats_report(MAX(max, 0), tb_stats_sort_by(sort_by));
+}
 #endif
 
 static void hmp_info_sync_profile(Monitor *mon, const QDict *qdict)
@@ -152,6 +152,18 @@ qemu_plugin_register_vcpu_syscall_ret_cb(qemu_plugin_id_t id,
     plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_SYSCALL_RET, cb);
 }
 
+void qemu_plugin_register_vcpu_cap_mem_cb(qemu_plugin_id_t id,
+                                          qemu_plugin_vcpu_cap_mem_cb_t cb)
+{
+    plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_CAP_MEM, cb);
+}
+
+void qemu_plugin_register_vcpu_cap_reg_cb(qemu_plugin_id_t id,
+                                          qemu_plugin_vcpu_cap_reg_cb_t cb)
+{
+    plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_CAP_REG, cb);
+}
+
 /*
  * Plugin Queries
  *
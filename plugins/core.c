@@ -57,8 +57,15 @@ struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id)
 
 static void plugin_cpu_update__async(CPUState *cpu, run_on_cpu_data data)
 {
+    bool cap_reg = test_bit(QEMU_PLUGIN_EV_VCPU_CAP_REG, cpu->plugin_mask);
+
     bitmap_copy(cpu->plugin_mask, &data.host_ulong, QEMU_PLUGIN_EV_MAX);
     cpu_tb_jmp_cache_clear(cpu);
+    /* Capability register writes are only instrumented at translation */
+    if (cpu->created &&
+        cap_reg != test_bit(QEMU_PLUGIN_EV_VCPU_CAP_REG, cpu->plugin_mask)) {
+        tb_flush(cpu);
+    }
 }
 
 static void plugin_cpu_update__locked(gpointer k, gpointer v, gpointer udata)
@@ -374,6 +381,40 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
     }
 }
 
+void qemu_plugin_vcpu_cap_mem_cb(CPUState *cpu, uint64_t vaddr, bool is_store,
+                                 const qemu_plugin_cap_t *cap)
+{
+    struct qemu_plugin_cb *cb, *next;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_CAP_MEM;
+
+    if (!test_bit(ev, cpu->plugin_mask)) {
+        return;
+    }
+
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[ev], entry, next) {
+        qemu_plugin_vcpu_cap_mem_cb_t func = cb->f.vcpu_cap_mem;
+
+        func(cb->ctx->id, cpu->cpu_index, vaddr, is_store, cap);
+    }
+}
+
+void qemu_plugin_vcpu_cap_reg_cb(CPUState *cpu, const char *reg_name,
+                                 const qemu_plugin_cap_t *cap)
+{
+    struct qemu_plugin_cb *cb, *next;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_CAP_REG;
+
+    if (!test_bit(ev, cpu->plugin_mask)) {
+        return;
+    }
+
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[ev], entry, next) {
+        qemu_plugin_vcpu_cap_reg_cb_t func = cb->f.vcpu_cap_reg;
+
+        func(cb->ctx->id, cpu->cpu_index, reg_name, cap);
+    }
+}
+
 void qemu_plugin_vcpu_idle_cb(CPUState *cpu)
 {
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_IDLE);
@@ -156,7 +156,8 @@ SRST
         additional host cores. The default is to enable multi-threading
         where both the back-end and front-ends support it and no
         incompatible TCG features have been enabled (e.g.
-        icount/replay).
+        icount/replay). Enabling it together with icount selects
+        lockstep execution (see ``-icount``).
 ERST
 
 DEF("smp", HAS_ARG, QEMU_OPTION_smp,
@@ -3965,10 +3966,11 @@ SRST
 ERST
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>][,quantum=N]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
-    "                or disable real time cpu sleeping\n", QEMU_ARCH_ALL)
+    "                or disable real time cpu sleeping; with multi-threaded\n" \
+    "                TCG, run vCPUs in lockstep quanta of N instructions\n", QEMU_ARCH_ALL)
 SRST
 ``-icount [shift=N|auto][,rr=record|replay,rrfile=filename,rrsnapshot=snapshot]``
     Enable virtual instruction counter. The virtual cpu will execute one
@@ -4007,6 +4009,14 @@ SRST
     Option rrsnapshot is used to create new vm snapshot named snapshot
     at the start of execution recording. In replay mode this option is
     used to load the initial VM state.
+
+    With ``-accel tcg,thread=multi`` the vCPUs run on separate threads
+    in lockstep: each executes ``quantum`` instructions (default 10000)
+    and then waits for the others. I/O, atomic operations, timers and
+    memory shared between vCPUs are ordered independently of host
+    timing, but input from outside the guest is not, so the mode is not
+    deterministic. It needs a fixed ``shift`` and cannot be combined
+    with ``rr``.
 ERST
 
 DEF("watchdog", HAS_ARG, QEMU_OPTION_watchdog, \
@@ -15,6 +15,12 @@
 #include "replay-internal.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/bswap.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
 
 /* Mutex to protect reading and writing events to the log.
    data_kind and has_unread_data are also protected
@@ -30,6 +36,65 @@ static unsigned long mutex_head, mutex_tail;
 static bool write_error;
 FILE *replay_file;
 
+/*
+ * The event stream is cut into frames of at most REPLAY_FRAME_SIZE bytes.
+ * While recording, filled frames are handed over to a writer thread which
+ * compresses them with zstd (when available) and appends them to the
+ * file, so the vCPU and main loop threads only copy bytes into memory.
+ *
+ * Every frame starts with a header holding its position in the
+ * uncompressed stream. These headers index the log: positions saved in
+ * snapshots refer to the uncompressed stream, and restoring one only has
+ * to decompress the frame that contains it.
+ */
+#define REPLAY_FRAME_SIZE           (1 << 20)
+/* Maximum number of filled frames waiting for the writer thread */
+#define REPLAY_FRAME_QUEUE          8
+#define REPLAY_FRAME_HEADER_SIZE    20
+#define REPLAY_FRAME_ZSTD           1
+#define REPLAY_ZSTD_LEVEL           1
+
+typedef struct ReplayFrame {
+    /* Position of the first byte in the uncompressed stream */
+    uint64_t offset;
+    uint32_t size;
+    uint8_t *data;
+    QSIMPLEQ_ENTRY(ReplayFrame) next;
+} ReplayFrame;
+
+/* Where a frame of the replayed log lives in the file */
+typedef struct ReplayFrameIndex {
+    uint64_t offset;
+    uint64_t file_pos;
+    uint32_t size;
+    uint32_t stored_size;
+    uint32_t flags;
+} ReplayFrameIndex;
+
+/* Frame being filled when recording, or being read when replaying */
+static ReplayFrame *cur_frame;
+/* Read position in cur_frame */
+static uint32_t cur_pos;
+/* Position of the next byte written in the uncompressed stream */
+static uint64_t write_offset;
+/* Frames of the replayed log, and the one following cur_frame */
+static GArray *frame_index;
+static unsigned int next_frame;
+static bool read_eof;
+#ifdef CONFIG_ZSTD
+static ZSTD_DCtx *zstd_dctx;
+static uint8_t *zstd_buf;
+#endif
+
+/* Writer thread, and the queue of frames it has to write */
+static QemuThread writer_thread;
+static QemuMutex writer_lock;
+static QemuCond writer_cond;
+static QSIMPLEQ_HEAD(, ReplayFrame) writer_queue =
+    QSIMPLEQ_HEAD_INITIALIZER(writer_queue);
+static unsigned int writer_queued;
+static bool writer_done;
+
 static void replay_write_error(void)
 {
     if (!write_error) {
@@ -44,12 +109,310 @@ static void replay_read_error(void)
     exit(1);
 }
 
+static ReplayFrame *replay_frame_new(uint64_t offset)
+{
+    ReplayFrame *frame = g_new0(ReplayFrame, 1);
+
+    frame->offset = offset;
+    frame->data = g_malloc(REPLAY_FRAME_SIZE);
+    return frame;
+}
+
+static void replay_frame_free(ReplayFrame *frame)
+{
+    if (frame) {
+        g_free(frame->data);
+        g_free(frame);
+    }
+}
+
+/* Pass cur_frame to the writer thread, waiting if it is too far behind. */
+static void replay_frame_submit(void)
+{
+    qemu_mutex_lock(&writer_lock);
+    while (writer_queued >= REPLAY_FRAME_QUEUE) {
+        qemu_cond_wait(&writer_cond, &writer_lock);
+    }
+    QSIMPLEQ_INSERT_TAIL(&writer_queue, cur_frame, next);
+    writer_queued++;
+    qemu_cond_broadcast(&writer_cond);
+    qemu_mutex_unlock(&writer_lock);
+    cur_frame = NULL;
+}
+
+static void replay_write(const uint8_t *buf, size_t size)
+{
+    while (size) {
+        size_t n;
+
+        if (!cur_frame) {
+            cur_frame = replay_frame_new(write_offset);
+        }
+        n = MIN(size, REPLAY_FRAME_SIZE - cur_frame->size);
+        memcpy(cur_frame->data + cur_frame->size, buf, n);
+        cur_frame->size += n;
+        write_offset += n;
+        buf += n;
+        size -= n;
+        if (cur_frame->size == REPLAY_FRAME_SIZE) {
+            replay_frame_submit();
+        }
+    }
+}
+
+static void replay_write_frame(ReplayFrame *frame, const uint8_t *payload,
+                               uint32_t stored_size, uint32_t flags)
+{
+    uint8_t header[REPLAY_FRAME_HEADER_SIZE];
+
+    stq_be_p(header, frame->offset);
+    stl_be_p(header + 8, frame->size);
+    stl_be_p(header + 12, stored_size);
+    stl_be_p(header + 16, flags);
+    if (fwrite(header, 1, sizeof(header), replay_file) != sizeof(header)
+        || fwrite(payload, 1, stored_size, replay_file) != stored_size) {
+        replay_write_error();
+    }
+}
+
+static void *replay_writer_thread_fn(void *opaque)
+{
+#ifdef CONFIG_ZSTD
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    size_t bound = ZSTD_compressBound(REPLAY_FRAME_SIZE);
+    uint8_t *zbuf = g_malloc(bound);
+#endif
+
+    for (;;) {
+        ReplayFrame *frame;
+        const uint8_t *payload;
+        uint32_t stored_size;
+        uint32_t flags = 0;
+
+        qemu_mutex_lock(&writer_lock);
+        while (QSIMPLEQ_EMPTY(&writer_queue) && !writer_done) {
+            qemu_cond_wait(&writer_cond, &writer_lock);
+        }
+        frame = QSIMPLEQ_FIRST(&writer_queue);
+        if (frame) {
+            QSIMPLEQ_REMOVE_HEAD(&writer_queue, next);
+        }
+        qemu_mutex_unlock(&writer_lock);
+        if (!frame) {
+            break;
+        }
+
+        payload = frame->data;
+        stored_size = frame->size;
+#ifdef CONFIG_ZSTD
+        if (cctx) {
+            size_t n = ZSTD_compressCCtx(cctx, zbuf, bound, frame->data,
+                                         frame->size, REPLAY_ZSTD_LEVEL);
+            if (!ZSTD_isError(n) && n < frame->size) {
+                payload = zbuf;
+                stored_size = n;
+                flags = REPLAY_FRAME_ZSTD;
+            }
+        }
+#endif
+        replay_write_frame(frame, payload, stored_size, flags);
+        replay_frame_free(frame);
+
+        qemu_mutex_lock(&writer_lock);
+        writer_queued--;
+        qemu_cond_broadcast(&writer_cond);
+        qemu_mutex_unlock(&writer_lock);
+    }
+
+#ifdef CONFIG_ZSTD
+    ZSTD_freeCCtx(cctx);
+    g_free(zbuf);
+#endif
+    return NULL;
+}
+
+/* Collect the frame headers that follow the current file position. */
+static void replay_index_frames(void)
+{
+    uint8_t header[REPLAY_FRAME_HEADER_SIZE];
+    uint64_t offset = 0;
+    uint64_t file_size;
+    long start = ftell(replay_file);
+
+    fseek(replay_file, 0, SEEK_END);
+    file_size = ftell(replay_file);
+    fseek(replay_file, start, SEEK_SET);
+
+    frame_index = g_array_new(false, false, sizeof(ReplayFrameIndex));
+    while (fread(header, 1, sizeof(header), replay_file) == sizeof(header)) {
+        ReplayFrameIndex fi = {
+            .offset = ldq_be_p(header),
+            .size = ldl_be_p(header + 8),
+            .stored_size = ldl_be_p(header + 12),
+            .flags = ldl_be_p(header + 16),
+            .file_pos = ftell(replay_file),
+        };
+
+        /* Stop at a truncated or damaged frame */
+        if (fi.offset != offset || fi.size == 0
+            || fi.size > REPLAY_FRAME_SIZE
+            || (!(fi.flags & REPLAY_FRAME_ZSTD) && fi.stored_size != fi.size)
+            || fi.file_pos + fi.stored_size > file_size) {
+            break;
+        }
+        g_array_append_val(frame_index, fi);
+        offset += fi.size;
+        fseek(replay_file, fi.stored_size, SEEK_CUR);
+    }
+    clearerr(replay_file);
+}
+
+static void replay_load_frame(unsigned int i)
+{
+    ReplayFrameIndex *fi = &g_array_index(frame_index, ReplayFrameIndex, i);
+    uint8_t *buf = cur_frame->data;
+
+    if (fseek(replay_file, fi->file_pos, SEEK_SET) != 0) {
+        replay_read_error();
+    }
+    if (fi->flags & REPLAY_FRAME_ZSTD) {
+#ifdef CONFIG_ZSTD
+        size_t n;
+
+        buf = zstd_buf;
+        if (fread(buf, 1, fi->stored_size, replay_file) != fi->stored_size) {
+            replay_read_error();
+        }
+        n = ZSTD_decompressDCtx(zstd_dctx, cur_frame->data, REPLAY_FRAME_SIZE,
+                                buf, fi->stored_size);
+        if (ZSTD_isError(n) || n != fi->size) {
+            replay_read_error();
+        }
+#else
+        error_report("replay log is compressed, but zstd support "
+                     "is not available");
+        exit(1);
+#endif
+    } else if (fread(buf, 1, fi->size, replay_file) != fi->size) {
+        replay_read_error();
+    }
+    cur_frame->offset = fi->offset;
+    cur_frame->size = fi->size;
+    cur_pos = 0;
+    next_frame = i + 1;
+}
+
+static void replay_read(uint8_t *buf, size_t size)
+{
+    while (size) {
+        size_t n;
+
+        if (cur_pos == cur_frame->size) {
+            if (next_frame == frame_index->len) {
+                read_eof = true;
+                replay_read_error();
+            }
+            replay_load_frame(next_frame);
+        }
+        n = MIN(size, cur_frame->size - cur_pos);
+        memcpy(buf, cur_frame->data + cur_pos, n);
+        cur_pos += n;
+        buf += n;
+        size -= n;
+    }
+}
+
+void replay_log_open(void)
+{
+    if (replay_mode == REPLAY_MODE_RECORD) {
+        write_offset = 0;
+        writer_done = false;
+        qemu_mutex_init(&writer_lock);
+        qemu_cond_init(&writer_cond);
+        qemu_thread_create(&writer_thread, "replay-writer",
+                           replay_writer_thread_fn, NULL,
+                           QEMU_THREAD_JOINABLE);
+    } else {
+#ifdef CONFIG_ZSTD
+        zstd_dctx = ZSTD_createDCtx();
+        zstd_buf = g_malloc(ZSTD_compressBound(REPLAY_FRAME_SIZE));
+#endif
+        replay_index_frames();
+        cur_frame = replay_frame_new(0);
+        cur_pos = 0;
+        next_frame = 0;
+        read_eof = false;
+    }
+}
+
+void replay_log_close(void)
+{
+    if (replay_mode == REPLAY_MODE_RECORD) {
+        if (cur_frame) {
+            replay_frame_submit();
+        }
+        qemu_mutex_lock(&writer_lock);
+        writer_done = true;
+        qemu_cond_broadcast(&writer_cond);
+        qemu_mutex_unlock(&writer_lock);
+        qemu_thread_join(&writer_thread);
+    } else {
+        replay_frame_free(cur_frame);
+        cur_frame = NULL;
+        g_array_free(frame_index, true);
+        frame_index = NULL;
+#ifdef CONFIG_ZSTD
+        ZSTD_freeDCtx(zstd_dctx);
+        zstd_dctx = NULL;
+        g_free(zstd_buf);
+        zstd_buf = NULL;
+#endif
+    }
+}
+
+uint64_t replay_log_tell(void)
+{
+    if (replay_mode == REPLAY_MODE_RECORD) {
+        return write_offset;
+    }
+    return cur_frame->offset + cur_pos;
+}
+
+void replay_log_seek(uint64_t offset)
+{
+    unsigned int lo = 0, hi = frame_index->len;
+    ReplayFrameIndex *fi;
+
+    /* Find the last frame starting at or before offset */
+    while (hi - lo > 1) {
+        unsigned int mid = (lo + hi) / 2;
+
+        fi = &g_array_index(frame_index, ReplayFrameIndex, mid);
+        if (fi->offset <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    if (hi == 0) {
+        /* Empty log */
+        if (offset != 0) {
+            replay_read_error();
+        }
+        return;
+    }
+    fi = &g_array_index(frame_index, ReplayFrameIndex, lo);
+    if (offset - fi->offset > fi->size) {
+        replay_read_error();
+    }
+    replay_load_frame(lo);
+    cur_pos = offset - fi->offset;
+}
+
 void replay_put_byte(uint8_t byte)
 {
     if (replay_file) {
-        if (putc(byte, replay_file) == EOF) {
-            replay_write_error();
-        }
+        replay_write(&byte, 1);
     }
 }
 
@@ -82,9 +445,7 @@ void replay_put_array(const uint8_t *buf, size_t size)
 {
     if (replay_file) {
         replay_put_dword(size);
-        if (fwrite(buf, 1, size, replay_file) != size) {
-            replay_write_error();
-        }
+        replay_write(buf, size);
     }
 }
 
@@ -92,11 +453,7 @@ uint8_t replay_get_byte(void)
 {
     uint8_t byte = 0;
     if (replay_file) {
-        int r = getc(replay_file);
-        if (r == EOF) {
-            replay_read_error();
-        }
-        byte = r;
+        replay_read(&byte, 1);
     }
     return byte;
 }
@@ -138,9 +495,7 @@ void replay_get_array(uint8_t *buf, size_t *size)
 {
     if (replay_file) {
         *size = replay_get_dword();
-        if (fread(buf, 1, *size, replay_file) != *size) {
-            replay_read_error();
-        }
+        replay_read(buf, *size);
     }
 }
 
@@ -149,16 +504,14 @@ void replay_get_array_alloc(uint8_t **buf, size_t *size)
     if (replay_file) {
         *size = replay_get_dword();
         *buf = g_malloc(*size);
-        if (fread(*buf, 1, *size, replay_file) != *size) {
-            replay_read_error();
-        }
+        replay_read(*buf, *size);
     }
 }
 
 void replay_check_error(void)
 {
     if (replay_file) {
-        if (feof(replay_file)) {
+        if (read_eof) {
             error_report("replay file is over");
             qemu_system_vmstop_request_prepare();
             qemu_system_vmstop_request(RUN_STATE_PAUSED);
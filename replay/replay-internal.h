@@ -75,7 +75,8 @@ typedef struct ReplayState {
     unsigned int data_kind;
     /*! Flag which indicates that event is not processed yet. */
     unsigned int has_unread_data;
-    /*! Temporary variable for saving current log offset. */
+    /*! Temporary variable for saving current log offset.
+        This is a position in the uncompressed event stream. */
     uint64_t file_offset;
     /*! Next block operation id.
         This counter is global, because requests from different
@@ -106,6 +107,17 @@ void replay_put_dword(uint32_t dword);
 void replay_put_qword(int64_t qword);
 void replay_put_array(const uint8_t *buf, size_t size);
 
+/*! Starts buffering the events after the log file header.
+    Recording spawns the thread which writes the log, replaying
+    reads the index of the log frames. */
+void replay_log_open(void);
+/*! Writes out the buffered events and stops the writer thread. */
+void replay_log_close(void);
+/*! Returns the current position in the uncompressed event stream. */
+uint64_t replay_log_tell(void);
+/*! Moves the replay read position, as returned by replay_log_tell(). */
+void replay_log_seek(uint64_t offset);
+
 uint8_t replay_get_byte(void);
 uint16_t replay_get_word(void);
 uint32_t replay_get_dword(void);
@@ -19,10 +19,11 @@
 #include "qemu/option.h"
 #include "sysemu/cpus.h"
 #include "qemu/error-report.h"
+#include "qemu/bswap.h"
 
 /* Current version of the replay mechanism.
    Increase it when file format changes. */
-#define REPLAY_VERSION              0xe0200a
+#define REPLAY_VERSION              0xe0200c
 /* Size of replay log header */
 #define HEADER_SIZE                 (sizeof(uint32_t) + sizeof(uint64_t))
 
@@ -297,14 +298,15 @@ static void replay_enable(const char *fname, int mode)
     /* skip file header for RECORD and check it for PLAY */
     if (replay_mode == REPLAY_MODE_RECORD) {
         fseek(replay_file, HEADER_SIZE, SEEK_SET);
+        replay_log_open();
     } else if (replay_mode == REPLAY_MODE_PLAY) {
-        unsigned int version = replay_get_dword();
-        if (version != REPLAY_VERSION) {
+        uint8_t header[HEADER_SIZE];
+        if (fread(header, 1, HEADER_SIZE, replay_file) != HEADER_SIZE
+            || ldl_be_p(header) != REPLAY_VERSION) {
             fprintf(stderr, "Replay: invalid input log file version\n");
             exit(1);
         }
-        /* go to the beginning */
-        fseek(replay_file, HEADER_SIZE, SEEK_SET);
+        replay_log_open();
         replay_fetch_data_kind();
     }
 
@@ -390,10 +392,18 @@ void replay_finish(void)
             replay_shutdown_request(SHUTDOWN_CAUSE_HOST_SIGNAL);
             /* write end event */
             replay_put_event(EVENT_END);
+        }
+        replay_log_close();
 
+        if (replay_mode == REPLAY_MODE_RECORD) {
             /* write header */
+            uint8_t version[sizeof(uint32_t)];
+            stl_be_p(version, REPLAY_VERSION);
             fseek(replay_file, 0, SEEK_SET);
-            replay_put_dword(REPLAY_VERSION);
+            if (fwrite(version, 1, sizeof(version), replay_file)
+                != sizeof(version)) {
+                error_report("replay write error");
+            }
         }
 
         fclose(replay_file);
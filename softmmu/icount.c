@@ -58,6 +58,10 @@ static bool icount_sleep = true;
  */
 int use_icount;
 
+/* Lockstep multi-threaded icount, and its quantum in instructions */
+bool icount_lockstep;
+int64_t icount_lockstep_quantum = 10000;
+
 static void icount_enable_precise(void)
 {
     use_icount = 1;
@@ -89,6 +93,11 @@ static void icount_update_locked(CPUState *cpu)
     int64_t executed = icount_get_executed(cpu);
     cpu->icount_budget -= executed;
 
+    if (icount_lockstep) {
+        /* The shared count only moves at quantum boundaries */
+        cpu->icount_quantum_done += executed;
+        return;
+    }
     qatomic_set_i64(&timers_state.qemu_icount,
                     timers_state.qemu_icount + executed);
 }
@@ -107,6 +116,16 @@ void icount_update(CPUState *cpu)
                          &timers_state.vm_clock_lock);
 }
 
+void icount_lockstep_advance(int64_t count)
+{
+    seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                       &timers_state.vm_clock_lock);
+    qatomic_set_i64(&timers_state.qemu_icount,
+                    timers_state.qemu_icount + count);
+    seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                         &timers_state.vm_clock_lock);
+}
+
 static int64_t icount_get_raw_locked(void)
 {
     CPUState *cpu = current_cpu;
@@ -118,6 +137,11 @@ static int64_t icount_get_raw_locked(void)
         }
         /* Take into account what has run */
         icount_update_locked(cpu);
+        if (icount_lockstep) {
+            /* A vCPU sees its own progress through the current quantum */
+            return qatomic_read_i64(&timers_state.qemu_icount) +
+                cpu->icount_quantum_done;
+        }
     }
     /* The read is protected by the seqlock, but needs atomic64 to avoid UB */
     return qatomic_read_i64(&timers_state.qemu_icount);
@@ -306,6 +330,14 @@ void icount_start_warp_timer(void)
         return;
     }
 
+    /*
+     * In lockstep mode the vCPU threads jump to the next deadline when
+     * they are all idle; a real time warp would not be deterministic.
+     */
+    if (icount_lockstep) {
+        return;
+    }
+
     if (replay_mode != REPLAY_MODE_PLAY) {
         if (!all_cpu_threads_idle()) {
             return;
@@ -422,6 +454,8 @@ void icount_configure(QemuOpts *opts, Error **errp)
     const char *option = qemu_opt_get(opts, "shift");
     bool sleep = qemu_opt_get_bool(opts, "sleep", true);
     bool align = qemu_opt_get_bool(opts, "align", false);
+    int64_t quantum = qemu_opt_get_number(opts, "quantum",
+                                          icount_lockstep_quantum);
     long time_shift = -1;
 
     if (!option) {
@@ -436,6 +470,12 @@ void icount_configure(QemuOpts *opts, Error **errp)
         return;
     }
 
+    if (quantum <= 0) {
+        error_setg(errp, "icount: Invalid quantum value");
+        return;
+    }
+    icount_lockstep_quantum = quantum;
+
     if (strcmp(option, "auto") != 0) {
         if (qemu_strtol(option, NULL, 0, &time_shift) < 0
             || time_shift < 0 || time_shift > MAX_ICOUNT_SHIFT) {
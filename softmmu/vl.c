@@ -527,6 +527,9 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "rrsnapshot",
             .type = QEMU_OPT_STRING,
+        }, {
+            .name = "quantum",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -71,6 +71,30 @@ void helper_store_cap_via_cap_mmu_idx(CPUArchState *env, uint32_t cd,
     store_cap_to_memory_mmu_index(env, cd, addr, _host_return_address, mmu_idx);
 }
 
+/*
+ * Used by the translator fast path: bounds, perms, seal and alignment have
+ * already been checked by inline TCG ops, so only perform the access.
+ */
+void helper_load_cap_via_checked_cap(CPUArchState *env, uint32_t cd,
+                                     uint32_t cb, target_ulong addr)
+{
+    GET_HOST_RETPC();
+    const cap_register_t *cbp = get_capreg_or_special(env, cb);
+
+    cheri_debug_assert(QEMU_IS_ALIGNED(addr, CHERI_CAP_SIZE));
+    load_cap_from_memory(env, cd, cb, cbp, addr, _host_return_address,
+                         /*physaddr_out=*/NULL);
+}
+
+void helper_store_cap_via_checked_cap(CPUArchState *env, uint32_t cs,
+                                      uint32_t cb, target_ulong addr)
+{
+    GET_HOST_RETPC();
+
+    cheri_debug_assert(QEMU_IS_ALIGNED(addr, CHERI_CAP_SIZE));
+    store_cap_to_memory(env, cs, addr, _host_return_address);
+}
+
 void helper_load_cap_pair_via_cap(CPUArchState *env, uint32_t cd, uint32_t cd2,
                                   uint32_t cb, target_ulong addr)
 {
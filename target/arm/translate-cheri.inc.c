@@ -237,6 +237,60 @@ static inline TCGv_i64 read_cpu_reg_maybe_0(DisasContext *ctx, int regnum)
 }
 
 
+/*
+ * Capability load/store via a capability base register. The bounds, perms,
+ * seal and alignment checks are done with inline TCG ops and on success a
+ * helper that only performs the access (and the tag lookup) is called. If any
+ * check fails we call the normal helper, which repeats the checks to raise
+ * the correct exception. For stores we conservatively require all of the
+ * store permissions on the fast path since they depend on the value stored.
+ */
+static void gen_load_store_cap_via_cap_fast(DisasContext *ctx, bool is_load,
+                                            uint32_t rd, uint32_t cb,
+                                            TCGv_i64 addr)
+{
+    int perms = is_load ? CAP_PERM_LOAD
+                        : (CAP_PERM_STORE | CAP_PERM_STORE_CAP |
+                           CAP_PERM_STORE_LOCAL);
+    TCGLabel *slow_path = gen_new_label();
+    TCGLabel *done = gen_new_label();
+    TCGv_i64 local_addr = tcg_temp_local_new_i64();
+    TCGv_i64 ok = tcg_temp_new_i64();
+    TCGv_i64 aligned = tcg_temp_new_i64();
+    TCGv_i32 tcg_rd, tcg_cb;
+
+    tcg_gen_mov_i64(local_addr, addr);
+    gen_cap_memop_checks_result(ctx, cb, local_addr, CHERI_CAP_SIZE, perms,
+                                ok);
+    tcg_gen_andi_i64(aligned, local_addr, CHERI_CAP_SIZE - 1);
+    tcg_gen_setcondi_i64(TCG_COND_EQ, aligned, aligned, 0);
+    tcg_gen_and_i64(ok, ok, aligned);
+    tcg_gen_brcondi_i64(TCG_COND_EQ, ok, 0, slow_path);
+    tcg_temp_free_i64(aligned);
+    tcg_temp_free_i64(ok);
+
+    tcg_rd = tcg_const_i32(rd);
+    tcg_cb = tcg_const_i32(cb);
+    (is_load ? gen_helper_load_cap_via_checked_cap
+             : gen_helper_store_cap_via_checked_cap)(cpu_env, tcg_rd, tcg_cb,
+                                                     local_addr);
+    tcg_temp_free_i32(tcg_cb);
+    tcg_temp_free_i32(tcg_rd);
+    tcg_gen_br(done);
+
+    gen_set_label(slow_path);
+    tcg_rd = tcg_const_i32(rd);
+    tcg_cb = tcg_const_i32(cb);
+    (is_load ? gen_helper_load_cap_via_cap
+             : gen_helper_store_cap_via_cap)(cpu_env, tcg_rd, tcg_cb,
+                                             local_addr);
+    tcg_temp_free_i32(tcg_cb);
+    tcg_temp_free_i32(tcg_rd);
+
+    gen_set_label(done);
+    tcg_temp_free_i64(local_addr);
+}
+
 /**
  * Load/store common code. Most of these options should optimise away.
  *
@@ -391,6 +445,9 @@ static inline __attribute__((always_inline)) bool load_store_implementation(
                          : gen_helper_store_cap_via_cap_mmu_idx)(
                     cpu_env, tcg_rd, tcg_base_reg, addr, tcg_idx);
                 tcg_temp_free_i32(tcg_idx);
+            } else if (capability_base) {
+                gen_load_store_cap_via_cap_fast(ctx, is_load, rd, base_reg,
+                                                addr);
             } else {
                 (is_load ? gen_helper_load_cap_via_cap
                          : gen_helper_store_cap_via_cap)(cpu_env, tcg_rd,
@@ -145,6 +145,8 @@ DEF_HELPER_2(cloadtags, tl, env, i32)
 // Slightly different from normal tracing as it will not trigger decompression.
 // This is helpful if there is a TCG bug that would go away with tracing.
 DEF_HELPER_2(debug_cap, void, env, i32)
+// Report a capability register written by inline TCG to plugins
+DEF_HELPER_FLAGS_3(plugin_capreg_changed, TCG_CALL_NO_WG, void, env, cptr, cptr)
 
 // Check that static optimisation is correct
 DEF_HELPER_4(capreg_state_debug, void, env, i32, i64, i64)
@@ -375,6 +375,25 @@ bool load_cap_from_memory_raw_tag_mmu_idx(
     CPUArchState *env, target_ulong *pesbt, target_ulong *cursor, uint32_t cb,
     const cap_register_t *source, target_ulong vaddr, target_ulong retpc,
     hwaddr *physaddr, bool *raw_tag, int mmu_idx);
+
+typedef struct CheriCapMemValue {
+    target_ulong pesbt;
+    target_ulong cursor;
+    bool tag;
+} CheriCapMemValue;
+
+/*
+ * Store capability register @cs to @vaddr if memory holds @expected (or
+ * unconditionally if @expected is NULL) without stopping other vCPUs. The
+ * previous contents as they would have been returned by
+ * load_cap_from_memory_raw() are written to @old.
+ * Returns true if the store was performed.
+ * Must only be called if CHERI_CAP_CMPXCHG_SUPPORTED.
+ */
+bool cheri_cap_cmpxchg_parallel(CPUArchState *env, uint32_t cb,
+                                const cap_register_t *cbp, target_ulong vaddr,
+                                uint32_t cs, const CheriCapMemValue *expected,
+                                CheriCapMemValue *old, uintptr_t retpc);
 /* Useful for the load+branch capability helpers. */
 cap_register_t load_and_decompress_cap_from_memory_raw(
     CPUArchState *env, uint32_t cb, const cap_register_t *source,
@@ -246,15 +246,66 @@ get_load_store_base_cap(CPUArchState *env, uint32_t cb)
 #endif
 }
 
+#ifdef CONFIG_PLUGIN
+static inline bool cheri_plugin_event_enabled(CPUArchState *env,
+                                              enum qemu_plugin_event ev)
+{
+    return unlikely(test_bit(ev, env_cpu(env)->plugin_mask));
+}
+#else
+#define cheri_plugin_event_enabled(env, ev) false
+#endif
+
+static inline void cheri_plugin_cap_from(qemu_plugin_cap_t *out,
+                                         const cap_register_t *cr)
+{
+    out->cursor = cap_get_cursor(cr);
+    out->base = cap_get_base(cr);
+    out->top = cap_get_top(cr);
+    out->otype = cap_get_otype_unsigned(cr);
+    out->perms = cap_get_perms(cr);
+    out->uperms = cap_get_uperms(cr);
+    out->flags = cap_get_flags(cr);
+    out->tag = cr->cr_tag;
+}
+
+/*
+ * Notify plugins of a capability load/store. The caller should check
+ * cheri_plugin_event_enabled(env, QEMU_PLUGIN_EV_VCPU_CAP_MEM) first to
+ * avoid decompressing the capability when no plugin is listening.
+ */
+static inline void cheri_plugin_cap_mem(CPUArchState *env, target_ulong vaddr,
+                                        bool is_store, const cap_register_t *cr)
+{
+    qemu_plugin_cap_t cap;
+
+    cheri_plugin_cap_from(&cap, cr);
+    qemu_plugin_vcpu_cap_mem_cb(env_cpu(env), vaddr, is_store, &cap);
+}
+
+static inline void cheri_plugin_changed_capreg(CPUArchState *env,
+                                               const char *name,
+                                               const cap_register_t *newval)
+{
+    if (cheri_plugin_event_enabled(env, QEMU_PLUGIN_EV_VCPU_CAP_REG)) {
+        qemu_plugin_cap_t cap;
+
+        cheri_plugin_cap_from(&cap, newval);
+        qemu_plugin_vcpu_cap_reg_cb(env_cpu(env), name, &cap);
+    }
+}
+
 #ifdef CONFIG_TCG_LOG_INSTR
 
 /*
  * Log instruction update to the given capability register.
+ * This also reports the update to any plugins that are interested in it.
  */
 #define cheri_log_instr_changed_capreg(env, name, newval) do {          \
         if (qemu_log_instr_enabled(env)) {                              \
             qemu_log_instr_cap(env, name, newval);                      \
         }                                                               \
+        cheri_plugin_changed_capreg(env, name, newval);                 \
     } while (0)
 
 /*
@@ -268,7 +319,8 @@ get_load_store_base_cap(CPUArchState *env, uint32_t cb)
     } while (0)
 
 #else
-#define cheri_log_instr_changed_capreg(env, name, newval) ((void)0)
+#define cheri_log_instr_changed_capreg(env, name, newval)               \
+    cheri_plugin_changed_capreg(env, name, newval)
 #define cheri_log_instr_changed_capreg_int(env, name, newval) ((void)0)
 #endif
 
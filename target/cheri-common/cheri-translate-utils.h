@@ -99,6 +99,11 @@ _gen_cap_check(rmw)
 static inline void gen_load_gpr(TCGv t, int reg);
 #define target_get_gpr(ctx, t, reg) gen_load_gpr((TCGv)t, reg)
 #define MERGED_FILE 0
+// The capability register file is separate from the GPRs, but the cursors are
+// still TCG globals so that they can stay in host registers between helpers.
+static inline TCGv mips_capreg_cursor_global(int reg);
+#define SEPARATE_CURSOR_GLOBALS 1
+#define target_get_cursor_global(ctx, reg) mips_capreg_cursor_global(reg)
 
 #elif defined(TARGET_AARCH64)
 
@@ -140,6 +145,12 @@ TCGv_i64 cpu_reg(DisasContext *s, int reg);
 #error "Don't know how to fetch a GPR value"
 #endif
 
+#ifndef SEPARATE_CURSOR_GLOBALS
+// On merged register files the cursors are the GPR globals.
+#define SEPARATE_CURSOR_GLOBALS 0
+#define target_get_cursor_global(ctx, reg) target_get_gpr_global(ctx, reg)
+#endif
+
 static inline void generate_get_ddc_checked_gpr_plus_offset(
     TCGv_cap_checked_ptr addr, DisasContext *ctx, int reg_num,
     target_long offset, MemOp mop,
@@ -838,6 +849,9 @@ static inline void gen_cap_get_cursor(DisasContext *ctx, int regnum,
     } else {
         if (regnum == NULL_CAPREG_INDEX) {
             tcg_gen_movi_tl(cursor, 0);
+        } else if (SEPARATE_CURSOR_GLOBALS &&
+                   !lazy_capreg_number_is_special(regnum)) {
+            tcg_gen_mov_tl(cursor, target_get_cursor_global(ctx, regnum));
         } else {
             tcg_gen_ld_tl(cursor, cpu_env,
                           gp_register_offset(regnum) +
@@ -847,15 +861,24 @@ static inline void gen_cap_get_cursor(DisasContext *ctx, int regnum,
     cheri_tcg_printf_verbose("cd", "Get reg %d cursor: %lx\n", regnum, cursor);
 }
 
+#define cheri_ctx_plugin_cap_reg_enabled(ctx)                                  \
+    unlikely(ctx->base.plugin_cap_reg_enabled)
+
 static inline void gen_reg_modified_cap_base(DisasContext *ctx,
                                              const char *str_name,
                                              size_t env_offset)
 {
-    if (qemu_ctx_logging_enabled(ctx)) {
+    if (qemu_ctx_logging_enabled(ctx) ||
+        cheri_ctx_plugin_cap_reg_enabled(ctx)) {
         TCGv_ptr name = tcg_const_ptr(str_name);
         TCGv_ptr reg = tcg_const_ptr(env_offset);
         tcg_gen_add_ptr(reg, reg, cpu_env);
-        gen_helper_qemu_log_instr_cap(cpu_env, name, reg);
+        if (qemu_ctx_logging_enabled(ctx)) {
+            gen_helper_qemu_log_instr_cap(cpu_env, name, reg);
+        }
+        if (cheri_ctx_plugin_cap_reg_enabled(ctx)) {
+            gen_helper_plugin_capreg_changed(cpu_env, name, reg);
+        }
         tcg_temp_free_ptr(reg);
         tcg_temp_free_ptr(name);
     }
@@ -867,7 +890,8 @@ static inline void gen_reg_modified_cap(DisasContext *ctx, int regnum)
 {
     if (regnum == NULL_CAPREG_INDEX)
         return;
-    if (qemu_ctx_logging_enabled(ctx)) {
+    if (qemu_ctx_logging_enabled(ctx) ||
+        cheri_ctx_plugin_cap_reg_enabled(ctx)) {
         gen_ensure_cap_decompressed(ctx, regnum);
         gen_reg_modified_cap_base(ctx, cheri_gp_regnames[regnum],
                                   gp_register_offset(regnum));
@@ -1006,21 +1030,22 @@ static inline void gen_sp_set_decompressed_int(DisasContext *ctx, size_t offset)
     tcg_temp_free(temp);
 }
 
-// In a merged register file, cursors are also globals. If backing is to also be
-// used for memory operations, We need to take special
+// In a merged register file, cursors are also globals (and on MIPS they are
+// globals of their own). If backing is to also be used for memory operations,
+// We need to take special care to sync / discard the global.
 static inline void gen_cap_sync_cursor(DisasContext *ctx, int regnum)
 {
-#if MERGED_FILE
+#if MERGED_FILE || SEPARATE_CURSOR_GLOBALS
     if (!lazy_capreg_number_is_special(regnum))
-        tcg_gen_sync_tl(target_get_gpr_global(ctx, regnum));
+        tcg_gen_sync_tl(target_get_cursor_global(ctx, regnum));
 #endif
 }
 
 static inline void gen_cap_invalidate_cursor(DisasContext *ctx, int regnum)
 {
-#if MERGED_FILE
+#if MERGED_FILE || SEPARATE_CURSOR_GLOBALS
     if (!lazy_capreg_number_is_special(regnum))
-        tcg_gen_discard_tl(target_get_gpr_global(ctx, regnum));
+        tcg_gen_discard_tl(target_get_cursor_global(ctx, regnum));
 #endif
 }
 
@@ -1476,6 +1501,9 @@ static inline void gen_cap_set_cursor_unsafe(DisasContext *ctx, int regnum,
 #if MERGED_FILE
         target_set_gpr(ctx, regnum, new_cursor);
 #endif
+    } else if (SEPARATE_CURSOR_GLOBALS &&
+               !lazy_capreg_number_is_special(regnum)) {
+        tcg_gen_mov_tl(target_get_cursor_global(ctx, regnum), new_cursor);
     } else {
         tcg_gen_st_tl(new_cursor, cpu_env,
                       gp_register_offset(regnum) +
@@ -2210,6 +2238,32 @@ static inline void gen_cap_set_pesbt(DisasContext *ctx, int regnum, TCGv pesbt)
     tcg_temp_free(mem_pesbt);
 }
 
+#ifdef DO_TCG_BOUNDS_CHECKS
+// Sets result to 1 if a size byte access at addr via cap regnum with the
+// specified perms would pass the bounds, perms, seal and tag checks, and 0
+// otherwise. addr must be a local temp since decompressing regnum may branch.
+static inline void gen_cap_memop_checks_result(DisasContext *ctx, int regnum,
+                                               TCGv addr, target_ulong size,
+                                               int perms, TCGv result)
+{
+    TCGv tmp = tcg_temp_new();
+
+    // Bounds
+    gen_cap_in_bounds(ctx, regnum, addr, result, size);
+    // Perms
+    gen_cap_has_perms(ctx, regnum, perms, tmp);
+    tcg_gen_and_tl(result, result, tmp);
+    // Unsealed
+    gen_cap_get_unsealed(ctx, regnum, tmp);
+    tcg_gen_and_tl(result, result, tmp);
+    // Tagged
+    gen_cap_get_tag(ctx, regnum, tmp);
+    tcg_gen_and_tl(result, result, tmp);
+
+    tcg_temp_free(tmp);
+}
+#endif
+
 // Checks a cap is in bounds for a given size, has specified perms, is tagged,
 // and not sealed. Or throws an exception. Because of the branch, this will kill
 // every temp. Addr is specially conserved as it will probably be used again.
@@ -2224,17 +2278,7 @@ static inline void gen_cap_memop_checks(DisasContext *ctx, int regnum,
     tcg_gen_mov_tl(local_addr, addr);
     TCGv tmp2 = addr;
 
-    // Bounds
-    gen_cap_in_bounds(ctx, regnum, local_addr, result, size);
-    // Perms
-    gen_cap_has_perms(ctx, regnum, perms, tmp2);
-    tcg_gen_and_tl(result, result, tmp2);
-    // Unsealed
-    gen_cap_get_unsealed(ctx, regnum, tmp2);
-    tcg_gen_and_tl(result, result, tmp2);
-    // Tagged
-    gen_cap_get_tag(ctx, regnum, tmp2);
-    tcg_gen_and_tl(result, result, tmp2);
+    gen_cap_memop_checks_result(ctx, regnum, local_addr, size, perms, result);
 
     /* If failure: */
     TCGLabel *skip = gen_new_label();
@@ -66,6 +66,20 @@
 #  define CHERI_MEM_OFFSET_METADATA TARGET_LONG_SIZE
 #endif
 
+/*
+ * Whether capability atomics can be implemented without stopping all other
+ * vCPUs (i.e. without EXCP_ATOMIC). This requires a host cmpxchg wide enough
+ * for a capability.
+ */
+#include "qemu/atomic128.h"
+#if CHERI_CAP_SIZE == 16
+#  define CHERI_CAP_CMPXCHG_SUPPORTED HAVE_CMPXCHG128
+#elif defined(CONFIG_ATOMIC64)
+#  define CHERI_CAP_CMPXCHG_SUPPORTED 1
+#else
+#  define CHERI_CAP_CMPXCHG_SUPPORTED 0
+#endif
+
 /*
  * Optional suffix intended for Morello to differentiate its 128-bit
  * compression format from the CHERI-MIPS and CHERI-RISC-V CHERI-128 format,
@@ -253,6 +253,32 @@ void cheri_tag_init(MemoryRegion *mr, uint64_t memory_size)
     }
 }
 
+bool cheri_tag_range_empty(RAMBlock *ram, ram_addr_t ram_offset,
+                           ram_addr_t len)
+{
+    if (!ram->cheri_tags) {
+        return true;
+    }
+
+    uint64_t tag = ram_offset / CHERI_CAP_SIZE;
+    uint64_t end_tag = DIV_ROUND_UP(ram_offset + len, CHERI_CAP_SIZE);
+    while (tag < end_tag) {
+        /* Never look past the end of the tag block containing @tag. */
+        uint64_t blk_end = MIN(end_tag, QEMU_ALIGN_UP(tag + 1, CAP_TAGBLK_SIZE));
+        CheriTagBlock *tagblk = cheri_tag_block(tag, ram);
+        /* Blocks that were never allocated cannot contain any set tags. */
+        if (tagblk) {
+            size_t first = CAP_TAGBLK_IDX(tag);
+            size_t last = first + (blk_end - tag);
+            if (find_next_bit(tagblk->tag_bitmap, last, first) < last) {
+                return false;
+            }
+        }
+        tag = blk_end;
+    }
+    return true;
+}
+
 void *cheri_tagmem_for_addr(CPUArchState *env, target_ulong vaddr,
                             RAMBlock *ram, ram_addr_t ram_offset, size_t size,
                             int *prot, bool tag_write)
@@ -521,6 +547,20 @@ void cheri_tag_phys_invalidate(CPUArchState *env, RAMBlock *ram,
 #define clear_capcause_reg(env)
 #endif
 
+void *cheri_tag_probe_store(CPUArchState *env, target_ulong vaddr, int reg,
+                            bool tag, uintptr_t pc, int mmu_idx)
+{
+    void *host_addr;
+
+    if (!tag) {
+        return probe_write(env, vaddr, CHERI_CAP_SIZE, mmu_idx, pc);
+    }
+    store_capcause_reg(env, reg);
+    host_addr = probe_cap_write(env, vaddr, CHERI_CAP_SIZE, mmu_idx, pc);
+    clear_capcause_reg(env);
+    return host_addr;
+}
+
 void *cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg,
                     hwaddr *ret_paddr, uintptr_t pc, int mmu_idx)
 {
@@ -685,3 +725,81 @@ void cheri_tag_set_many(CPUArchState *env, uint32_t tags, target_ulong vaddr,
 
     tagblock_set_tag_many_tagmem(tagmem, page_vaddr_to_tag_offset(vaddr), tags);
 }
+
+bool cheri_tag_copy_in_page(CPUArchState *env, target_ulong dst_vaddr,
+                            target_ulong src_vaddr, target_ulong len,
+                            bool load_tags, bool store_tags, int reg,
+                            uintptr_t pc, int mmu_idx)
+{
+    cheri_debug_assert(len != 0 && len <= TARGET_PAGE_SIZE);
+    cheri_debug_assert(QEMU_IS_ALIGNED(dst_vaddr, CHERI_CAP_SIZE));
+    cheri_debug_assert(QEMU_IS_ALIGNED(src_vaddr, CHERI_CAP_SIZE));
+    cheri_debug_assert((dst_vaddr & TARGET_PAGE_MASK) ==
+                       ((dst_vaddr + len - 1) & TARGET_PAGE_MASK));
+    cheri_debug_assert((src_vaddr & TARGET_PAGE_MASK) ==
+                       ((src_vaddr + len - 1) & TARGET_PAGE_MASK));
+
+    void *src_host = probe_read(env, src_vaddr, len, mmu_idx, pc);
+    if (unlikely(!src_host)) {
+        return false;
+    }
+    uintptr_t src_flags;
+    void *src_tagmem = get_tagmem_from_iotlb_entry(env, src_vaddr, mmu_idx,
+                                                   /*write=*/false, &src_flags);
+    if (src_flags & TLBENTRYCAP_FLAG_TRAP_ANY) {
+        return false;
+    }
+
+    /*
+     * Only whole capabilities keep their tag, a trailing partial one is
+     * cleared just like it would be by a sub-capability store.
+     */
+    const size_t ntags = DIV_ROUND_UP(len, CHERI_CAP_SIZE);
+    const size_t nwhole = len / CHERI_CAP_SIZE;
+    const size_t src_first = page_vaddr_to_tag_offset(src_vaddr);
+    bool have_tags = false;
+    if (load_tags && nwhole && src_tagmem != ALL_ZERO_TAGBLK &&
+        !(src_flags & TLBENTRYCAP_FLAG_CLEAR)) {
+        have_tags = find_next_bit(src_tagmem, src_first + nwhole, src_first) <
+                    src_first + nwhole;
+    }
+    if (have_tags &&
+        (!store_tags || (src_flags & TLBENTRYCAP_FLAG_TRAP))) {
+        /* Needs a precise exception -> let the caller take the slow path. */
+        return false;
+    }
+
+    void *dst_host;
+    if (have_tags) {
+        store_capcause_reg(env, reg);
+        dst_host = probe_cap_write(env, dst_vaddr, len, mmu_idx, pc);
+        clear_capcause_reg(env);
+    } else {
+        dst_host = probe_write(env, dst_vaddr, len, mmu_idx, pc);
+    }
+    if (unlikely(!dst_host)) {
+        return false;
+    }
+    uintptr_t dst_flags;
+    void *dst_tagmem = get_tagmem_from_iotlb_entry(env, dst_vaddr, mmu_idx,
+                                                   /*write=*/true, &dst_flags);
+
+    memcpy(dst_host, src_host, len);
+
+    if (dst_tagmem == ALL_ZERO_TAGBLK) {
+        return true;
+    }
+    if (dst_flags & TLBENTRYCAP_FLAG_CLEAR) {
+        have_tags = false;
+    }
+    const size_t dst_first = page_vaddr_to_tag_offset(dst_vaddr);
+    for (size_t i = 0; i < ntags; i++) {
+        if (have_tags && i < nwhole &&
+            tagblock_get_tag_tagmem(src_tagmem, src_first + i)) {
+            tagblock_set_tag_tagmem(dst_tagmem, dst_first + i);
+        } else {
+            tagblock_clear_tag_tagmem(dst_tagmem, dst_first + i);
+        }
+    }
+    return true;
+}
@@ -73,6 +73,14 @@ int cheri_tag_get_many(CPUArchState *env, target_ulong vaddr, int reg,
 void cheri_tag_set_many(CPUArchState *env, uint32_t tags, target_ulong vaddr,
                         int reg, hwaddr *ret_paddr, uintptr_t pc);
 
+/**
+ * Take all the TLB faults of a capability store to @vaddr (with a capability
+ * store fault only if @tag is set) without modifying memory or tags.
+ * @return the host address, or NULL if @vaddr is not backed by host RAM.
+ */
+void *cheri_tag_probe_store(CPUArchState *env, target_ulong vaddr, int reg,
+                            bool tag, uintptr_t pc, int mmu_idx);
+
 /**
  * Update a tag for virtual address @vaddr.
  * @return the host address as returned by probe_cap_write()
@@ -80,6 +88,31 @@ void cheri_tag_set_many(CPUArchState *env, uint32_t tags, target_ulong vaddr,
 void *cheri_tag_set(CPUArchState *env, target_ulong vaddr, int reg,
                     hwaddr *ret_paddr, uintptr_t pc, int mmu_idx);
 
+/**
+ * Check whether all tags covering [@ram_offset, @ram_offset + @len) in @ram
+ * are clear. Unallocated tag blocks are skipped without scanning, and within
+ * allocated blocks the bitmap is checked a word at a time, so this is cheap
+ * enough to be called for every page (e.g. during RAM migration).
+ */
+bool cheri_tag_range_empty(RAMBlock *ram, ram_addr_t ram_offset,
+                           ram_addr_t len);
+
+/**
+ * Copy @len bytes of data and the matching tags from @src_vaddr to
+ * @dst_vaddr using host memcpy() and the tag bitmaps directly. Both addresses
+ * must be CHERI_CAP_SIZE-aligned, neither range may cross a page boundary and
+ * the ranges must not overlap.
+ * Tags are only copied if @load_tags is set; a tagged source capability with
+ * @store_tags false (or one that would trap on load) makes this return false
+ * without writing anything so that the caller can fall back to a path that
+ * raises the right exception. This also returns false for non-RAM memory.
+ * TLB faults are raised as usual, so callers must be restartable.
+ */
+bool cheri_tag_copy_in_page(CPUArchState *env, target_ulong dst_vaddr,
+                            target_ulong src_vaddr, target_ulong len,
+                            bool load_tags, bool store_tags, int reg,
+                            uintptr_t pc, int mmu_idx);
+
 void *cheri_tagmem_for_addr(CPUArchState *env, target_ulong vaddr,
                             RAMBlock *ram, ram_addr_t ram_offset, size_t size,
                             int *prot, bool tag_write);
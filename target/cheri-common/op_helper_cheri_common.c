@@ -1409,6 +1409,89 @@ void squash_mutable_permissions(CPUArchState *env, target_ulong *pesbt,
 #endif
 }
 
+/*
+ * Account for and trace a capability load of (@pesbt, @cursor, @tag) from
+ * @vaddr. Shared by the plain and the atomic accesses so that both produce
+ * the same statistics, instruction log and plugin events.
+ */
+static void cap_mem_load_done(CPUArchState *env, target_ulong vaddr,
+                              target_ulong pesbt, target_ulong cursor,
+                              bool tag)
+{
+    env->statcounters_cap_read++;
+    if (tag)
+        env->statcounters_cap_read_tagged++;
+
+#if defined(TARGET_RISCV) && defined(CONFIG_RVFI_DII)
+    env->rvfi_dii_trace.MEM.rvfi_mem_addr = vaddr;
+    env->rvfi_dii_trace.MEM.rvfi_mem_rdata[0] = cursor;
+    env->rvfi_dii_trace.MEM.rvfi_mem_rdata[1] = pesbt;
+    env->rvfi_dii_trace.MEM.rvfi_mem_rdata[2] = tag;
+    env->rvfi_dii_trace.MEM.rvfi_mem_rmask = (1 << CHERI_CAP_SIZE) - 1;
+    // TODO: Add one extra bit to include the tag?
+    env->rvfi_dii_trace.available_fields |= RVFI_MEM_DATA;
+#endif
+#if defined(CONFIG_TCG_LOG_INSTR)
+    /* Log capability memory access as a single access */
+    if (qemu_log_instr_enabled(env)) {
+        /*
+         * Decompress to log all fields
+         * TODO(am2419): why do we decompress? we and up having to compress
+         * again in logging implementation. Passing pesbt + cursor would
+         * assume a 128-bit format and be less generic?
+         */
+        cap_register_t ncd;
+        CAP_cc(decompress_raw)(pesbt, cursor, tag, &ncd);
+        qemu_log_instr_ld_cap(env, vaddr, &ncd);
+    }
+#endif
+    if (cheri_plugin_event_enabled(env, QEMU_PLUGIN_EV_VCPU_CAP_MEM)) {
+        cap_register_t ncd;
+        CAP_cc(decompress_raw)(pesbt, cursor, tag, &ncd);
+        cheri_plugin_cap_mem(env, vaddr, /*is_store=*/false, &ncd);
+    }
+}
+
+/* Likewise for a capability store; @pesbt_for_mem is the in-memory form. */
+static void cap_mem_store_done(CPUArchState *env, target_ulong vaddr,
+                               target_ulong pesbt_for_mem,
+                               target_ulong cursor, bool tag)
+{
+    env->statcounters_cap_write++;
+    if (tag)
+        env->statcounters_cap_write_tagged++;
+
+#if defined(TARGET_RISCV) && defined(CONFIG_RVFI_DII)
+    env->rvfi_dii_trace.MEM.rvfi_mem_addr = vaddr;
+    env->rvfi_dii_trace.MEM.rvfi_mem_wdata[0] = cursor;
+    env->rvfi_dii_trace.MEM.rvfi_mem_wdata[1] = pesbt_for_mem;
+    env->rvfi_dii_trace.MEM.rvfi_mem_wdata[2] = tag;
+    env->rvfi_dii_trace.MEM.rvfi_mem_wmask = (1 << CHERI_CAP_SIZE) - 1;
+    // TODO: Add one extra bit to include the tag?
+    env->rvfi_dii_trace.available_fields |= RVFI_MEM_DATA;
+#endif
+#if defined(CONFIG_TCG_LOG_INSTR)
+    /* Log capability memory access as a single access */
+    if (qemu_log_instr_enabled(env)) {
+        /*
+         * Decompress to log all fields
+         * TODO(am2419): see notes on the load path on compression.
+         */
+        cap_register_t stored_cap;
+        const target_ulong pesbt = pesbt_for_mem ^ CAP_NULL_XOR_MASK;
+        CAP_cc(decompress_raw)(pesbt, cursor, tag, &stored_cap);
+        cheri_debug_assert(cursor == cap_get_cursor(&stored_cap));
+        qemu_log_instr_st_cap(env, vaddr, &stored_cap);
+    }
+#endif
+    if (cheri_plugin_event_enabled(env, QEMU_PLUGIN_EV_VCPU_CAP_MEM)) {
+        cap_register_t stored_cap;
+        const target_ulong pesbt = pesbt_for_mem ^ CAP_NULL_XOR_MASK;
+        CAP_cc(decompress_raw)(pesbt, cursor, tag, &stored_cap);
+        cheri_plugin_cap_mem(env, vaddr, /*is_store=*/true, &stored_cap);
+    }
+}
+
 bool load_cap_from_memory_raw_tag_mmu_idx(
     CPUArchState *env, target_ulong *pesbt, target_ulong *cursor, uint32_t cb,
     const cap_register_t *source, target_ulong vaddr, target_ulong retpc,
@@ -1457,33 +1540,7 @@ bool load_cap_from_memory_raw_tag_mmu_idx(
     if (tag)
         squash_mutable_permissions(env, pesbt, source);
 
-    env->statcounters_cap_read++;
-    if (tag)
-        env->statcounters_cap_read_tagged++;
-
-#if defined(TARGET_RISCV) && defined(CONFIG_RVFI_DII)
-    env->rvfi_dii_trace.MEM.rvfi_mem_addr = vaddr;
-    env->rvfi_dii_trace.MEM.rvfi_mem_rdata[0] = *cursor;
-    env->rvfi_dii_trace.MEM.rvfi_mem_rdata[1] = *pesbt;
-    env->rvfi_dii_trace.MEM.rvfi_mem_rdata[2] = tag;
-    env->rvfi_dii_trace.MEM.rvfi_mem_rmask = (1 << CHERI_CAP_SIZE) - 1;
-    // TODO: Add one extra bit to include the tag?
-    env->rvfi_dii_trace.available_fields |= RVFI_MEM_DATA;
-#endif
-#if defined(CONFIG_TCG_LOG_INSTR)
-    /* Log capability memory access as a single access */
-    if (qemu_log_instr_enabled(env)) {
-        /*
-         * Decompress to log all fields
-         * TODO(am2419): why do we decompress? we and up having to compress
-         * again in logging implementation. Passing pesbt + cursor would
-         * assume a 128-bit format and be less generic?
-         */
-        cap_register_t ncd;
-        CAP_cc(decompress_raw)(*pesbt, *cursor, tag, &ncd);
-        qemu_log_instr_ld_cap(env, vaddr, &ncd);
-    }
-#endif
+    cap_mem_load_done(env, vaddr, *pesbt, *cursor, tag);
     return tag;
 }
 
@@ -1531,6 +1588,32 @@ void load_cap_from_memory(CPUArchState *env, uint32_t cd, uint32_t cb,
     update_compressed_capreg(env, cd, pesbt, tag, cursor);
 }
 
+#if CHERI_CAP_CMPXCHG_SUPPORTED
+/*
+ * Capability stores and atomics update the data and the tag separately, so
+ * with MTTCG they are serialized against each other with a striped lock
+ * keyed by the host cache line. Plain data stores only ever clear tags and
+ * do not need it. Atomics additionally replace the data with a host
+ * compare-and-swap, so that a racing data store makes them retry.
+ */
+#define CAP_ATOMIC_LOCK_STRIPES 256
+#define CAP_ATOMIC_LOCK_SHIFT 6
+static QemuSpin cap_atomic_locks[CAP_ATOMIC_LOCK_STRIPES];
+
+static void __attribute__((constructor)) cap_atomic_locks_init(void)
+{
+    for (int i = 0; i < CAP_ATOMIC_LOCK_STRIPES; i++) {
+        qemu_spin_init(&cap_atomic_locks[i]);
+    }
+}
+
+static inline QemuSpin *cap_atomic_lock_for(void *host)
+{
+    return &cap_atomic_locks[((uintptr_t)host >> CAP_ATOMIC_LOCK_SHIFT) %
+                             CAP_ATOMIC_LOCK_STRIPES];
+}
+#endif
+
 void store_cap_to_memory_mmu_index(CPUArchState *env, uint32_t cs,
                                    target_ulong vaddr, target_ulong retpc,
                                    int mmu_idx)
@@ -1556,10 +1639,19 @@ void store_cap_to_memory_mmu_index(CPUArchState *env, uint32_t cs,
      * tag logic, is not multi-TCG-thread safe.
      */
 
-    env->statcounters_cap_write++;
     void *host = NULL;
+#if CHERI_CAP_CMPXCHG_SUPPORTED
+    QemuSpin *lock = NULL;
+    if (qemu_tcg_mttcg_enabled()) {
+        /* No TLB fault may be taken with the lock held. */
+        host = cheri_tag_probe_store(env, vaddr, cs, tag, retpc, mmu_idx);
+        if (host) {
+            lock = cap_atomic_lock_for(host);
+            qemu_spin_lock(lock);
+        }
+    }
+#endif
     if (tag) {
-        env->statcounters_cap_write_tagged++;
         host = cheri_tag_set(env, vaddr, cs, NULL, retpc, mmu_idx);
     } else {
         host = cheri_tag_invalidate_aligned(env, vaddr, retpc, mmu_idx);
@@ -1587,29 +1679,12 @@ void store_cap_to_memory_mmu_index(CPUArchState *env, uint32_t cs,
         cpu_st_cap_word_ra(env, vaddr + CHERI_MEM_OFFSET_CURSOR, cursor,
                            retpc);
     }
-#if defined(TARGET_RISCV) && defined(CONFIG_RVFI_DII)
-    env->rvfi_dii_trace.MEM.rvfi_mem_addr = vaddr;
-    env->rvfi_dii_trace.MEM.rvfi_mem_wdata[0] = cursor;
-    env->rvfi_dii_trace.MEM.rvfi_mem_wdata[1] = pesbt_for_mem;
-    env->rvfi_dii_trace.MEM.rvfi_mem_wdata[2] = tag;
-    env->rvfi_dii_trace.MEM.rvfi_mem_wmask = (1 << CHERI_CAP_SIZE) - 1;
-    // TODO: Add one extra bit to include the tag?
-    env->rvfi_dii_trace.available_fields |= RVFI_MEM_DATA;
-#endif
-#if defined(CONFIG_TCG_LOG_INSTR)
-    /* Log capability memory access as a single access */
-    if (qemu_log_instr_enabled(env)) {
-        /*
-         * Decompress to log all fields
-         * TODO(am2419): see notes on the load path on compression.
-         */
-        cap_register_t stored_cap;
-        const target_ulong pesbt = pesbt_for_mem ^ CAP_NULL_XOR_MASK;
-        CAP_cc(decompress_raw)(pesbt, cursor, tag, &stored_cap);
-        cheri_debug_assert(cursor == cap_get_cursor(&stored_cap));
-        qemu_log_instr_st_cap(env, vaddr, &stored_cap);
+#if CHERI_CAP_CMPXCHG_SUPPORTED
+    if (lock) {
+        qemu_spin_unlock(lock);
     }
 #endif
+    cap_mem_store_done(env, vaddr, pesbt_for_mem, cursor, tag);
 }
 
 void store_cap_to_memory(CPUArchState *env, uint32_t cs, target_ulong vaddr,
@@ -1619,6 +1694,145 @@ void store_cap_to_memory(CPUArchState *env, uint32_t cs, target_ulong vaddr,
                                          cpu_mmu_index(env, false));
 }
 
+#if CHERI_CAP_CMPXCHG_SUPPORTED
+#if TARGET_LONG_BITS == 32
+#define st_cap_word_p stl_p
+#define ld_cap_word_p ldl_p
+#elif TARGET_LONG_BITS == 64
+#define st_cap_word_p stq_p
+#define ld_cap_word_p ldq_p
+#else
+#error "Unhandled target long width"
+#endif
+
+/* Replace the in-memory (pesbt ^ CAP_NULL_XOR_MASK, cursor) pair atomically. */
+static bool cap_data_cmpxchg(void *host, target_ulong old_pesbt_for_mem,
+                             target_ulong old_cursor,
+                             target_ulong new_pesbt_for_mem,
+                             target_ulong new_cursor)
+{
+#if CHERI_CAP_SIZE == 16
+    union {
+        Int128 v;
+        uint8_t b[CHERI_CAP_SIZE];
+    } cmpv, newv, oldv;
+    st_cap_word_p(cmpv.b + CHERI_MEM_OFFSET_METADATA, old_pesbt_for_mem);
+    st_cap_word_p(cmpv.b + CHERI_MEM_OFFSET_CURSOR, old_cursor);
+    st_cap_word_p(newv.b + CHERI_MEM_OFFSET_METADATA, new_pesbt_for_mem);
+    st_cap_word_p(newv.b + CHERI_MEM_OFFSET_CURSOR, new_cursor);
+    oldv.v = atomic16_cmpxchg(host, cmpv.v, newv.v);
+    return int128_eq(oldv.v, cmpv.v);
+#else
+    union {
+        uint64_t v;
+        uint8_t b[CHERI_CAP_SIZE];
+    } cmpv, newv;
+    st_cap_word_p(cmpv.b + CHERI_MEM_OFFSET_METADATA, old_pesbt_for_mem);
+    st_cap_word_p(cmpv.b + CHERI_MEM_OFFSET_CURSOR, old_cursor);
+    st_cap_word_p(newv.b + CHERI_MEM_OFFSET_METADATA, new_pesbt_for_mem);
+    st_cap_word_p(newv.b + CHERI_MEM_OFFSET_CURSOR, new_cursor);
+    return qatomic_cmpxchg__nocheck((uint64_t *)host, cmpv.v, newv.v) ==
+           cmpv.v;
+#endif
+}
+
+bool cheri_cap_cmpxchg_parallel(CPUArchState *env, uint32_t cb,
+                                const cap_register_t *cbp, target_ulong vaddr,
+                                uint32_t cs, const CheriCapMemValue *expected,
+                                CheriCapMemValue *old, uintptr_t retpc)
+{
+    const int mmu_idx = cpu_mmu_index(env, false);
+    const target_ulong new_cursor = get_capreg_cursor(env, cs);
+    const target_ulong new_pesbt_for_mem =
+        get_capreg_pesbt(env, cs) ^ CAP_NULL_XOR_MASK;
+    const bool new_tag = get_capreg_tag_filtered(env, cs);
+    void *host;
+    bool stored;
+
+    cheri_debug_assert(QEMU_IS_ALIGNED(vaddr, CHERI_CAP_SIZE));
+    /*
+     * Like atomic_mmu_lookup(): lockstep icount orders atomics between
+     * vCPUs in the serial phase.
+     */
+    if (unlikely(env_cpu(env)->icount_parallel)) {
+        cpu_loop_exit_serial(env_cpu(env), retpc);
+    }
+    /*
+     * Take all data and capability store TLB faults before acquiring the
+     * lock. Thereafter the accesses below hit in the TLB and cannot trap,
+     * except for load-capability traps which are handled explicitly.
+     */
+    probe_read(env, vaddr, CHERI_CAP_SIZE, mmu_idx, retpc);
+    host = cheri_tag_probe_store(env, vaddr, cs, new_tag, retpc, mmu_idx);
+    if (unlikely(!host)) {
+        /* Not backed by host RAM (e.g. MMIO): stop the world instead. */
+        cpu_loop_exit_atomic(env_cpu(env), retpc);
+    }
+
+    QemuSpin *lock = cap_atomic_lock_for(host);
+    do {
+        int prot;
+        qemu_spin_lock(lock);
+        target_ulong pesbt_for_mem =
+            ld_cap_word_p((char *)host + CHERI_MEM_OFFSET_METADATA);
+        target_ulong cursor =
+            ld_cap_word_p((char *)host + CHERI_MEM_OFFSET_CURSOR);
+        bool tag = cheri_tag_get(env, vaddr, cb, NULL, &prot, retpc, mmu_idx,
+                                 host);
+        if ((tag && (prot & PAGE_LC_TRAP)) || (prot & PAGE_LC_TRAP_ANY)) {
+            qemu_spin_unlock(lock);
+            raise_load_tag_exception(env, vaddr, cb, retpc);
+        }
+        old->pesbt = pesbt_for_mem ^ CAP_NULL_XOR_MASK;
+        old->cursor = cursor;
+        old->tag =
+            cheri_tag_prot_clear_or_trap(env, vaddr, cb, cbp, prot, retpc, tag);
+        if (old->tag) {
+            squash_mutable_permissions(env, &old->pesbt, cbp);
+        }
+        if (expected && (old->pesbt != expected->pesbt ||
+                         old->cursor != expected->cursor ||
+                         old->tag != expected->tag)) {
+            qemu_spin_unlock(lock);
+            cap_mem_load_done(env, vaddr, old->pesbt, old->cursor, old->tag);
+            return false;
+        }
+        /*
+         * Never expose the new data with a stale tag set: clear the tag
+         * before the data is replaced and only set it afterwards. Racing
+         * capability stores hold the lock, so the data can only have been
+         * changed by a plain store, which clears the tag anyway.
+         */
+        if (!new_tag) {
+            cheri_tag_invalidate_aligned(env, vaddr, retpc, mmu_idx);
+        }
+        stored = cap_data_cmpxchg(host, pesbt_for_mem, cursor,
+                                  new_pesbt_for_mem, new_cursor);
+        if (stored && new_tag) {
+            cheri_tag_set(env, vaddr, cs, NULL, retpc, mmu_idx);
+        }
+        qemu_spin_unlock(lock);
+        /* A racing data store changed the data, start again. */
+    } while (!stored);
+
+    /* Same accounting and tracing as load_cap_from_memory + store_cap */
+    cap_mem_load_done(env, vaddr, old->pesbt, old->cursor, old->tag);
+    cap_mem_store_done(env, vaddr, new_pesbt_for_mem, new_cursor, new_tag);
+    return true;
+}
+#undef st_cap_word_p
+#undef ld_cap_word_p
+#else
+bool cheri_cap_cmpxchg_parallel(CPUArchState *env, uint32_t cb,
+                                const cap_register_t *cbp, target_ulong vaddr,
+                                uint32_t cs, const CheriCapMemValue *expected,
+                                CheriCapMemValue *old, uintptr_t retpc)
+{
+    /* Callers should have raised EXCP_ATOMIC instead. */
+    g_assert_not_reached();
+}
+#endif /* CHERI_CAP_CMPXCHG_SUPPORTED */
+
 target_ulong CHERI_HELPER_IMPL(cloadtags(CPUArchState *env, uint32_t cb))
 {
     static const uint32_t perms = CAP_PERM_LOAD | CAP_PERM_LOAD_CAP;
@@ -1754,6 +1968,13 @@ void CHERI_HELPER_IMPL(debug_cap(CPUArchState *env, uint32_t regndx))
     }
 }
 
+void CHERI_HELPER_IMPL(plugin_capreg_changed(CPUArchState *env,
+                                             const void *reg_name,
+                                             const void *cr))
+{
+    cheri_plugin_changed_capreg(env, reg_name, cr);
+}
+
 void helper_capreg_state_debug(CPUArchState *env, uint32_t regnum,
                                uint64_t flags, uint64_t pc)
 {
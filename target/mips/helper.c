@@ -78,6 +78,157 @@ int fixed_mmu_map_address(CPUMIPSState *env, hwaddr *physical, int *prot,
     return TLBRET_MATCH;
 }
 
+/* 1k pages are not supported. */
+static inline target_ulong r4k_tlb_mask(const r4k_tlb_t *tlb)
+{
+    return tlb->PageMask | ~(TARGET_PAGE_MASK << 1);
+}
+
+/* The bits under MASK are clear in VPN, so VPN | MASK identifies both. */
+static inline unsigned r4k_tlb_hash(target_ulong vpn, target_ulong mask)
+{
+    uint64_t key = (uint64_t)vpn | mask;
+
+    return (key * 0x9e3779b97f4a7c15ull) >> (64 - MIPS_TLB_HASH_BITS);
+}
+
+void r4k_tlb_hash_insert(CPUMIPSState *env, int idx)
+{
+    CPUMIPSTLBContext *ctx = env->tlb;
+    r4k_tlb_t *tlb = &ctx->mmu.r4k.tlb[idx];
+    target_ulong mask = r4k_tlb_mask(tlb);
+    int slot, free_slot = -1;
+    unsigned h;
+
+    g_assert(ctx->mmu.r4k.hash_bucket[idx] == MIPS_TLB_HASH_NONE);
+    if (tlb->EHINV) {
+        return;
+    }
+    for (slot = 0; slot < MIPS_TLB_HASH_MASKS; slot++) {
+        if (ctx->mmu.r4k.hash_mask_refs[slot] == 0) {
+            if (free_slot < 0) {
+                free_slot = slot;
+            }
+        } else if (ctx->mmu.r4k.hash_mask[slot] == mask) {
+            break;
+        }
+    }
+    if (slot == MIPS_TLB_HASH_MASKS) {
+        if (free_slot < 0) {
+            ctx->mmu.r4k.hash_bucket[idx] = MIPS_TLB_HASH_UNINDEXED;
+            ctx->mmu.r4k.hash_unindexed++;
+            return;
+        }
+        slot = free_slot;
+        ctx->mmu.r4k.hash_mask[slot] = mask;
+    }
+    ctx->mmu.r4k.hash_mask_refs[slot]++;
+    ctx->mmu.r4k.hash_mask_slot[idx] = slot;
+
+    h = r4k_tlb_hash(tlb->VPN & ~mask, mask);
+    ctx->mmu.r4k.hash_bucket[idx] = h;
+    ctx->mmu.r4k.hash_next[idx] = ctx->mmu.r4k.hash_head[h];
+    ctx->mmu.r4k.hash_head[h] = idx;
+}
+
+void r4k_tlb_hash_remove(CPUMIPSState *env, int idx)
+{
+    CPUMIPSTLBContext *ctx = env->tlb;
+    int h = ctx->mmu.r4k.hash_bucket[idx];
+    int16_t *p;
+
+    if (h == MIPS_TLB_HASH_NONE) {
+        return;
+    }
+    ctx->mmu.r4k.hash_bucket[idx] = MIPS_TLB_HASH_NONE;
+    if (h == MIPS_TLB_HASH_UNINDEXED) {
+        ctx->mmu.r4k.hash_unindexed--;
+        return;
+    }
+    for (p = &ctx->mmu.r4k.hash_head[h]; *p != idx;
+         p = &ctx->mmu.r4k.hash_next[*p]) {
+        g_assert(*p >= 0);
+    }
+    *p = ctx->mmu.r4k.hash_next[idx];
+    ctx->mmu.r4k.hash_mask_refs[ctx->mmu.r4k.hash_mask_slot[idx]]--;
+}
+
+void r4k_tlb_hash_rebuild(CPUMIPSState *env)
+{
+    CPUMIPSTLBContext *ctx = env->tlb;
+    int i;
+
+    for (i = 0; i < MIPS_TLB_HASH_SIZE; i++) {
+        ctx->mmu.r4k.hash_head[i] = -1;
+    }
+    for (i = 0; i < MIPS_TLB_MAX; i++) {
+        ctx->mmu.r4k.hash_bucket[i] = MIPS_TLB_HASH_NONE;
+    }
+    memset(ctx->mmu.r4k.hash_mask_refs, 0,
+           sizeof(ctx->mmu.r4k.hash_mask_refs));
+    ctx->mmu.r4k.hash_unindexed = 0;
+
+    for (i = 0; i < ctx->tlb_in_use; i++) {
+        r4k_tlb_hash_insert(env, i);
+    }
+}
+
+/*
+ * Return the index of the first TLB entry that maps ADDRESS for MMID, or -1.
+ * As with a linear scan, the lowest index wins if the guest has created
+ * overlapping entries.
+ */
+static int r4k_tlb_lookup(CPUMIPSState *env, target_ulong address,
+                          uint32_t MMID, bool mi)
+{
+    CPUMIPSTLBContext *ctx = env->tlb;
+    int found = -1;
+    int slot, i;
+
+    if (unlikely(ctx->mmu.r4k.hash_unindexed)) {
+        for (i = 0; i < ctx->tlb_in_use; i++) {
+            r4k_tlb_t *tlb = &ctx->mmu.r4k.tlb[i];
+            target_ulong mask = r4k_tlb_mask(tlb);
+            target_ulong tag = address & ~mask;
+#if defined(TARGET_MIPS64)
+            tag &= env->SEGMask;
+#endif
+            uint32_t tlb_mmid = mi ? tlb->MMID : (uint32_t) tlb->ASID;
+
+            if ((tlb->G == 1 || tlb_mmid == MMID) &&
+                (tlb->VPN & ~mask) == tag && !tlb->EHINV) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    for (slot = 0; slot < MIPS_TLB_HASH_MASKS; slot++) {
+        target_ulong mask = ctx->mmu.r4k.hash_mask[slot];
+        target_ulong tag = address & ~mask;
+
+        if (ctx->mmu.r4k.hash_mask_refs[slot] == 0) {
+            continue;
+        }
+#if defined(TARGET_MIPS64)
+        tag &= env->SEGMask;
+#endif
+        for (i = ctx->mmu.r4k.hash_head[r4k_tlb_hash(tag, mask)]; i >= 0;
+             i = ctx->mmu.r4k.hash_next[i]) {
+            r4k_tlb_t *tlb = &ctx->mmu.r4k.tlb[i];
+            uint32_t tlb_mmid = mi ? tlb->MMID : (uint32_t) tlb->ASID;
+
+            if ((found < 0 || i < found) &&
+                (tlb->G == 1 || tlb_mmid == MMID) &&
+                (tlb->VPN & ~mask) == tag && r4k_tlb_mask(tlb) == mask &&
+                !tlb->EHINV) {
+                found = i;
+            }
+        }
+    }
+    return found;
+}
+
 /* MIPS32/MIPS64 R4000-style MMU emulation */
 int r4k_map_address(CPUMIPSState *env, hwaddr *physical, int *prot,
                     target_ulong address, int rw, int access_type)
@@ -85,8 +236,9 @@ int r4k_map_address(CPUMIPSState *env, hwaddr *physical, int *prot,
     uint16_t ASID = env->CP0_EntryHi & env->CP0_EntryHi_ASID_mask;
     uint32_t MMID = env->CP0_MemoryMapID;
     bool mi = !!((env->CP0_Config5 >> CP0C5_MI) & 1);
-    uint32_t tlb_mmid;
-    int i;
+    r4k_tlb_t *tlb;
+    target_ulong mask;
+    int i, n;
 
     MMID = mi ? MMID : (uint32_t) ASID;
 
@@ -111,87 +263,79 @@ int r4k_map_address(CPUMIPSState *env, hwaddr *physical, int *prot,
     bool gclg = !!(env->CP0_EntryHi & (1UL << gclg_bit));
 #endif
 
-    for (i = 0; i < env->tlb->tlb_in_use; i++) {
-        r4k_tlb_t *tlb = &env->tlb->mmu.r4k.tlb[i];
-        /* 1k pages are not supported. */
-        target_ulong mask = tlb->PageMask | ~(TARGET_PAGE_MASK << 1);
-        target_ulong tag = address & ~mask;
-        target_ulong VPN = tlb->VPN & ~mask;
-#if defined(TARGET_MIPS64)
-        tag &= env->SEGMask;
-#endif
+    /* Check ASID/MMID, virtual page number & size */
+    i = r4k_tlb_lookup(env, address, MMID, mi);
+    if (i < 0) {
+        return TLBRET_NOMATCH;
+    }
 
-        /* Check ASID/MMID, virtual page number & size */
-        tlb_mmid = mi ? tlb->MMID : (uint32_t) tlb->ASID;
-        if ((tlb->G == 1 || tlb_mmid == MMID) && VPN == tag && !tlb->EHINV) {
-            /* TLB match */
-            int n = !!(address & mask & ~(mask >> 1));
-            /* Check access rights */
-            if (!(n ? tlb->V1 : tlb->V0)) {
-                return TLBRET_INVALID;
-            }
+    /* TLB match */
+    tlb = &env->tlb->mmu.r4k.tlb[i];
+    mask = r4k_tlb_mask(tlb);
+    n = !!(address & mask & ~(mask >> 1));
+    /* Check access rights */
+    if (!(n ? tlb->V1 : tlb->V0)) {
+        return TLBRET_INVALID;
+    }
 #if defined(TARGET_CHERI)
-            if (rw == MMU_DATA_CAP_STORE) {
-                /*
-                 * If we're trying to do a cap-store, first check for the
-                 * dirty/store-permitted bit before looking at the the
-                 * store-capability inhibit.
-                 */
-                if (!(n ? tlb->D1 : tlb->D0)) {
-                    return TLBRET_DIRTY;
-                }
-                if (n ? tlb->S1 : tlb->S0) {
-                    return TLBRET_S;
-                }
-            }
+    if (rw == MMU_DATA_CAP_STORE) {
+        /*
+         * If we're trying to do a cap-store, first check for the
+         * dirty/store-permitted bit before looking at the the
+         * store-capability inhibit.
+         */
+        if (!(n ? tlb->D1 : tlb->D0)) {
+            return TLBRET_DIRTY;
+        }
+        if (n ? tlb->S1 : tlb->S0) {
+            return TLBRET_S;
+        }
+    }
 
-            if (n ? tlb->S1 : tlb->S0) {
-                *prot |= PAGE_SC_TRAP;
-            }
+    if (n ? tlb->S1 : tlb->S0) {
+        *prot |= PAGE_SC_TRAP;
+    }
 #else
-            if (rw == MMU_INST_FETCH && (n ? tlb->XI1 : tlb->XI0)) {
-                return TLBRET_XI;
-            }
-            if (rw == MMU_DATA_LOAD && (n ? tlb->RI1 : tlb->RI0)) {
-                return TLBRET_RI;
-            }
+    if (rw == MMU_INST_FETCH && (n ? tlb->XI1 : tlb->XI0)) {
+        return TLBRET_XI;
+    }
+    if (rw == MMU_DATA_LOAD && (n ? tlb->RI1 : tlb->RI0)) {
+        return TLBRET_RI;
+    }
 #endif /* TARGET_CHERI */
 
-            if (( (rw != MMU_DATA_STORE)
+    if (( (rw != MMU_DATA_STORE)
 #if defined(TARGET_CHERI)
-                  && (rw != MMU_DATA_CAP_STORE)
+          && (rw != MMU_DATA_CAP_STORE)
 #endif
-                ) || (n ? tlb->D1 : tlb->D0)) {
+        ) || (n ? tlb->D1 : tlb->D0)) {
 
-                *physical = tlb->PFN[n] | (address & (mask >> 1));
-                *prot = PAGE_READ;
-                if (n ? tlb->D1 : tlb->D0) {
-                    *prot |= PAGE_WRITE;
-                }
+        *physical = tlb->PFN[n] | (address & (mask >> 1));
+        *prot = PAGE_READ;
+        if (n ? tlb->D1 : tlb->D0) {
+            *prot |= PAGE_WRITE;
+        }
 #if !defined(TARGET_CHERI)
-                if (!(n ? tlb->XI1 : tlb->XI0)) {
+        if (!(n ? tlb->XI1 : tlb->XI0)) {
 #else
-                if (true) {
+        if (true) {
 #endif
-                    *prot |= PAGE_EXEC;
-                }
+            *prot |= PAGE_EXEC;
+        }
 
 #if defined(TARGET_CHERI)
-                if (n ? tlb->L1 : tlb->L0) {
-                    *prot |= PAGE_LC_CLEAR;
-                }
-                bool pclg = n ? tlb->CLG1 : tlb->CLG0;
-                if (pclg != gclg) {
-                    *prot |= PAGE_LC_TRAP;
-                }
+        if (n ? tlb->L1 : tlb->L0) {
+            *prot |= PAGE_LC_CLEAR;
+        }
+        bool pclg = n ? tlb->CLG1 : tlb->CLG0;
+        if (pclg != gclg) {
+            *prot |= PAGE_LC_TRAP;
+        }
 #endif
 
-                return TLBRET_MATCH;
-            }
-            return TLBRET_DIRTY;
-        }
+        return TLBRET_MATCH;
     }
-    return TLBRET_NOMATCH;
+    return TLBRET_DIRTY;
 }
 
 static int is_seg_am_mapped(unsigned int am, bool eu, int mmu_idx)
@@ -437,6 +581,7 @@ void cpu_mips_tlb_flush(CPUMIPSState *env)
     /* Flush qemu's TLB and discard all shadowed entries.  */
     tlb_flush(env_cpu(env));
     env->tlb->tlb_in_use = env->tlb->nb_tlb;
+    r4k_tlb_hash_rebuild(env);
 }
 
 /* Called for updates to CP0_Status.  */
@@ -1688,7 +1833,7 @@ void r4k_invalidate_tlb(CPUMIPSState *env, int idx, int use_extra)
          * tell that it's there.
          */
         env->tlb->mmu.r4k.tlb[env->tlb->tlb_in_use] = *tlb;
-        env->tlb->tlb_in_use++;
+        r4k_tlb_hash_insert(env, env->tlb->tlb_in_use++);
         return;
     }
 
@@ -133,6 +133,19 @@ struct r4k_tlb_t {
     uint64_t PFN[2];
 };
 
+/*
+ * r4k_map_address() looks up the guest TLB through a hash index keyed by
+ * the VPN2 and page mask of each valid entry.  Entries of each distinct page
+ * size present in the TLB are found with one probe; if more than
+ * MIPS_TLB_HASH_MASKS page sizes are in use the remaining entries are not
+ * indexed and lookups fall back to a linear scan.
+ */
+#define MIPS_TLB_HASH_BITS 8
+#define MIPS_TLB_HASH_SIZE (1 << MIPS_TLB_HASH_BITS)
+#define MIPS_TLB_HASH_MASKS 8
+#define MIPS_TLB_HASH_NONE (-1)
+#define MIPS_TLB_HASH_UNINDEXED (-2)
+
 struct CPUMIPSTLBContext {
     uint32_t nb_tlb;
     uint32_t tlb_in_use;
@@ -147,6 +160,14 @@ struct CPUMIPSTLBContext {
     union {
         struct {
             r4k_tlb_t tlb[MIPS_TLB_MAX];
+            /* Hash index over tlb[0, tlb_in_use) */
+            int16_t hash_head[MIPS_TLB_HASH_SIZE];
+            int16_t hash_next[MIPS_TLB_MAX];
+            int16_t hash_bucket[MIPS_TLB_MAX];
+            int8_t hash_mask_slot[MIPS_TLB_MAX];
+            target_ulong hash_mask[MIPS_TLB_HASH_MASKS];
+            uint16_t hash_mask_refs[MIPS_TLB_HASH_MASKS];
+            uint16_t hash_unindexed;
         } r4k;
     } mmu;
 };
@@ -164,6 +185,9 @@ void r4k_helper_tlbr(CPUMIPSState *env);
 void r4k_helper_tlbinv(CPUMIPSState *env);
 void r4k_helper_tlbinvf(CPUMIPSState *env);
 void r4k_invalidate_tlb(CPUMIPSState *env, int idx, int use_extra);
+void r4k_tlb_hash_insert(CPUMIPSState *env, int idx);
+void r4k_tlb_hash_remove(CPUMIPSState *env, int idx);
+void r4k_tlb_hash_rebuild(CPUMIPSState *env);
 bool r4k_lookup_tlb(CPUMIPSState *env, int *matching, bool use_extra);
 uint32_t cpu_mips_get_random(CPUMIPSState *env);
 
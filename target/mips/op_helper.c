@@ -23,6 +23,7 @@
 #include "cpu.h"
 #include "internal.h"
 #include "qemu/host-utils.h"
+#include "qemu/range.h"
 #include "qemu/error-report.h"
 #include "exec/helper-proto.h"
 #include "exec/exec-all.h"
@@ -679,7 +680,10 @@ static void r4k_mips_tlb_flush_extra(CPUMIPSState *env, int first)
 {
     /* Discard entries from env->tlb[first] onwards.  */
     while (env->tlb->tlb_in_use > first) {
-        r4k_invalidate_tlb(env, --env->tlb->tlb_in_use, 0);
+        int idx = --env->tlb->tlb_in_use;
+
+        r4k_tlb_hash_remove(env, idx);
+        r4k_invalidate_tlb(env, idx, 0);
     }
 }
 
@@ -700,6 +704,7 @@ static void r4k_fill_tlb(CPUMIPSState *env, int idx)
 
     /* XXX: detect conflicting TLBs and raise a MCHECK exception when needed */
     tlb = &env->tlb->mmu.r4k.tlb[idx];
+    r4k_tlb_hash_remove(env, idx);
     if (env->CP0_EntryHi & (1 << CP0EnHi_EHINV)) {
         tlb->EHINV = 1;
         return;
@@ -737,6 +742,7 @@ static void r4k_fill_tlb(CPUMIPSState *env, int idx)
     tlb->RI1 = (env->CP0_EntryLo1 >> CP0EnLo_RI) & 1;
 #endif /* TARGET_CHERI */
     tlb->PFN[1] = (get_tlb_pfn_from_entrylo(env->CP0_EntryLo1) & ~mask) << 12;
+    r4k_tlb_hash_insert(env, idx);
 }
 
 void r4k_helper_tlbinv(CPUMIPSState *env)
@@ -1848,6 +1854,9 @@ static struct nop_stats magic_memset_zero_bytes;
 static struct nop_stats magic_memset_nonzero_bytes;
 
 static struct nop_stats magic_memcpy_bytes;
+#ifdef TARGET_CHERI
+static struct nop_stats magic_memcpy_c_bytes;
+#endif
 static struct nop_stats magic_memmove_bytes;
 static struct nop_stats magic_bcopy_bytes;
 
@@ -1864,6 +1873,9 @@ static void dump_memset_stats_on_exit(void) {
     print_nop_stats("memset (zero)    with magic nop", &magic_memset_zero_bytes);
     print_nop_stats("memset (nonzero) with magic nop", &magic_memset_nonzero_bytes);
     print_nop_stats("memcpy with magic nop", &magic_memcpy_bytes);
+#ifdef TARGET_CHERI
+    print_nop_stats("memcpy_c with magic nop", &magic_memcpy_c_bytes);
+#endif
     print_nop_stats("memmove with magic nop", &magic_memmove_bytes);
     print_nop_stats("bcopy with magic nop", &magic_bcopy_bytes);
     print_nop_stats("memmove/memcpy/bcopy slowpath", &magic_memmove_slowpath);
@@ -2092,6 +2104,87 @@ success:
     return true;
 }
 
+#ifdef TARGET_CHERI
+/*
+ * Not handled here: undo any continuation state so that the guest sees
+ * neither success nor a partial copy and runs its software loop.
+ */
+static bool magic_memcpy_c_fallback(CPUMIPSState *env)
+{
+    env->active_tc.gpr[MIPS_REGNUM_V0] = 0;
+    env->active_tc.gpr[MIPS_REGNUM_V1] &= UINT32_MAX;
+    return false;
+}
+
+/*
+ * Capability-preserving memcpy for purecap code: $c3 = dest, $c4 = src,
+ * $a0 = len. Data and tags are copied a page at a time directly on the host
+ * instead of running a long CLC/CSC loop. Only mutually capability-aligned,
+ * non-overlapping buffers are handled here; for everything else we return
+ * false and the guest falls back to its software implementation.
+ * Note: $v0 holds the number of bytes already copied for continuations.
+ */
+static bool do_magic_memcpy_c(CPUMIPSState *env, uintptr_t ra)
+{
+    const cap_register_t *dest_cap = get_readonly_capreg(env, 3);
+    const cap_register_t *src_cap = get_readonly_capreg(env, 4);
+    const target_ulong dest = cap_get_cursor(dest_cap);
+    const target_ulong src = cap_get_cursor(src_cap);
+    const target_ulong len = env->active_tc.gpr[MIPS_REGNUM_A0];
+    int mmu_idx = cpu_mmu_index(env, false);
+    target_ulong already_written = 0;
+    const bool is_continuation = (env->active_tc.gpr[MIPS_REGNUM_V1] >> 32) == MAGIC_LIBCALL_HELPER_CONTINUATION_FLAG;
+    if (is_continuation) {
+        already_written = env->active_tc.gpr[MIPS_REGNUM_V0];
+        tcg_debug_assert(already_written < len);
+    } else if (env->active_tc.gpr[MIPS_REGNUM_V0] != 0) {
+        error_report("ERROR: Attempted to call memcpy_c library function "
+                     "with non-zero value in $v0 (0x" TARGET_FMT_lx
+                     ") and continuation flag not set in $v1 (0x" TARGET_FMT_lx
+                     ")!\n", env->active_tc.gpr[MIPS_REGNUM_V0], env->active_tc.gpr[MIPS_REGNUM_V1]);
+        do_raise_exception(env, EXCP_RI, ra);
+    }
+    if (len == 0) {
+        goto success; // nothing to do
+    }
+    // The instruction log should still show every load and store.
+    if (qemu_log_instr_enabled(env)) {
+        return magic_memcpy_c_fallback(env);
+    }
+    if (!QEMU_IS_ALIGNED(dest, CHERI_CAP_SIZE) ||
+        !QEMU_IS_ALIGNED(src, CHERI_CAP_SIZE) || len > UINT32_MAX ||
+        ranges_overlap(dest, len, src, len)) {
+        return magic_memcpy_c_fallback(env);
+    }
+    // Check capability bounds for the whole copy before starting.
+    check_cap(env, src_cap, CAP_PERM_LOAD, src, 4, len, /*instavail=*/true, ra);
+    check_cap(env, dest_cap, CAP_PERM_STORE, dest, 3, len, /*instavail=*/true, ra);
+    const bool load_tags = cap_has_perms(src_cap, CAP_PERM_LOAD_CAP);
+    const bool store_tags =
+        cap_has_perms(dest_cap, CAP_PERM_STORE_CAP | CAP_PERM_STORE_LOCAL);
+
+    while (already_written < len) {
+        // Mark this as a continuation in case we get a TLB miss and longjump out
+        env->active_tc.gpr[MIPS_REGNUM_V0] = already_written;
+        env->active_tc.gpr[MIPS_REGNUM_V1] = (MAGIC_LIBCALL_HELPER_CONTINUATION_FLAG << 32) | env->active_tc.gpr[MIPS_REGNUM_V1];
+        target_ulong cur_dest = dest + already_written;
+        target_ulong cur_src = src + already_written;
+        target_ulong chunk = adj_len_to_page(len - already_written, cur_dest);
+        chunk = MIN(chunk, adj_len_to_page(len - already_written, cur_src));
+        if (!cheri_tag_copy_in_page(env, cur_dest, cur_src, chunk, load_tags,
+                                    store_tags, 3, ra, mmu_idx)) {
+            // I/O memory or a tag exception: restart in software
+            return magic_memcpy_c_fallback(env);
+        }
+        already_written += chunk;
+    }
+    env->lladdr = 1;
+success:
+    env->active_tc.gpr[MIPS_REGNUM_V0] = 0;
+    return true;
+}
+#endif
+
 static void do_memset_pattern_hostaddr(void* hostaddr, uint64_t value, uint64_t nitems, unsigned pattern_length, uint64_t ra) {
     if (pattern_length == 1) {
         memset(hostaddr, value, nitems);
@@ -2431,6 +2524,15 @@ void helper_magic_library_function(CPUMIPSState *env, target_ulong which)
         collect_magic_nop_stats(env, &magic_memmove_bytes, env->active_tc.gpr[MIPS_REGNUM_A2]);
         break;
 
+#ifdef TARGET_CHERI
+    case MAGIC_NOP_MEMCPY_C:
+        // Unsupported copies are left to the guest's software loop
+        if (!do_magic_memcpy_c(env, GETPC()))
+            return;
+        collect_magic_nop_stats(env, &magic_memcpy_c_bytes, env->active_tc.gpr[MIPS_REGNUM_A0]);
+        break;
+#endif
+
     case MAGIC_NOP_BCOPY: // src + dest arguments swapped
         if (!do_magic_memmove(env, GETPC(), MIPS_REGNUM_A1, MIPS_REGNUM_A0))
             goto error;
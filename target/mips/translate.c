@@ -2754,6 +2754,22 @@ static TCGv mxu_gpr[NUMBER_OF_MXU_REGISTERS - 1];
 static TCGv mxu_CR;
 #endif
 
+#ifdef TARGET_CHERI
+/*
+ * Cursors of the lazy capability registers. The remaining fields are only
+ * accessed via env, so the globals must be synced/discarded around any TCG
+ * ops that access the whole register in env (see gen_cap_sync_cursor()).
+ * $c0 is the NULL register and has no global.
+ */
+static TCGv cpu_capreg_cursors[32];
+
+static inline TCGv mips_capreg_cursor_global(int reg)
+{
+    tcg_debug_assert(reg > 0 && reg < 32);
+    return cpu_capreg_cursors[reg];
+}
+#endif
+
 #include "exec/gen-icount.h"
 
 #define gen_helper_0e0i(name, arg) do {                           \
@@ -32767,6 +32783,14 @@ void mips_tcg_init(void)
     }
 
 #ifdef TARGET_CHERI
+    cpu_capreg_cursors[0] = NULL;
+    for (i = 1; i < 32; i++) {
+        cpu_capreg_cursors[i] = tcg_global_mem_new(
+            cpu_env,
+            offsetof(CPUMIPSState,
+                     active_tc.gpcapregs.decompressed[i].cap._cr_cursor),
+            cheri_gp_regnames[i]);
+    }
     cpu_PC = tcg_global_mem_new(cpu_env,
                                 offsetof(CPUMIPSState, active_tc.PCC._cr_cursor), "PC");
     /// XXXAR: We currently interpose using DDC.cursor and not DDC.base!
@@ -33007,6 +33031,9 @@ void cpu_state_reset(CPUMIPSState *env)
 #endif
     env->CP0_Random = env->tlb->nb_tlb - 1;
     env->tlb->tlb_in_use = env->tlb->nb_tlb;
+    if (env->tlb->map_address == &r4k_map_address) {
+        r4k_tlb_hash_rebuild(env);
+    }
     env->CP0_Wired = 0;
     env->CP0_GlobalNumber = (cs->cpu_index & 0xFF) << CP0GN_VPId;
     env->CP0_EBase = (cs->cpu_index & 0x3FF);
@@ -290,6 +290,18 @@ static inline void generate_cheri_cget(DisasContext *ctx, int rd, int cs,
     tcg_temp_free_i32(tcs);
 }
 
+static inline void generate_cgetaddr(DisasContext *ctx, int rd, int cb)
+{
+    check_cop2x(ctx);
+    TCGv t0 = tcg_temp_new();
+
+    /* The cursor is a TCG global, so this doesn't need a helper call. */
+    gen_cap_get_cursor(ctx, cb, t0);
+    gen_store_gpr(t0, rd);
+
+    tcg_temp_free(t0);
+}
+
 static inline void generate_cloadtags(DisasContext *ctx, int32_t rd, int32_t cb)
 {
     TCGv_i32 tcb = tcg_const_i32(cb);
@@ -1316,7 +1328,7 @@ static void gen_cp2 (DisasContext *ctx, uint32_t opc, int r16, int r11, int r6)
                 opn = "cwritehwr";
                 break;
             case OPC_CGETADDR_NI:   /* 0x0f << 6 */
-                generate_cheri_cget(ctx, r16, r11, &gen_helper_cgetaddr);
+                generate_cgetaddr(ctx, r16, r11);
                 opn = "cgetaddr";
                 break;
             case OPC_CRAP_NI:   /* 0x10 << 6 */
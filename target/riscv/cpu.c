@@ -681,6 +681,7 @@ static void riscv_cpu_reset(DeviceState *dev)
     env->priv = PRV_M;
     env->mstatus &= ~(MSTATUS_MIE | MSTATUS_MPRV);
     env->mcause = 0;
+    riscv_pwc_flush(env);
 #if defined(TARGET_RISCV64)
     target_ulong mxl = get_field(env->misa, MISA_MXL);
     env->mstatus = set_field(env->mstatus, MSTATUS64_SXL, mxl);
@@ -107,6 +107,22 @@ typedef struct CPURISCVState CPURISCVState;
 
 #define RV_VLEN_MAX 256
 
+/*
+ * Page-walk cache: the physical address of the next-level table for the
+ * upper levels of recent satp page-table walks, so that a TLB miss can skip
+ * the PTE loads of those levels.  Entries are tagged with satp; as the
+ * privileged spec permits, they may be stale until the next sfence.vma.
+ * Entry [n - 1][*] caches the table reached after n levels.
+ */
+#define RISCV_PWC_LEVELS 4
+#define RISCV_PWC_ENTRIES 8
+
+typedef struct RISCVPWCEntry {
+    target_ulong satp;      /* 0 if the entry is unused */
+    target_ulong vpn;       /* address bits translated by the cached levels */
+    hwaddr base;
+} RISCVPWCEntry;
+
 FIELD(VTYPE, VLMUL, 0, 2)
 FIELD(VTYPE, VSEW, 2, 3)
 FIELD(VTYPE, VEDIV, 5, 2)
@@ -284,6 +300,12 @@ struct CPURISCVState {
     /* physical memory protection */
     pmp_table_t pmp_state;
 
+    /* page-walk cache, see get_physical_address() */
+    RISCVPWCEntry pwc[RISCV_PWC_LEVELS][RISCV_PWC_ENTRIES];
+    uint64_t pwc_walks;
+    uint64_t pwc_hits;
+    uint64_t pwc_pte_loads;
+
     /* True if in debugger mode.  */
     bool debugger;
 #endif
@@ -452,13 +474,14 @@ extern const char * const riscv_intr_names[];
 extern const char * const cheri_gp_regnames[];
 #endif
 
-#ifdef CONFIG_TCG_LOG_INSTR
-void riscv_log_instr_csr_changed(CPURISCVState *env, int csrno);
-
 #ifdef TARGET_CHERI
+/* Also reports the new value to plugins, so it is not only for logging */
 void riscv_log_instr_scr_changed(CPURISCVState *env, int scrno);
 #endif
 
+#ifdef CONFIG_TCG_LOG_INSTR
+void riscv_log_instr_csr_changed(CPURISCVState *env, int csrno);
+
 #define log_changed_special_reg(env, name, newval) do { \
         if (qemu_log_instr_enabled(env))                \
             qemu_log_instr_reg(env, name, newval);      \
@@ -466,7 +489,6 @@ void riscv_log_instr_scr_changed(CPURISCVState *env, int scrno);
 #else /* !CONFIG_TCG_LOG_INSTR */
 #define log_changed_special_reg(env, name, newval) ((void)0)
 #define riscv_log_instr_csr_changed(env, csrno) ((void)0)
-#define riscv_log_instr_scr_changed(env, scrno) ((void)0)
 #endif /* !CONFIG_TCG_LOG_INSTR */
 
 
@@ -620,6 +642,7 @@ uint32_t riscv_cpu_update_mip(RISCVCPU *cpu, uint32_t mask, uint32_t value);
 #define BOOL_TO_MASK(x) (-!!(x)) /* helper for riscv_cpu_update_mip value */
 void riscv_cpu_set_rdtime_fn(CPURISCVState *env, uint64_t (*fn)(uint32_t),
                              uint32_t arg);
+void riscv_pwc_flush(CPURISCVState *env);
 #endif
 void riscv_cpu_set_mode(CPURISCVState *env, target_ulong newpriv);
 
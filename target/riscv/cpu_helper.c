@@ -43,14 +43,13 @@
     } while (false)
 #endif
 
-#ifdef CONFIG_TCG_LOG_INSTR
 #ifdef TARGET_CHERI
+/* Plugins see SCR updates even without instruction logging */
 #define LOG_SPECIAL_REG(env, csrno, scrno)      \
     riscv_log_instr_scr_changed(env, scrno)
-#else
+#elif defined(CONFIG_TCG_LOG_INSTR)
 #define LOG_SPECIAL_REG(env, csrno, scrno)      \
     riscv_log_instr_csr_changed(env, csrno);
-#endif
 #else /* !CONFIG_TCG_LOG_INSTR */
 #define LOG_SPECIAL_REG(env, csrno, scrno) ((void)0)
 #endif /* !CONFIG_TCG_LOG_INSTR */
@@ -373,6 +372,50 @@ extern bool rvfi_debug_output;
 #define RISCV_PTE_TRAPPY 0
 #endif
 
+void riscv_pwc_flush(CPURISCVState *env)
+{
+    memset(env->pwc, 0, sizeof(env->pwc));
+}
+
+/* The address bits translated by the first @n of @levels levels. */
+static inline target_ulong riscv_pwc_vpn(target_ulong addr, int levels,
+                                         int ptidxbits, int n)
+{
+    return addr >> (PGSHIFT + (levels - n) * ptidxbits);
+}
+
+/*
+ * Find the deepest cached table for @addr. Returns the number of levels
+ * that can be skipped, with *@base set to the table to continue from.
+ */
+static int riscv_pwc_lookup(CPURISCVState *env, target_ulong addr,
+                            int levels, int ptidxbits, hwaddr *base)
+{
+    int n;
+
+    for (n = MIN(levels - 1, RISCV_PWC_LEVELS); n > 0; n--) {
+        target_ulong vpn = riscv_pwc_vpn(addr, levels, ptidxbits, n);
+        RISCVPWCEntry *e = &env->pwc[n - 1][vpn % RISCV_PWC_ENTRIES];
+
+        if (e->satp == env->satp && e->vpn == vpn) {
+            *base = e->base;
+            return n;
+        }
+    }
+    return 0;
+}
+
+static void riscv_pwc_insert(CPURISCVState *env, target_ulong addr,
+                             int levels, int ptidxbits, int n, hwaddr base)
+{
+    target_ulong vpn = riscv_pwc_vpn(addr, levels, ptidxbits, n);
+    RISCVPWCEntry *e = &env->pwc[n - 1][vpn % RISCV_PWC_ENTRIES];
+
+    e->satp = env->satp;
+    e->vpn = vpn;
+    e->base = base;
+}
+
 /* get_physical_address - get the physical address for this virtual address
  *
  * Do a page table walk to obtain the physical address corresponding to a
@@ -522,13 +565,30 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
         return TRANSLATE_FAIL;
     }
 
-    int ptshift = (levels - 1) * ptidxbits;
+    /*
+     * Only plain satp walks go through the page-walk cache; it is not
+     * tagged with the guest-physical or background translation state.
+     */
+    bool use_pwc = first_stage && !two_stage && !use_background &&
+                   !riscv_cpu_virt_enabled(env) && levels > 1;
+    hwaddr root = base;
+    bool pwc_hit = false;
+    int ptshift;
     int i;
 
+    env->pwc_walks++;
 #if !TCG_OVERSIZED_GUEST
 restart:
 #endif
-    for (i = 0; i < levels; i++, ptshift -= ptidxbits) {
+    base = root;
+    i = use_pwc ? riscv_pwc_lookup(env, addr, levels, ptidxbits, &base) : 0;
+    /* A restarted walk is still one walk: count at most one hit for it */
+    if (i && !pwc_hit) {
+        pwc_hit = true;
+        env->pwc_hits++;
+    }
+    for (ptshift = (levels - 1 - i) * ptidxbits; i < levels;
+         i++, ptshift -= ptidxbits) {
         target_ulong idx;
         if (i == 0) {
             idx = (addr >> (PGSHIFT + ptshift)) &
@@ -564,10 +624,11 @@ restart:
 
         if (riscv_feature(env, RISCV_FEATURE_PMP) &&
             !pmp_hart_has_privs(env, pte_addr, sizeof(target_ulong),
-            1 << MMU_DATA_LOAD, PRV_S)) {
+            1 << MMU_DATA_LOAD, NULL, PRV_S)) {
             return TRANSLATE_PMP_FAIL;
         }
 
+        env->pwc_pte_loads++;
 #if defined(TARGET_RISCV32)
         target_ulong pte = address_space_ldl(cs->as, pte_addr, attrs, &res);
 #elif defined(TARGET_RISCV64)
@@ -600,6 +661,9 @@ restart:
         } else if (!(pte & (PTE_R | PTE_W | PTE_X))) {
             /* Inner PTE, continue walking */
             base = ppn << PGSHIFT;
+            if (use_pwc && i < RISCV_PWC_LEVELS && i + 1 < levels) {
+                riscv_pwc_insert(env, addr, levels, ptidxbits, i + 1, base);
+            }
         } else if ((pte & (PTE_R | PTE_W | PTE_X)) == PTE_W) {
             /* Reserved leaf PTE flags: PTE_W */
             qemu_log_mask(CPU_LOG_MMU, "%s Translate fail: Reserved WRX 100\n",
@@ -963,6 +1027,7 @@ static int riscv_cpu_tlb_fill_impl(CPURISCVState *env, vaddr address, int size,
     int prot2;
     int ret = TRANSLATE_FAIL;
     int mode = mmu_idx;
+    pmp_priv_t pmp_privs;
 
     env->guest_phys_fault_addr = 0;
 
@@ -1054,7 +1119,7 @@ static int riscv_cpu_tlb_fill_impl(CPURISCVState *env, vaddr address, int size,
                 (ret == TRANSLATE_SUCCESS) &&
                 !pmp_hart_has_privs(env, *pa, size,
                                     access_type_to_pmp_priv(access_type),
-                                    mode)) {
+                                    &pmp_privs, mode)) {
                 ret = TRANSLATE_PMP_FAIL;
             }
 
@@ -1082,10 +1147,19 @@ static int riscv_cpu_tlb_fill_impl(CPURISCVState *env, vaddr address, int size,
     }
 
     if (riscv_feature(env, RISCV_FEATURE_PMP) &&
-        (ret == TRANSLATE_SUCCESS) &&
-        !pmp_hart_has_privs(env, *pa, size,
-                            access_type_to_pmp_priv(access_type), mode)) {
-        ret = TRANSLATE_PMP_FAIL;
+        (ret == TRANSLATE_SUCCESS)) {
+        if (!pmp_hart_has_privs(env, *pa, size,
+                                access_type_to_pmp_priv(access_type),
+                                &pmp_privs, mode)) {
+            ret = TRANSLATE_PMP_FAIL;
+        } else {
+            /*
+             * The TLB entry may be reused for other access types; only
+             * grant what PMP allows for the whole page or region.
+             */
+            *prot &= ~(PAGE_READ | PAGE_WRITE | PAGE_EXEC) |
+                     pmp_priv_to_page_prot(pmp_privs);
+        }
     }
     if (ret == TRANSLATE_PMP_FAIL) {
         *pmp_violation = true;
@@ -486,6 +486,27 @@ static int validate_vm(CPURISCVState *env, target_ulong vm)
     return valid_vm_1_10[vm & 0xf];
 }
 
+/*
+ * The MMU indexes whose translations depend on the mstatus fields in
+ * @changed, without the hypervisor extension. MXR and SUM only matter
+ * to U- and S-mode, and to M-mode loads and stores while MPRV is set.
+ */
+static uint16_t mstatus_vm_mmuidx(uint64_t changed, uint64_t mprv)
+{
+    uint16_t idxmap = 0;
+
+    if (changed & MSTATUS_MXR) {
+        idxmap |= 1 << PRV_U;
+    }
+    if (changed & (MSTATUS_MXR | MSTATUS_SUM)) {
+        idxmap |= 1 << PRV_S;
+    }
+    if ((changed & (MSTATUS_MPRV | MSTATUS_MPP)) || (idxmap && mprv)) {
+        idxmap |= 1 << PRV_M;
+    }
+    return idxmap;
+}
+
 static int write_mstatus(CPURISCVState *env, int csrno, target_ulong val)
 {
     uint64_t mstatus = env->mstatus;
@@ -495,7 +516,16 @@ static int write_mstatus(CPURISCVState *env, int csrno, target_ulong val)
     /* flush tlb on mstatus fields that affect VM */
     if ((val ^ mstatus) & (MSTATUS_MXR | MSTATUS_MPP | MSTATUS_MPV |
             MSTATUS_MPRV | MSTATUS_SUM)) {
-        tlb_flush(env_cpu(env));
+        if (riscv_has_ext(env, RVH)) {
+            /* Two-stage lookups also depend on vsstatus */
+            tlb_flush(env_cpu(env));
+        } else {
+            /* Linux toggles SUM around every user access */
+            tlb_flush_by_mmuidx(env_cpu(env),
+                                mstatus_vm_mmuidx(val ^ mstatus,
+                                                  (val | mstatus) &
+                                                  MSTATUS_MPRV));
+        }
     }
     mask = MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_MIE | MSTATUS_MPIE |
         MSTATUS_SPP | MSTATUS_FS | MSTATUS_MPRV | MSTATUS_SUM |
@@ -947,7 +977,8 @@ static int write_satp(CPURISCVState *env, int csrno, target_ulong val)
             return -RISCV_EXCP_ILLEGAL_INST;
         } else {
             if ((val ^ env->satp) & SATP_ASID) {
-                tlb_flush(env_cpu(env));
+                /* Keep the entries of the outgoing ASID for later. */
+                tlb_switch_asid(env_cpu(env), get_field(val, SATP_ASID));
             }
             env->satp = val;
         }
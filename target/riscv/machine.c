@@ -141,10 +141,19 @@ static const VMStateDescription vmstate_hyper = {
 #ifdef TARGET_CHERI
 #pragma message("TODO: VMSTATE_CAP_ARRAY")
 #endif
+static int riscv_cpu_post_load(void *opaque, int version_id)
+{
+    RISCVCPU *cpu = opaque;
+
+    riscv_pwc_flush(&cpu->env);
+    return 0;
+}
+
 const VMStateDescription vmstate_riscv_cpu = {
     .name = "cpu",
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = riscv_cpu_post_load,
     .fields = (VMStateField[]) {
 #ifndef TARGET_CHERI
         VMSTATE_UINTTL_ARRAY(env.gpr, RISCVCPU, 32),
@@ -238,4 +238,12 @@ void hmp_info_mem(Monitor *mon, const QDict *qdict)
     }
 
     mem_info_svxx(mon, env);
+
+    if (env->pwc_walks) {
+        monitor_printf(mon, "page-table walks: %" PRIu64 ", walk cache hits: "
+                       "%" PRIu64 " (%.1f%%), PTE loads per walk: %.2f\n",
+                       env->pwc_walks, env->pwc_hits,
+                       100.0 * env->pwc_hits / env->pwc_walks,
+                       (double)env->pwc_pte_loads / env->pwc_walks);
+    }
 }
@@ -231,18 +231,51 @@ void helper_wfi(CPURISCVState *env)
     }
 }
 
-void helper_tlb_flush(CPURISCVState *env)
+static void check_sfence_vma(CPURISCVState *env, uintptr_t retaddr)
 {
-    CPUState *cs = env_cpu(env);
     if (!(env->priv >= PRV_S) ||
         (env->priv == PRV_S &&
          get_field(env->mstatus, MSTATUS_TVM))) {
-        riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, GETPC());
+        riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, retaddr);
     } else if (riscv_has_ext(env, RVH) && riscv_cpu_virt_enabled(env) &&
                get_field(env->hstatus, HSTATUS_VTVM)) {
-        riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, GETPC());
-    } else {
+        riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, retaddr);
+    }
+}
+
+void helper_tlb_flush(CPURISCVState *env)
+{
+    check_sfence_vma(env, GETPC());
+    riscv_pwc_flush(env);
+    tlb_flush(env_cpu(env));
+}
+
+/*
+ * sfence.vma with rs1 and/or rs2 not x0: flush a single page and/or a
+ * single address space, as tagged by write_satp(). Global mappings are
+ * not required to be flushed by an ASID-specific fence. The page-walk
+ * cache is not indexed by page or ASID and is always flushed completely.
+ */
+void helper_tlb_flush_vma(CPURISCVState *env, target_ulong addr,
+                          target_ulong asid, uint32_t use_addr,
+                          uint32_t use_asid)
+{
+    CPUState *cs = env_cpu(env);
+
+    check_sfence_vma(env, GETPC());
+    riscv_pwc_flush(env);
+    if (riscv_cpu_virt_enabled(env)) {
+        /* Only the address spaces of satp are tracked. */
         tlb_flush(cs);
+    } else if (!use_asid) {
+        tlb_flush_page(cs, addr);
+    } else {
+        asid = get_field(set_field(0, SATP_ASID, asid), SATP_ASID);
+        if (use_addr) {
+            tlb_flush_page_asid(cs, addr, asid);
+        } else {
+            tlb_flush_asid(cs, asid);
+        }
     }
 }
 
@@ -256,6 +289,7 @@ void helper_hyp_tlb_flush(CPURISCVState *env)
 
     if (env->priv == PRV_M ||
         (env->priv == PRV_S && !riscv_cpu_virt_enabled(env))) {
+        riscv_pwc_flush(env);
         tlb_flush(cs);
         return;
     }
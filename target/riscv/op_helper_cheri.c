@@ -142,14 +142,11 @@ static inline cap_register_t *get_scr(CPUArchState *env, uint32_t index)
     }
 }
 
-#ifdef CONFIG_TCG_LOG_INSTR
 void riscv_log_instr_scr_changed(CPURISCVState *env, int scrno)
 {
-    if (qemu_log_instr_enabled(env)) {
-        qemu_log_instr_cap(env, scr_info[scrno].name, get_scr(env, scrno));
-    }
+    cheri_log_instr_changed_capreg(env, scr_info[scrno].name,
+                                   get_scr(env, scrno));
 }
-#endif
 
 void HELPER(cspecialrw)(CPUArchState *env, uint32_t cd, uint32_t cs,
                         uint32_t index)
@@ -236,13 +233,24 @@ void HELPER(auipcc)(CPUArchState *env, uint32_t cd, target_ulong new_cursor)
     derive_cap_from_pcc(env, cd, new_cursor, GETPC(), OOB_INFO(auipcc));
 }
 
+/*
+ * With CHERI_CAP_CMPXCHG_SUPPORTED the translator no longer raises EXCP_ATOMIC
+ * for capability atomics, so other vCPUs may be running concurrently.
+ */
+static inline bool cap_atomic_is_parallel(CPUArchState *env)
+{
+    bool parallel = qemu_tcg_mttcg_enabled() &&
+                    !cpu_in_exclusive_context(env_cpu(env));
+    assert((CHERI_CAP_CMPXCHG_SUPPORTED || !parallel) &&
+           "Should have raised EXCP_ATOMIC");
+    return parallel;
+}
+
 void HELPER(amoswap_cap)(CPUArchState *env, uint32_t dest_reg,
                          uint32_t addr_reg, uint32_t val_reg)
 {
     uintptr_t _host_return_address = GETPC();
-    assert(!qemu_tcg_mttcg_enabled() ||
-           (cpu_in_exclusive_context(env_cpu(env)) &&
-            "Should have raised EXCP_ATOMIC"));
+    bool parallel = cap_atomic_is_parallel(env);
     target_long offset = 0;
     if (!cheri_in_capmode(env)) {
         offset = get_capreg_cursor(env, addr_reg);
@@ -280,6 +288,15 @@ void HELPER(amoswap_cap)(CPUArchState *env, uint32_t dest_reg,
     if (addr == env->load_res) {
         env->load_res = -1; // Invalidate LR/SC to the same address
     }
+    if (parallel) {
+        CheriCapMemValue old;
+        cheri_cap_cmpxchg_parallel(env, addr_reg, cbp, addr, val_reg,
+                                   /*expected=*/NULL, &old,
+                                   _host_return_address);
+        update_compressed_capreg(env, dest_reg, old.pesbt, old.tag,
+                                 old.cursor);
+        return;
+    }
     // Load the value to store from the register file now in case the
     // load_cap_from_memory call overwrites that register
     target_ulong loaded_pesbt;
@@ -298,9 +315,9 @@ void HELPER(amoswap_cap)(CPUArchState *env, uint32_t dest_reg,
 static void lr_c_impl(CPUArchState *env, uint32_t dest_reg, uint32_t addr_reg,
                       target_long offset, uintptr_t _host_return_address)
 {
-    assert(!qemu_tcg_mttcg_enabled() ||
-           (cpu_in_exclusive_context(env_cpu(env)) &&
-            "Should have raised EXCP_ATOMIC"));
+    // A plain load is sufficient even in parallel mode: the SC compares the
+    // whole capability with a host cmpxchg.
+    (void)cap_atomic_is_parallel(env);
     const cap_register_t *cbp = get_load_store_base_cap(env, addr_reg);
     if (!cbp->cr_tag) {
         raise_cheri_exception(env, CapEx_TagViolation, addr_reg);
@@ -363,9 +380,7 @@ static target_ulong sc_c_impl(CPUArchState *env, uint32_t addr_reg,
                               uint32_t val_reg, target_ulong offset,
                               uintptr_t _host_return_address)
 {
-    assert(!qemu_tcg_mttcg_enabled() ||
-        (cpu_in_exclusive_context(env_cpu(env)) &&
-            "Should have raised EXCP_ATOMIC"));
+    bool parallel = cap_atomic_is_parallel(env);
     const cap_register_t *cbp = get_load_store_base_cap(env, addr_reg);
 
     if (!cbp->cr_tag) {
@@ -404,6 +419,20 @@ static target_ulong sc_c_impl(CPUArchState *env, uint32_t addr_reg,
     if (addr != expected_addr) {
         goto sc_failed;
     }
+    if (parallel) {
+        const CheriCapMemValue expected = {
+            .pesbt = env->load_pesbt,
+            .cursor = env->load_val,
+            .tag = env->load_tag,
+        };
+        CheriCapMemValue old;
+        if (!cheri_cap_cmpxchg_parallel(env, addr_reg, cbp, addr, val_reg,
+                                        &expected, &old,
+                                        _host_return_address)) {
+            goto sc_failed;
+        }
+        return 0; // success
+    }
     // Now perform the "cmpxchg" operation by checking if the current values
     // in memory are the same as the ones that the load-reserved observed.
     // FIXME: There is a bug here. If the MMU / Cap Permissions squash the tag,
@@ -27,6 +27,7 @@
 #include "qemu/log.h"
 #include "qapi/error.h"
 #include "cpu.h"
+#include "exec/exec-all.h"
 #include "trace.h"
 
 static void pmp_write_cfg(CPURISCVState *env, uint32_t addr_index,
@@ -178,6 +179,98 @@ void pmp_update_rule_addr(CPURISCVState *env, uint32_t pmp_index)
     env->pmp_state.addr[pmp_index].ea = ea;
 }
 
+static int pmp_region_sa_cmp(const void *a, const void *b)
+{
+    target_ulong sa = *(const target_ulong *)a;
+    target_ulong sb = *(const target_ulong *)b;
+
+    return sa < sb ? -1 : sa > sb;
+}
+
+/*
+ * Rebuild the region table from the active entries. Every entry start and
+ * every address following an entry end begins a new region; within a
+ * region each entry either matches every address or none of them.
+ * Neighbouring regions with the same highest-priority entry are merged.
+ */
+static void pmp_update_regions(CPURISCVState *env)
+{
+    pmp_table_t *st = &env->pmp_state;
+    target_ulong bounds[MAX_RISCV_PMP_REGIONS];
+    int nb = 0;
+    int i, j;
+
+    bounds[nb++] = 0;
+    for (i = 0; i < MAX_RISCV_PMPS; i++) {
+        target_ulong sa = st->addr[i].sa;
+        target_ulong ea = st->addr[i].ea;
+
+        if (pmp_get_a_field(st->pmp[i].cfg_reg) == PMP_AMATCH_OFF || sa > ea) {
+            continue;
+        }
+        bounds[nb++] = sa;
+        if (ea != (target_ulong)-1) {
+            bounds[nb++] = ea + 1;
+        }
+    }
+    qsort(bounds, nb, sizeof(bounds[0]), pmp_region_sa_cmp);
+
+    st->num_regions = 0;
+    for (j = 0; j < nb; j++) {
+        int rule = -1;
+
+        if (j > 0 && bounds[j] == bounds[j - 1]) {
+            continue;
+        }
+        for (i = 0; i < MAX_RISCV_PMPS; i++) {
+            if (pmp_get_a_field(st->pmp[i].cfg_reg) != PMP_AMATCH_OFF &&
+                bounds[j] >= st->addr[i].sa && bounds[j] <= st->addr[i].ea) {
+                rule = i;
+                break;
+            }
+        }
+        if (st->num_regions &&
+            st->region[st->num_regions - 1].rule == rule) {
+            continue;
+        }
+        st->region[st->num_regions].sa = bounds[j];
+        st->region[st->num_regions].rule = rule;
+        st->num_regions++;
+    }
+}
+
+/*
+ * Return the index of the region containing @addr.
+ */
+static int pmp_find_region(CPURISCVState *env, target_ulong addr)
+{
+    const pmp_region_t *region = env->pmp_state.region;
+    int lo = 0, hi = env->pmp_state.num_regions - 1;
+
+    /* region[0].sa is always 0 */
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+
+        if (region[mid].sa <= addr) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Return the last address of region @r.
+ */
+static target_ulong pmp_region_ea(CPURISCVState *env, int r)
+{
+    if (r + 1 < env->pmp_state.num_regions) {
+        return env->pmp_state.region[r + 1].sa - 1;
+    }
+    return -1;
+}
+
 void pmp_update_rule_nums(CPURISCVState *env)
 {
     int i;
@@ -190,6 +283,16 @@ void pmp_update_rule_nums(CPURISCVState *env)
             env->pmp_state.num_rules++;
         }
     }
+    pmp_update_regions(env);
+
+    /* Cached page-table walks skip the PMP check on the levels they cover */
+    riscv_pwc_flush(env);
+
+    /*
+     * TLB entries may cover whole pages that the old rules allowed, so
+     * they must not outlive a change that enables or narrows a rule.
+     */
+    tlb_flush(env_cpu(env));
 }
 
 /* Convert cfg/addr reg values here into simple 'sa' --> start address and 'ea'
@@ -223,40 +326,48 @@ static int pmp_is_in_range(CPURISCVState *env, int pmp_index, target_ulong addr)
  */
 
 /*
- * Check if the address has required RWX privs to complete desired operation
+ * Privileges granted by entry @pmp_index to an access from @mode.
  */
-bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
-    target_ulong size, pmp_priv_t privs, target_ulong mode)
+static pmp_priv_t pmp_rule_privs(CPURISCVState *env, int pmp_index,
+                                 target_ulong mode)
 {
-    int i = 0;
-    int ret = -1;
-    int pmp_size = 0;
-    target_ulong s = 0;
-    target_ulong e = 0;
-    pmp_priv_t allowed_privs = 0;
-
-    /* Short cut if no rules */
-    if (0 == pmp_get_num_rules(env)) {
-        return true;
+    if (pmp_index < 0) {
+        /*
+         * Privileged spec v1.10 states if no PMP entry matches an M-Mode
+         * access, the access succeeds. Other modes are not allowed to
+         * succeed if they don't match a rule, but there are rules.
+         */
+        return mode == PRV_M ? PMP_READ | PMP_WRITE | PMP_EXEC : 0;
     }
-
-    if (size == 0) {
-        if (riscv_feature(env, RISCV_FEATURE_MMU)) {
-            /*
-             * If size is unknown (0), assume that all bytes
-             * from addr to the end of the page will be accessed.
-             */
-            pmp_size = -(addr | TARGET_PAGE_MASK);
-        } else {
-            pmp_size = sizeof(target_ulong);
-        }
-    } else {
-        pmp_size = size;
+    if (mode != PRV_M || pmp_is_locked(env, pmp_index)) {
+        return env->pmp_state.pmp[pmp_index].cfg_reg &
+               (PMP_READ | PMP_WRITE | PMP_EXEC);
     }
+    return PMP_READ | PMP_WRITE | PMP_EXEC;
+}
+
+/*
+ * Find the entry deciding an access that spans more than one region by
+ * checking each entry in priority order. Returns -1 if no entry matches and
+ * -2 if the access is partially inside the highest-priority match.
+ */
+static int pmp_find_rule_slow(CPURISCVState *env, target_ulong addr,
+                              target_ulong pmp_size)
+{
+    int i;
+    target_ulong s = 0;
+    target_ulong e = 0;
 
     /* 1.10 draft priv spec states there is an implicit order
          from low to high */
     for (i = 0; i < MAX_RISCV_PMPS; i++) {
+        const uint8_t a_field =
+            pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
+
+        if (PMP_AMATCH_OFF == a_field) {
+            continue;
+        }
+
         s = pmp_is_in_range(env, i, addr);
         e = pmp_is_in_range(env, i, addr + pmp_size - 1);
 
@@ -264,47 +375,70 @@ bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
         if ((s + e) == 1) {
             qemu_log_mask(LOG_GUEST_ERROR,
                           "pmp violation - access is partially inside\n");
-            ret = 0;
-            break;
+            return -2;
         }
 
         /* fully inside */
-        const uint8_t a_field =
-            pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
+        if ((s + e) == 2) {
+            return i;
+        }
+    }
 
-        /*
-         * If the PMP entry is not off and the address is in range, do the priv
-         * check
-         */
-        if (((s + e) == 2) && (PMP_AMATCH_OFF != a_field)) {
-            allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-            if ((mode != PRV_M) || pmp_is_locked(env, i)) {
-                allowed_privs &= env->pmp_state.pmp[i].cfg_reg;
-            }
+    return -1;
+}
 
-            if ((privs & allowed_privs) == privs) {
-                ret = 1;
-                break;
-            } else {
-                ret = 0;
-                break;
-            }
+/*
+ * Check if the address has required RWX privs to complete desired operation.
+ * If @allowed_privs is not NULL, it is set to the privileges that the
+ * deciding entry grants to every address in the accessed range.
+ */
+bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
+    target_ulong size, pmp_priv_t privs, pmp_priv_t *allowed_privs,
+    target_ulong mode)
+{
+    int pmp_size = 0;
+    int rule, r;
+    pmp_priv_t allowed;
+
+    /* Short cut if no rules */
+    if (0 == pmp_get_num_rules(env)) {
+        if (allowed_privs) {
+            *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
         }
+        return true;
     }
 
-    /* No rule matched */
-    if (ret == -1) {
-        if (mode == PRV_M) {
-            ret = 1; /* Privileged spec v1.10 states if no PMP entry matches an
-                      * M-Mode access, the access succeeds */
+    if (size == 0) {
+        if (riscv_feature(env, RISCV_FEATURE_MMU)) {
+            /*
+             * If size is unknown (0), assume that all bytes
+             * from addr to the end of the page will be accessed.
+             */
+            pmp_size = -(addr | TARGET_PAGE_MASK);
         } else {
-            ret = 0; /* Other modes are not allowed to succeed if they don't
-                      * match a rule, but there are rules.  We've checked for
-                      * no rule earlier in this function. */
+            pmp_size = sizeof(target_ulong);
         }
+    } else {
+        pmp_size = size;
     }
 
-    return ret == 1 ? true : false;
+    /*
+     * An access within a single region is decided by that region's entry,
+     * every higher-priority entry being entirely outside of it.
+     */
+    r = pmp_find_region(env, addr);
+    if (addr + pmp_size - 1 >= addr &&
+        addr + pmp_size - 1 <= pmp_region_ea(env, r)) {
+        rule = env->pmp_state.region[r].rule;
+    } else {
+        rule = pmp_find_rule_slow(env, addr, pmp_size);
+    }
+
+    allowed = rule == -2 ? 0 : pmp_rule_privs(env, rule, mode);
+    if (allowed_privs) {
+        *allowed_privs = allowed;
+    }
+    return (privs & allowed) == privs;
 }
 
 
@@ -392,53 +526,52 @@ target_ulong pmpaddr_csr_read(CPURISCVState *env, uint32_t addr_index)
 }
 
 /*
- * Calculate the TLB size if the start address or the end address of
- * PMP entry is presented in thie TLB page.
+ * Check if the PMP decision may differ within the page at @tlb_sa. If so,
+ * set *@tlb_size to the size of the smallest region piece in the page, so
+ * that the TLB entry is only used for a single access.
  */
-static target_ulong pmp_get_tlb_size(CPURISCVState *env, int pmp_index,
-                                     target_ulong tlb_sa, target_ulong tlb_ea)
+bool pmp_is_range_in_tlb(CPURISCVState *env, hwaddr tlb_sa,
+                         target_ulong *tlb_size)
 {
-    target_ulong pmp_sa = env->pmp_state.addr[pmp_index].sa;
-    target_ulong pmp_ea = env->pmp_state.addr[pmp_index].ea;
+    target_ulong tlb_ea = (tlb_sa + TARGET_PAGE_SIZE - 1);
+    target_ulong sa = tlb_sa;
+    int r;
 
-    if (pmp_sa >= tlb_sa && pmp_ea <= tlb_ea) {
-        return pmp_ea - pmp_sa + 1;
+    if (!env->pmp_state.num_regions) {
+        return false;
     }
 
-    if (pmp_sa >= tlb_sa && pmp_sa <= tlb_ea && pmp_ea >= tlb_ea) {
-        return tlb_ea - pmp_sa + 1;
+    r = pmp_find_region(env, tlb_sa);
+    if (pmp_region_ea(env, r) >= tlb_ea) {
+        return false;
     }
 
-    if (pmp_ea <= tlb_ea && pmp_ea >= tlb_sa && pmp_sa <= tlb_sa) {
-        return pmp_ea - tlb_sa + 1;
+    for (; r < env->pmp_state.num_regions &&
+           env->pmp_state.region[r].sa <= tlb_ea; r++) {
+        target_ulong ea = MIN(pmp_region_ea(env, r), tlb_ea);
+        target_ulong val = ea - sa + 1;
+
+        if (*tlb_size == 0 || *tlb_size > val) {
+            *tlb_size = val;
+        }
+        sa = ea + 1;
     }
 
-    return 0;
+    return true;
 }
 
-/*
- * Check is there a PMP entry which range covers this page. If so,
- * try to find the minimum granularity for the TLB size.
- */
-bool pmp_is_range_in_tlb(CPURISCVState *env, hwaddr tlb_sa,
-                         target_ulong *tlb_size)
+int pmp_priv_to_page_prot(pmp_priv_t pmp_priv)
 {
-    int i;
-    target_ulong val;
-    target_ulong tlb_ea = (tlb_sa + TARGET_PAGE_SIZE - 1);
+    int prot = 0;
 
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
-        val = pmp_get_tlb_size(env, i, tlb_sa, tlb_ea);
-        if (val) {
-            if (*tlb_size == 0 || *tlb_size > val) {
-                *tlb_size = val;
-            }
-        }
+    if (pmp_priv & PMP_READ) {
+        prot |= PAGE_READ;
     }
-
-    if (*tlb_size != 0) {
-        return true;
+    if (pmp_priv & PMP_WRITE) {
+        prot |= PAGE_WRITE;
     }
-
-    return false;
+    if (pmp_priv & PMP_EXEC) {
+        prot |= PAGE_EXEC;
+    }
+    return prot;
 }
@@ -58,10 +58,23 @@ typedef struct {
     target_ulong ea;
 } pmp_addr_t;
 
+/*
+ * The address space split into regions in which the same PMP entry has
+ * priority. Region i spans [sa, region[i + 1].sa - 1].
+ */
+typedef struct {
+    target_ulong sa;
+    int rule;           /* matching entry with the highest priority, or -1 */
+} pmp_region_t;
+
+#define MAX_RISCV_PMP_REGIONS (MAX_RISCV_PMPS * 2 + 1)
+
 typedef struct {
     pmp_entry_t pmp[MAX_RISCV_PMPS];
     pmp_addr_t  addr[MAX_RISCV_PMPS];
     uint32_t num_rules;
+    pmp_region_t region[MAX_RISCV_PMP_REGIONS];
+    uint32_t num_regions;
 } pmp_table_t;
 
 void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
@@ -71,10 +84,12 @@ void pmpaddr_csr_write(CPURISCVState *env, uint32_t addr_index,
     target_ulong val);
 target_ulong pmpaddr_csr_read(CPURISCVState *env, uint32_t addr_index);
 bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
-    target_ulong size, pmp_priv_t priv, target_ulong mode);
+    target_ulong size, pmp_priv_t priv, pmp_priv_t *allowed_privs,
+    target_ulong mode);
 bool pmp_is_range_in_tlb(CPURISCVState *env, hwaddr tlb_sa,
                          target_ulong *tlb_size);
 void pmp_update_rule_addr(CPURISCVState *env, uint32_t pmp_index);
 void pmp_update_rule_nums(CPURISCVState *env);
+int pmp_priv_to_page_prot(pmp_priv_t pmp_priv);
 
 #endif
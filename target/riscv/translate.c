@@ -326,6 +326,34 @@ void cheri_tcg_prepare_for_unconditional_exception(DisasContextBase *db)
     db->is_jmp = DISAS_NORETURN;
 }
 
+/*
+ * Unconditional direct jumps forward within the page of the TB can be
+ * followed at translation time instead of ending the TB, so that the optimizer
+ * and register allocator see both sides of the jump. Only forward jumps are
+ * followed: this guarantees termination, keeps all instructions within
+ * [pc_first, pc_first + tb->size) for self-modifying code detection, and
+ * preserves the assumption that PCC bounds only need checking above pc_next.
+ */
+static bool can_translate_through_jump(DisasContext *ctx, target_ulong dest)
+{
+#ifdef CONFIG_RVFI_DII
+    return false;
+#else
+    if (!use_goto_tb(ctx, dest) || dest <= ctx->base.pc_next) {
+        return false;
+    }
+    if ((ctx->base.pc_first & TARGET_PAGE_MASK) != (dest & TARGET_PAGE_MASK)) {
+        return false;
+    }
+#ifdef TARGET_CHERI
+    if (!in_pcc_bounds(&ctx->base, dest)) {
+        return false;
+    }
+#endif
+    return true;
+#endif
+}
+
 static void gen_goto_tb(DisasContext *ctx, int n, target_ulong dest,
                         bool bounds_check)
 {
@@ -485,6 +513,11 @@ static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
     // For CHERI the result is an offset relative to PCC.base
     gen_set_gpr_const(rd, ctx->pc_succ_insn - pcc_base(ctx));
 
+    if (can_translate_through_jump(ctx, next_pc)) {
+        /* Keep translating at the jump target as part of this TB. */
+        ctx->pc_succ_insn = next_pc;
+        return;
+    }
     gen_goto_tb(ctx, 0, ctx->base.pc_next + imm, /*bounds_check=*/true); /* must use this for safety */
     ctx->base.is_jmp = DISAS_NORETURN;
 }
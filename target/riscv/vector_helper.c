@@ -1627,6 +1627,35 @@ GEN_VEXT_VX(vmax_vx_h, 2, 2, clearh)
 GEN_VEXT_VX(vmax_vx_w, 4, 4, clearl)
 GEN_VEXT_VX(vmax_vx_d, 8, 8, clearq)
 
+/* Out-of-line expansion of the unmasked min/max with a scalar */
+#define GEN_VEC_MINMAXS(NAME, ETYPE, OP)                      \
+void HELPER(NAME)(void *d, void *a, uint64_t b, uint32_t desc) \
+{                                                             \
+    intptr_t oprsz = simd_oprsz(desc);                        \
+    intptr_t i;                                               \
+                                                              \
+    for (i = 0; i < oprsz; i += sizeof(ETYPE)) {              \
+        *(ETYPE *)(d + i) = OP(*(ETYPE *)(a + i), (ETYPE)b);  \
+    }                                                         \
+}
+
+GEN_VEC_MINMAXS(vec_umins8,  uint8_t,  DO_MIN)
+GEN_VEC_MINMAXS(vec_umins16, uint16_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_umins32, uint32_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_umins64, uint64_t, DO_MIN)
+GEN_VEC_MINMAXS(vec_smins8,  int8_t,   DO_MIN)
+GEN_VEC_MINMAXS(vec_smins16, int16_t,  DO_MIN)
+GEN_VEC_MINMAXS(vec_smins32, int32_t,  DO_MIN)
+GEN_VEC_MINMAXS(vec_smins64, int64_t,  DO_MIN)
+GEN_VEC_MINMAXS(vec_umaxs8,  uint8_t,  DO_MAX)
+GEN_VEC_MINMAXS(vec_umaxs16, uint16_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_umaxs32, uint32_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_umaxs64, uint64_t, DO_MAX)
+GEN_VEC_MINMAXS(vec_smaxs8,  int8_t,   DO_MAX)
+GEN_VEC_MINMAXS(vec_smaxs16, int16_t,  DO_MAX)
+GEN_VEC_MINMAXS(vec_smaxs32, int32_t,  DO_MAX)
+GEN_VEC_MINMAXS(vec_smaxs64, int64_t,  DO_MAX)
+
 /* Vector Single-Width Integer Multiply Instructions */
 #define DO_MUL(N, M) (N * M)
 RVVCALL(OPIVV2, vmul_vv_b, OP_SSS_B, H1, H1, H1, DO_MUL)
@@ -1946,6 +1975,39 @@ GEN_VEXT_VV(vnmsub_vv_h, 2, 2, clearh)
 GEN_VEXT_VV(vnmsub_vv_w, 4, 4, clearl)
 GEN_VEXT_VV(vnmsub_vv_d, 8, 8, clearq)
 
+/*
+ * Out-of-line expansion of the unmasked multiply-add, with a = vs2 and
+ * b = vs1 as for the element helpers above.
+ */
+#define GEN_VEC_MACC(NAME, ETYPE, OP)                         \
+void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)   \
+{                                                             \
+    intptr_t oprsz = simd_oprsz(desc);                        \
+    intptr_t i;                                               \
+                                                              \
+    for (i = 0; i < oprsz; i += sizeof(ETYPE)) {              \
+        ETYPE *pd = (ETYPE *)(d + i);                         \
+        *pd = OP(*(ETYPE *)(a + i), *(ETYPE *)(b + i), *pd);  \
+    }                                                         \
+}
+
+GEN_VEC_MACC(vec_macc8,   int8_t,   DO_MACC)
+GEN_VEC_MACC(vec_macc16,  int16_t,  DO_MACC)
+GEN_VEC_MACC(vec_macc32,  uint32_t, DO_MACC)
+GEN_VEC_MACC(vec_macc64,  uint64_t, DO_MACC)
+GEN_VEC_MACC(vec_nmsac8,  int8_t,   DO_NMSAC)
+GEN_VEC_MACC(vec_nmsac16, int16_t,  DO_NMSAC)
+GEN_VEC_MACC(vec_nmsac32, uint32_t, DO_NMSAC)
+GEN_VEC_MACC(vec_nmsac64, uint64_t, DO_NMSAC)
+GEN_VEC_MACC(vec_madd8,   int8_t,   DO_MADD)
+GEN_VEC_MACC(vec_madd16,  int16_t,  DO_MADD)
+GEN_VEC_MACC(vec_madd32,  uint32_t, DO_MADD)
+GEN_VEC_MACC(vec_madd64,  uint64_t, DO_MADD)
+GEN_VEC_MACC(vec_nmsub8,  int8_t,   DO_NMSUB)
+GEN_VEC_MACC(vec_nmsub16, int16_t,  DO_NMSUB)
+GEN_VEC_MACC(vec_nmsub32, uint32_t, DO_NMSUB)
+GEN_VEC_MACC(vec_nmsub64, uint64_t, DO_NMSUB)
+
 #define OPIVX3(NAME, TD, T1, T2, TX1, TX2, HD, HS2, OP)             \
 static void do_##NAME(void *vd, target_long s1, void *vs2, int i)   \
 {                                                                   \
@@ -594,6 +594,250 @@ static bool swap_commutative2(TCGArg *p1, TCGArg *p2)
     return false;
 }
 
+/*
+ * Forward values loaded from or stored to env at constant offsets to later
+ * loads of the same location, and drop stores to env that are overwritten
+ * before anything can read them.  Only accesses based directly on cpu_env
+ * are tracked.  Anything else that may read env (helper calls, guest memory
+ * accesses whose slow path may fill the TLB or raise an exception, accesses
+ * through other pointers, the end of the basic block) makes the pending
+ * stores observable; anything that may write it drops the known values.
+ */
+#define ENV_MEM_ENTRIES 16
+
+struct env_mem_entry {
+    intptr_t ofs;
+    unsigned size;
+    /* The load that @val can replace, or INDEX_op_last if none.  */
+    TCGOpcode ld_opc;
+    TCGTemp *val;
+    /* The store that wrote @val, if nothing may have read it since.  */
+    TCGOp *store;
+};
+
+struct env_mem_info {
+    int n;
+    struct env_mem_entry e[ENV_MEM_ENTRIES];
+};
+
+static unsigned env_ld_size(TCGOpcode opc)
+{
+    switch (opc) {
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(ld8s):
+        return 1;
+    CASE_OP_32_64(ld16u):
+    CASE_OP_32_64(ld16s):
+        return 2;
+    case INDEX_op_ld_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+        return 4;
+    case INDEX_op_ld_i64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+static unsigned env_st_size(TCGOpcode opc)
+{
+    switch (opc) {
+    CASE_OP_32_64(st8):
+        return 1;
+    CASE_OP_32_64(st16):
+        return 2;
+    case INDEX_op_st_i32:
+    case INDEX_op_st32_i64:
+        return 4;
+    case INDEX_op_st_i64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/* The load that can be replaced by a move from the value stored by OPC.  */
+static TCGOpcode env_st_fwd_opc(TCGOpcode opc)
+{
+    switch (opc) {
+    case INDEX_op_st_i32:
+        return INDEX_op_ld_i32;
+    case INDEX_op_st_i64:
+        return INDEX_op_ld_i64;
+    default:
+        return INDEX_op_last;
+    }
+}
+
+static inline bool env_mem_overlap(const struct env_mem_entry *e,
+                                   intptr_t ofs, unsigned size)
+{
+    return e->ofs < ofs + (intptr_t)size && ofs < e->ofs + (intptr_t)e->size;
+}
+
+static void env_mem_remove(struct env_mem_info *em, int i)
+{
+    em->e[i] = em->e[--em->n];
+}
+
+static void env_mem_add(struct env_mem_info *em, intptr_t ofs, unsigned size,
+                        TCGOpcode ld_opc, TCGTemp *val, TCGOp *store)
+{
+    if (em->n == ENV_MEM_ENTRIES) {
+        env_mem_remove(em, 0);
+    }
+    em->e[em->n++] = (struct env_mem_entry) {
+        .ofs = ofs, .size = size, .ld_opc = ld_opc, .val = val, .store = store
+    };
+}
+
+/* Forget the values held in TS, which is about to be overwritten.  */
+static void env_mem_drop_val(struct env_mem_info *em, TCGTemp *ts)
+{
+    int i;
+
+    for (i = em->n - 1; i >= 0; i--) {
+        if (em->e[i].val == ts) {
+            env_mem_remove(em, i);
+        }
+    }
+}
+
+static void env_mem_observe(struct env_mem_info *em, intptr_t ofs,
+                            unsigned size)
+{
+    int i;
+
+    for (i = 0; i < em->n; i++) {
+        if (env_mem_overlap(&em->e[i], ofs, size)) {
+            em->e[i].store = NULL;
+        }
+    }
+}
+
+static void env_mem_observe_all(struct env_mem_info *em)
+{
+    int i;
+
+    for (i = 0; i < em->n; i++) {
+        em->e[i].store = NULL;
+    }
+}
+
+static void env_mem_optimize(TCGContext *s, struct env_mem_info *em,
+                             TCGOp *op, int nb_oargs, int nb_iargs)
+{
+    TCGOpcode opc = op->opc;
+    const TCGOpDef *def = &tcg_op_defs[opc];
+    TCGTemp *env = tcgv_ptr_temp(cpu_env);
+    TCGTemp *ts;
+    intptr_t ofs;
+    unsigned size;
+    int i;
+
+    if (def->flags & TCG_OPF_BB_END) {
+        em->n = 0;
+        return;
+    }
+
+    switch (opc) {
+    case INDEX_op_call:
+        {
+            unsigned flags = op->args[nb_oargs + nb_iargs + 1];
+
+            if (!(flags & TCG_CALL_NO_SIDE_EFFECTS)) {
+                em->n = 0;
+                return;
+            }
+            env_mem_observe_all(em);
+            if (!(flags & TCG_CALL_NO_WRITE_GLOBALS)) {
+                for (i = em->n - 1; i >= 0; i--) {
+                    if (em->e[i].val->temp_global) {
+                        env_mem_remove(em, i);
+                    }
+                }
+            }
+        }
+        break;
+
+    case INDEX_op_qemu_ld_i32:
+    case INDEX_op_qemu_ld_i64:
+    case INDEX_op_qemu_st_i32:
+    case INDEX_op_qemu_st_i64:
+    case INDEX_op_st_vec:
+    case INDEX_op_sync:
+    case INDEX_op_mb:
+        em->n = 0;
+        return;
+
+    case INDEX_op_ld_vec:
+    case INDEX_op_dupm_vec:
+        env_mem_observe_all(em);
+        break;
+
+    default:
+        size = env_ld_size(opc);
+        if (size) {
+            if (arg_temp(op->args[1]) != env) {
+                env_mem_observe_all(em);
+                break;
+            }
+            ofs = op->args[2];
+            ts = arg_temp(op->args[0]);
+            for (i = 0; i < em->n; i++) {
+                struct env_mem_entry *e = &em->e[i];
+
+                if (e->ofs == ofs && e->ld_opc == opc) {
+                    op->opc = (def->flags & TCG_OPF_64BIT
+                               ? INDEX_op_mov_i64 : INDEX_op_mov_i32);
+                    op->args[1] = temp_arg(e->val);
+                    if (e->val != ts) {
+                        env_mem_drop_val(em, ts);
+                    }
+                    return;
+                }
+            }
+            env_mem_observe(em, ofs, size);
+            env_mem_drop_val(em, ts);
+            env_mem_add(em, ofs, size, opc, ts, NULL);
+            return;
+        }
+
+        size = env_st_size(opc);
+        if (size) {
+            if (arg_temp(op->args[1]) != env) {
+                em->n = 0;
+                return;
+            }
+            ofs = op->args[2];
+            for (i = em->n - 1; i >= 0; i--) {
+                struct env_mem_entry *e = &em->e[i];
+
+                if (!env_mem_overlap(e, ofs, size)) {
+                    continue;
+                }
+                if (e->store && e->ofs >= ofs &&
+                    e->ofs + e->size <= ofs + size) {
+                    tcg_op_remove(s, e->store);
+                }
+                env_mem_remove(em, i);
+            }
+            env_mem_add(em, ofs, size, env_st_fwd_opc(opc),
+                        arg_temp(op->args[0]), op);
+            return;
+        }
+        break;
+    }
+
+    for (i = 0; i < nb_oargs; i++) {
+        ts = arg_temp(op->args[i]);
+        if (ts) {
+            env_mem_drop_val(em, ts);
+        }
+    }
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -601,6 +845,7 @@ void tcg_optimize(TCGContext *s)
     TCGOp *op, *op_next, *prev_mb = NULL;
     struct tcg_temp_info *infos;
     TCGTempSet temps_used;
+    struct env_mem_info env_mem = { .n = 0 };
 
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
@@ -646,6 +891,11 @@ void tcg_optimize(TCGContext *s)
             }
         }
 
+        /* Forward env loads and eliminate dead env stores */
+        env_mem_optimize(s, &env_mem, op, nb_oargs, nb_iargs);
+        opc = op->opc;
+        def = &tcg_op_defs[opc];
+
         /* For commutative operations make constant second argument */
         switch (opc) {
         CASE_OP_32_64_VEC(add):
@@ -44,6 +44,7 @@
 #include "cpu.h"
 
 #include "exec/exec-all.h"
+#include "exec/tb-stats.h"
 
 #if !defined(CONFIG_USER_ONLY)
 #include "hw/boards.h"
@@ -198,8 +199,10 @@ struct tcg_region_state {
     size_t stride; /* .size + guard size */
 
     /* fields protected by the lock */
-    size_t current; /* current region index */
+    size_t current; /* next never-assigned region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    GQueue full; /* indices of full regions, oldest first */
+    GQueue free; /* indices of evicted regions, ready for reuse */
 };
 
 static struct tcg_region_state region;
@@ -313,6 +316,10 @@ static void tcg_out_label(TCGContext *s, TCGLabel *l)
     tcg_debug_assert(!l->has_value);
     l->has_value = 1;
     l->u.value_ptr = tcg_splitwx_to_rx(s->code_ptr);
+#ifdef TCG_TARGET_INTERPRETER
+    /* Branches must land on the start of a bytecode instruction. */
+    s->tci_fuse_ptr = NULL;
+#endif
 }
 
 TCGLabel *gen_new_label(void)
@@ -413,22 +420,24 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *cp)
+static size_t tcg_region_index(const void *p)
 {
-    void *p = tcg_splitwx_to_rw(cp);
-    size_t region_idx;
+    ptrdiff_t offset;
 
     if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
     }
+    return offset / region.stride;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *cp)
+{
+    size_t region_idx = tcg_region_index(tcg_splitwx_to_rw(cp));
+
     return region_trees + region_idx * tree_size;
 }
 
@@ -525,18 +534,21 @@ static gboolean tcg_region_tree_traverse(gpointer k, gpointer v, gpointer data)
     return FALSE;
 }
 
+static void tcg_region_tree_reset(struct tcg_region_tree *rt)
+{
+    g_tree_foreach(rt->tree, tcg_region_tree_traverse, NULL);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+}
+
 static void tcg_region_tree_reset_all(void)
 {
     size_t i;
 
     tcg_region_tree_lock_all();
     for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
-
-        g_tree_foreach(rt->tree, tcg_region_tree_traverse, NULL);
-        /* Increment the refcount first so that destroy acts as a reset */
-        g_tree_ref(rt->tree);
-        g_tree_destroy(rt->tree);
+        tcg_region_tree_reset(region_trees + i * tree_size);
     }
     tcg_region_tree_unlock_all();
 }
@@ -573,11 +585,16 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t idx;
+
+    if (!g_queue_is_empty(&region.free)) {
+        idx = GPOINTER_TO_SIZE(g_queue_pop_head(&region.free));
+    } else if (region.current < region.n) {
+        idx = region.current++;
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, idx);
     return false;
 }
 
@@ -590,11 +607,13 @@ static bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t idx_full = tcg_region_index(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        g_queue_push_tail(&region.full, GSIZE_TO_POINTER(idx_full));
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -618,6 +637,8 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    g_queue_clear(&region.full);
+    g_queue_clear(&region.free);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -630,6 +651,56 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+static gboolean tcg_region_evict_traverse(gpointer k, gpointer v, gpointer data)
+{
+    TranslationBlock *tb = v;
+
+    tb_phys_invalidate(tb, -1);
+    return FALSE;
+}
+
+/*
+ * Evict the least recently filled region: invalidate all the TBs it holds
+ * and make it available to tcg_region_alloc() again. Regions currently
+ * assigned to a TCGContext are never evicted.
+ * Returns false if there was nothing to evict, in which case the caller
+ * must fall back to a full flush.
+ *
+ * Call from a safe-work context, with mmap_lock held in user-mode.
+ */
+bool tcg_region_evict_oldest(void)
+{
+    struct tcg_region_tree *rt;
+    void *start, *end;
+    size_t idx;
+
+    qemu_mutex_lock(&region.lock);
+    /* another vCPU may already have evicted on our behalf */
+    if (!g_queue_is_empty(&region.free) || region.current < region.n) {
+        qemu_mutex_unlock(&region.lock);
+        return true;
+    }
+    if (g_queue_is_empty(&region.full)) {
+        qemu_mutex_unlock(&region.lock);
+        return false;
+    }
+    idx = GPOINTER_TO_SIZE(g_queue_pop_head(&region.full));
+    qemu_mutex_unlock(&region.lock);
+
+    rt = region_trees + idx * tree_size;
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, tcg_region_evict_traverse, NULL);
+    tcg_region_tree_reset(rt);
+    qemu_mutex_unlock(&rt->lock);
+
+    tcg_region_bounds(idx, &start, &end);
+    qemu_mutex_lock(&region.lock);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    g_queue_push_tail(&region.free, GSIZE_TO_POINTER(idx));
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
 #ifdef CONFIG_USER_ONLY
 static size_t tcg_n_regions(void)
 {
@@ -646,29 +717,30 @@ static size_t tcg_n_regions(void)
 {
     size_t i;
 
-    /* Use a single region if all we have is one vCPU thread */
 #if !defined(CONFIG_USER_ONLY)
     MachineState *ms = MACHINE(qdev_get_machine());
     unsigned int max_cpus = ms->smp.max_cpus;
 #endif
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
-    }
+    /*
+     * A single vCPU thread still gets several regions, so that running out
+     * of space only evicts the oldest region instead of flushing everything.
+     */
+    unsigned int n_threads = qemu_tcg_mttcg_enabled() ? max_cpus : 1;
 
-    /* Try to have more regions than max_cpus, with each region being >= 2 MB */
+    /* Try to have more regions than threads, with each region being >= 2 MB */
     for (i = 8; i > 0; i--) {
         size_t regions_per_thread = i;
         size_t region_size;
 
         region_size = tcg_init_ctx.code_gen_buffer_size;
-        region_size /= max_cpus * regions_per_thread;
+        region_size /= n_threads * regions_per_thread;
 
         if (region_size >= 2 * 1024u * 1024) {
-            return max_cpus * regions_per_thread;
+            return n_threads * regions_per_thread;
         }
     }
     /* If we can't, then just allocate one region per vCPU thread */
-    return max_cpus;
+    return n_threads;
 }
 #endif
 
@@ -729,6 +801,8 @@ void tcg_region_init(void)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    g_queue_init(&region.full);
+    g_queue_init(&region.free);
     region.n = n_regions;
     region.size = region_size - page_size;
     region.stride = region_size;
@@ -4183,6 +4257,22 @@ static void sync_global(TCGContext *s, TCGOp *op)
     tcg_debug_assert((ts->val_type != TEMP_VAL_REG) || (ts->mem_coherent));
 }
 
+static void tcg_tb_stats_count_ops(TCGContext *s, uint32_t *ops,
+                                   uint32_t *calls)
+{
+    TCGOp *op;
+    uint32_t n_ops = 0, n_calls = 0;
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        n_ops++;
+        n_calls += op->opc == INDEX_op_call;
+    }
+    qatomic_set(ops, n_ops);
+    if (calls) {
+        qatomic_set(calls, n_calls);
+    }
+}
+
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 {
 #ifdef CONFIG_PROFILER
@@ -4239,6 +4329,10 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     }
 #endif
 
+    if (unlikely(tb->tb_stats)) {
+        tcg_tb_stats_count_ops(s, &tb->tb_stats->ops_before_opt, NULL);
+    }
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->opt_time, prof->opt_time - profile_getclock());
 #endif
@@ -4247,6 +4341,11 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     tcg_optimize(s);
 #endif
 
+    if (unlikely(tb->tb_stats)) {
+        tcg_tb_stats_count_ops(s, &tb->tb_stats->ops_after_opt,
+                               &tb->tb_stats->helper_calls);
+    }
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->opt_time, prof->opt_time + profile_getclock());
     qatomic_set(&prof->la_time, prof->la_time - profile_getclock());
@@ -4297,6 +4396,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
      */
     s->code_buf = tcg_splitwx_to_rw(tb->tc.ptr);
     s->code_ptr = s->code_buf;
+#ifdef TCG_TARGET_INTERPRETER
+    s->tci_fuse_ptr = NULL;
+#endif
 
 #ifdef TCG_TARGET_NEED_LDST_LABELS
     QSIMPLEQ_INIT(&s->ldst_labels);
@@ -4334,6 +4436,10 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
                 /* Assert that we do not overflow our stored offset.  */
                 assert(s->gen_insn_end_off[num_insns] == off);
             }
+#ifdef TCG_TARGET_INTERPRETER
+            /* Keep the bytecode of each guest insn separate for unwinding. */
+            s->tci_fuse_ptr = NULL;
+#endif
             num_insns++;
             for (i = 0; i < TARGET_INSN_START_WORDS; ++i) {
                 target_ulong a;
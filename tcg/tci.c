@@ -483,6 +483,34 @@ static bool tci_compare64(uint64_t u0, uint64_t u1, TCGCond condition)
 # define qemu_st_beq(X)  stq_be_p(g2h(taddr), X)
 #endif
 
+/*
+ * Threaded dispatch: every handler ends with its own indirect jump to the
+ * handler of the next instruction, rather than all of them sharing the
+ * single indirect jump of a switch statement.
+ */
+#if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
+# define TCI_INSN_START() (old_code_ptr = tb_ptr, op_size = tb_ptr[1])
+#else
+# define TCI_INSN_START() ((void)0)
+#endif
+
+/* Skip opcode and size entry, and jump to the handler. */
+#define DISPATCH() \
+    do { \
+        TCI_INSN_START(); \
+        tb_ptr += 2; \
+        goto *dispatch[tb_ptr[-2]]; \
+    } while (0)
+
+/* Continue with the instruction following the current one. */
+#define NEXT() \
+    do { \
+        tci_assert(tb_ptr == old_code_ptr + op_size); \
+        DISPATCH(); \
+    } while (0)
+
+#define CASE(name) op_##name:
+
 /* Interpret pseudo code in tb. */
 uintptr_t tcg_qemu_tb_exec(CPUArchState *env, const void *v_tb_ptr)
 {
@@ -491,795 +519,1017 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, const void *v_tb_ptr)
     long tcg_temps[CPU_TEMP_BUF_NLONGS];
     uintptr_t sp_value = (uintptr_t)(tcg_temps + CPU_TEMP_BUF_NLONGS);
     uintptr_t ret = 0;
+#if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
+    uint8_t op_size;
+    const uint8_t *old_code_ptr;
+#endif
+    tcg_target_ulong t0;
+    tcg_target_ulong t1;
+    tcg_target_ulong t2;
+    tcg_target_ulong label;
+    TCGCond condition;
+    target_ulong taddr;
+    uint8_t tmp8;
+    uint16_t tmp16;
+    uint32_t tmp32;
+    uint64_t tmp64;
+#if TCG_TARGET_REG_BITS == 32
+    uint64_t v64;
+#endif
+    TCGMemOpIdx oi;
+    static const void *const dispatch[1 << 8] = {
+        [0 ... (1 << 8) - 1] = &&op_todo,
+        [INDEX_op_call] = &&op_call,
+        [INDEX_op_br] = &&op_br,
+        [INDEX_op_setcond_i32] = &&op_setcond_i32,
+#if TCG_TARGET_REG_BITS == 32
+        [INDEX_op_setcond2_i32] = &&op_setcond2_i32,
+#elif TCG_TARGET_REG_BITS == 64
+        [INDEX_op_setcond_i64] = &&op_setcond_i64,
+#endif
+        [INDEX_op_mov_i32] = &&op_mov_i32,
+        [INDEX_op_movi_i32] = &&op_movi_i32,
+        [INDEX_op_ld8u_i32] = &&op_ld8u_i32,
+        [INDEX_op_ld8s_i32] = &&op_ld8s_i32,
+        [INDEX_op_ld16u_i32] = &&op_ld16u_i32,
+        [INDEX_op_ld16s_i32] = &&op_ld16s_i32,
+        [INDEX_op_ld_i32] = &&op_ld_i32,
+        [INDEX_op_st8_i32] = &&op_st8_i32,
+        [INDEX_op_st16_i32] = &&op_st16_i32,
+        [INDEX_op_st_i32] = &&op_st_i32,
+        [INDEX_op_add_i32] = &&op_add_i32,
+        [INDEX_op_sub_i32] = &&op_sub_i32,
+        [INDEX_op_mul_i32] = &&op_mul_i32,
+#if TCG_TARGET_HAS_div_i32
+        [INDEX_op_div_i32] = &&op_div_i32,
+        [INDEX_op_divu_i32] = &&op_divu_i32,
+        [INDEX_op_rem_i32] = &&op_rem_i32,
+        [INDEX_op_remu_i32] = &&op_remu_i32,
+#elif TCG_TARGET_HAS_div2_i32
+        [INDEX_op_div2_i32] = &&op_div2_i32,
+        [INDEX_op_divu2_i32] = &&op_divu2_i32,
+#endif
+        [INDEX_op_and_i32] = &&op_and_i32,
+        [INDEX_op_or_i32] = &&op_or_i32,
+        [INDEX_op_xor_i32] = &&op_xor_i32,
+        [INDEX_op_shl_i32] = &&op_shl_i32,
+        [INDEX_op_shr_i32] = &&op_shr_i32,
+        [INDEX_op_sar_i32] = &&op_sar_i32,
+#if TCG_TARGET_HAS_rot_i32
+        [INDEX_op_rotl_i32] = &&op_rotl_i32,
+        [INDEX_op_rotr_i32] = &&op_rotr_i32,
+#endif
+#if TCG_TARGET_HAS_deposit_i32
+        [INDEX_op_deposit_i32] = &&op_deposit_i32,
+#endif
+        [INDEX_op_brcond_i32] = &&op_brcond_i32,
+#if TCG_TARGET_REG_BITS == 32
+        [INDEX_op_add2_i32] = &&op_add2_i32,
+        [INDEX_op_sub2_i32] = &&op_sub2_i32,
+        [INDEX_op_brcond2_i32] = &&op_brcond2_i32,
+        [INDEX_op_mulu2_i32] = &&op_mulu2_i32,
+#endif /* TCG_TARGET_REG_BITS == 32 */
+#if TCG_TARGET_HAS_ext8s_i32
+        [INDEX_op_ext8s_i32] = &&op_ext8s_i32,
+#endif
+#if TCG_TARGET_HAS_ext16s_i32
+        [INDEX_op_ext16s_i32] = &&op_ext16s_i32,
+#endif
+#if TCG_TARGET_HAS_ext8u_i32
+        [INDEX_op_ext8u_i32] = &&op_ext8u_i32,
+#endif
+#if TCG_TARGET_HAS_ext16u_i32
+        [INDEX_op_ext16u_i32] = &&op_ext16u_i32,
+#endif
+#if TCG_TARGET_HAS_bswap16_i32
+        [INDEX_op_bswap16_i32] = &&op_bswap16_i32,
+#endif
+#if TCG_TARGET_HAS_bswap32_i32
+        [INDEX_op_bswap32_i32] = &&op_bswap32_i32,
+#endif
+#if TCG_TARGET_HAS_not_i32
+        [INDEX_op_not_i32] = &&op_not_i32,
+#endif
+#if TCG_TARGET_HAS_neg_i32
+        [INDEX_op_neg_i32] = &&op_neg_i32,
+#endif
+#if TCG_TARGET_REG_BITS == 64
+        [INDEX_op_mov_i64] = &&op_mov_i64,
+        [INDEX_op_movi_i64] = &&op_movi_i64,
+        [INDEX_op_ld8u_i64] = &&op_ld8u_i64,
+        [INDEX_op_ld8s_i64] = &&op_ld8s_i64,
+        [INDEX_op_ld16u_i64] = &&op_ld16u_i64,
+        [INDEX_op_ld16s_i64] = &&op_ld16s_i64,
+        [INDEX_op_ld32u_i64] = &&op_ld32u_i64,
+        [INDEX_op_ld32s_i64] = &&op_ld32s_i64,
+        [INDEX_op_ld_i64] = &&op_ld_i64,
+        [INDEX_op_st8_i64] = &&op_st8_i64,
+        [INDEX_op_st16_i64] = &&op_st16_i64,
+        [INDEX_op_st32_i64] = &&op_st32_i64,
+        [INDEX_op_st_i64] = &&op_st_i64,
+        [INDEX_op_add_i64] = &&op_add_i64,
+        [INDEX_op_sub_i64] = &&op_sub_i64,
+        [INDEX_op_mul_i64] = &&op_mul_i64,
+#if TCG_TARGET_HAS_div_i64
+        [INDEX_op_div_i64] = &&op_div_i64,
+        [INDEX_op_divu_i64] = &&op_divu_i64,
+        [INDEX_op_rem_i64] = &&op_rem_i64,
+        [INDEX_op_remu_i64] = &&op_remu_i64,
+#elif TCG_TARGET_HAS_div2_i64
+        [INDEX_op_div2_i64] = &&op_div2_i64,
+        [INDEX_op_divu2_i64] = &&op_divu2_i64,
+#endif
+        [INDEX_op_and_i64] = &&op_and_i64,
+        [INDEX_op_or_i64] = &&op_or_i64,
+        [INDEX_op_xor_i64] = &&op_xor_i64,
+        [INDEX_op_shl_i64] = &&op_shl_i64,
+        [INDEX_op_shr_i64] = &&op_shr_i64,
+        [INDEX_op_sar_i64] = &&op_sar_i64,
+#if TCG_TARGET_HAS_rot_i64
+        [INDEX_op_rotl_i64] = &&op_rotl_i64,
+        [INDEX_op_rotr_i64] = &&op_rotr_i64,
+#endif
+#if TCG_TARGET_HAS_deposit_i64
+        [INDEX_op_deposit_i64] = &&op_deposit_i64,
+#endif
+        [INDEX_op_brcond_i64] = &&op_brcond_i64,
+#if TCG_TARGET_HAS_ext8u_i64
+        [INDEX_op_ext8u_i64] = &&op_ext8u_i64,
+#endif
+#if TCG_TARGET_HAS_ext8s_i64
+        [INDEX_op_ext8s_i64] = &&op_ext8s_i64,
+#endif
+#if TCG_TARGET_HAS_ext16s_i64
+        [INDEX_op_ext16s_i64] = &&op_ext16s_i64,
+#endif
+#if TCG_TARGET_HAS_ext16u_i64
+        [INDEX_op_ext16u_i64] = &&op_ext16u_i64,
+#endif
+#if TCG_TARGET_HAS_ext32s_i64
+        [INDEX_op_ext32s_i64] = &&op_ext32s_i64,
+#endif
+        [INDEX_op_ext_i32_i64] = &&op_ext_i32_i64,
+#if TCG_TARGET_HAS_ext32u_i64
+        [INDEX_op_ext32u_i64] = &&op_ext32u_i64,
+#endif
+        [INDEX_op_extu_i32_i64] = &&op_extu_i32_i64,
+#if TCG_TARGET_HAS_bswap16_i64
+        [INDEX_op_bswap16_i64] = &&op_bswap16_i64,
+#endif
+#if TCG_TARGET_HAS_bswap32_i64
+        [INDEX_op_bswap32_i64] = &&op_bswap32_i64,
+#endif
+#if TCG_TARGET_HAS_bswap64_i64
+        [INDEX_op_bswap64_i64] = &&op_bswap64_i64,
+#endif
+#if TCG_TARGET_HAS_not_i64
+        [INDEX_op_not_i64] = &&op_not_i64,
+#endif
+#if TCG_TARGET_HAS_neg_i64
+        [INDEX_op_neg_i64] = &&op_neg_i64,
+#endif
+#endif /* TCG_TARGET_REG_BITS == 64 */
+        [INDEX_op_exit_tb] = &&op_exit_tb,
+        [INDEX_op_goto_tb] = &&op_goto_tb,
+        [INDEX_op_qemu_ld_i32] = &&op_qemu_ld_i32,
+        [INDEX_op_qemu_ld_i64] = &&op_qemu_ld_i64,
+        [INDEX_op_qemu_st_i32] = &&op_qemu_st_i32,
+        [INDEX_op_qemu_st_i64] = &&op_qemu_st_i64,
+        [INDEX_op_mb] = &&op_mb,
+        [TCI_OP_ld_add_i32] = &&op_ld_add_i32,
+        [TCI_OP_setcond_brcond_i32] = &&op_setcond_brcond_i32,
+#if TCG_TARGET_REG_BITS == 64
+        [TCI_OP_ld_add_i64] = &&op_ld_add_i64,
+        [TCI_OP_setcond_brcond_i64] = &&op_setcond_brcond_i64,
+#endif
+#if TARGET_LONG_BITS <= TCG_TARGET_REG_BITS
+        [TCI_OP_add_qemu_ld_i32] = &&op_add_qemu_ld_i32,
+        [TCI_OP_add_qemu_ld_i64] = &&op_add_qemu_ld_i64,
+#endif
+    };
 
     regs[TCG_AREG0] = (tcg_target_ulong)env;
     regs[TCG_REG_CALL_STACK] = sp_value;
     tci_assert(tb_ptr);
 
-    for (;;) {
-        TCGOpcode opc = tb_ptr[0];
-#if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
-        uint8_t op_size = tb_ptr[1];
-        const uint8_t *old_code_ptr = tb_ptr;
-#endif
-        tcg_target_ulong t0;
-        tcg_target_ulong t1;
-        tcg_target_ulong t2;
-        tcg_target_ulong label;
-        TCGCond condition;
-        target_ulong taddr;
-        uint8_t tmp8;
-        uint16_t tmp16;
-        uint32_t tmp32;
-        uint64_t tmp64;
-#if TCG_TARGET_REG_BITS == 32
-        uint64_t v64;
-#endif
-        TCGMemOpIdx oi;
+    DISPATCH();
 
-#if defined(GETPC)
+    CASE(call)
         tci_tb_ptr = (uintptr_t)tb_ptr;
-#endif
-
-        /* Skip opcode and size entry. */
-        tb_ptr += 2;
-
-        switch (opc) {
-        case INDEX_op_call:
-            t0 = tci_read_ri(regs, &tb_ptr);
+        t0 = tci_read_ri(regs, &tb_ptr);
 #if TCG_TARGET_REG_BITS == 32
-            tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
-                                          tci_read_reg(regs, TCG_REG_R1),
-                                          tci_read_reg(regs, TCG_REG_R2),
-                                          tci_read_reg(regs, TCG_REG_R3),
-                                          tci_read_reg(regs, TCG_REG_R5),
-                                          tci_read_reg(regs, TCG_REG_R6),
-                                          tci_read_reg(regs, TCG_REG_R7),
-                                          tci_read_reg(regs, TCG_REG_R8),
-                                          tci_read_reg(regs, TCG_REG_R9),
-                                          tci_read_reg(regs, TCG_REG_R10),
-                                          tci_read_reg(regs, TCG_REG_R11),
-                                          tci_read_reg(regs, TCG_REG_R12));
-            tci_write_reg(regs, TCG_REG_R0, tmp64);
-            tci_write_reg(regs, TCG_REG_R1, tmp64 >> 32);
+        tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
+                                      tci_read_reg(regs, TCG_REG_R1),
+                                      tci_read_reg(regs, TCG_REG_R2),
+                                      tci_read_reg(regs, TCG_REG_R3),
+                                      tci_read_reg(regs, TCG_REG_R5),
+                                      tci_read_reg(regs, TCG_REG_R6),
+                                      tci_read_reg(regs, TCG_REG_R7),
+                                      tci_read_reg(regs, TCG_REG_R8),
+                                      tci_read_reg(regs, TCG_REG_R9),
+                                      tci_read_reg(regs, TCG_REG_R10),
+                                      tci_read_reg(regs, TCG_REG_R11),
+                                      tci_read_reg(regs, TCG_REG_R12));
+        tci_write_reg(regs, TCG_REG_R0, tmp64);
+        tci_write_reg(regs, TCG_REG_R1, tmp64 >> 32);
 #else
-            tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
-                                          tci_read_reg(regs, TCG_REG_R1),
-                                          tci_read_reg(regs, TCG_REG_R2),
-                                          tci_read_reg(regs, TCG_REG_R3),
-                                          tci_read_reg(regs, TCG_REG_R5),
-                                          tci_read_reg(regs, TCG_REG_R6));
-            tci_write_reg(regs, TCG_REG_R0, tmp64);
+        tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
+                                      tci_read_reg(regs, TCG_REG_R1),
+                                      tci_read_reg(regs, TCG_REG_R2),
+                                      tci_read_reg(regs, TCG_REG_R3),
+                                      tci_read_reg(regs, TCG_REG_R5),
+                                      tci_read_reg(regs, TCG_REG_R6));
+        tci_write_reg(regs, TCG_REG_R0, tmp64);
 #endif
-            break;
-        case INDEX_op_br:
-            label = tci_read_label(&tb_ptr);
-            tci_assert(tb_ptr == old_code_ptr + op_size);
-            tb_ptr = (uint8_t *)label;
-            continue;
-        case INDEX_op_setcond_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg32(regs, t0, tci_compare32(t1, t2, condition));
-            break;
+        NEXT();
+    CASE(br)
+        label = tci_read_label(&tb_ptr);
+        tci_assert(tb_ptr == old_code_ptr + op_size);
+        tb_ptr = (uint8_t *)label;
+        DISPATCH();
+    CASE(setcond_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        tci_write_reg32(regs, t0, tci_compare32(t1, t2, condition));
+        NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_setcond2_i32:
-            t0 = *tb_ptr++;
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            v64 = tci_read_ri64(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg32(regs, t0, tci_compare64(tmp64, v64, condition));
-            break;
+    CASE(setcond2_i32)
+        t0 = *tb_ptr++;
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        v64 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        tci_write_reg32(regs, t0, tci_compare64(tmp64, v64, condition));
+        NEXT();
 #elif TCG_TARGET_REG_BITS == 64
-        case INDEX_op_setcond_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg64(regs, t0, tci_compare64(t1, t2, condition));
-            break;
+    CASE(setcond_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        tci_write_reg64(regs, t0, tci_compare64(t1, t2, condition));
+        NEXT();
 #endif
-        case INDEX_op_mov_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
-        case INDEX_op_movi_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_i32(&tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    CASE(mov_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        NEXT();
+    CASE(movi_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_i32(&tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        NEXT();
 
-            /* Load/store operations (32 bit). */
+        /* Load/store operations (32 bit). */
 
-        case INDEX_op_ld8u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i32:
-            TODO();
-            break;
-        case INDEX_op_ld16u_i32:
-            TODO();
-            break;
-        case INDEX_op_ld16s_i32:
-            TODO();
-            break;
-        case INDEX_op_ld_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i32:
-            t0 = tci_read_r8(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i32:
-            t0 = tci_read_r16(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i32:
-            t0 = tci_read_r32(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_assert(t1 != sp_value || (int32_t)t2 < 0);
-            *(uint32_t *)(t1 + t2) = t0;
-            break;
+    CASE(ld8u_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
+        NEXT();
+    CASE(ld8s_i32)
+        TODO();
+        NEXT();
+    CASE(ld16u_i32)
+        TODO();
+        NEXT();
+    CASE(ld16s_i32)
+        TODO();
+        NEXT();
+    CASE(ld_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
+        NEXT();
+    CASE(st8_i32)
+        t0 = tci_read_r8(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint8_t *)(t1 + t2) = t0;
+        NEXT();
+    CASE(st16_i32)
+        t0 = tci_read_r16(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint16_t *)(t1 + t2) = t0;
+        NEXT();
+    CASE(st_i32)
+        t0 = tci_read_r32(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_assert(t1 != sp_value || (int32_t)t2 < 0);
+        *(uint32_t *)(t1 + t2) = t0;
+        NEXT();
 
-            /* Arithmetic operations (32 bit). */
+        /* Arithmetic operations (32 bit). */
 
-        case INDEX_op_add_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 * t2);
-            break;
+    CASE(add_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 + t2);
+        NEXT();
+    CASE(sub_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 - t2);
+        NEXT();
+    CASE(mul_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 * t2);
+        NEXT();
 #if TCG_TARGET_HAS_div_i32
-        case INDEX_op_div_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, (int32_t)t1 / (int32_t)t2);
-            break;
-        case INDEX_op_divu_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 / t2);
-            break;
-        case INDEX_op_rem_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, (int32_t)t1 % (int32_t)t2);
-            break;
-        case INDEX_op_remu_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 % t2);
-            break;
+    CASE(div_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, (int32_t)t1 / (int32_t)t2);
+        NEXT();
+    CASE(divu_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 / t2);
+        NEXT();
+    CASE(rem_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, (int32_t)t1 % (int32_t)t2);
+        NEXT();
+    CASE(remu_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 % t2);
+        NEXT();
 #elif TCG_TARGET_HAS_div2_i32
-        case INDEX_op_div2_i32:
-        case INDEX_op_divu2_i32:
-            TODO();
-            break;
+    CASE(div2_i32)
+    CASE(divu2_i32)
+        TODO();
+        NEXT();
 #endif
-        case INDEX_op_and_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 & t2);
-            break;
-        case INDEX_op_or_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 ^ t2);
-            break;
+    CASE(and_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 & t2);
+        NEXT();
+    CASE(or_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 | t2);
+        NEXT();
+    CASE(xor_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 ^ t2);
+        NEXT();
 
-            /* Shift/rotate operations (32 bit). */
+        /* Shift/rotate operations (32 bit). */
 
-        case INDEX_op_shl_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 << (t2 & 31));
-            break;
-        case INDEX_op_shr_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1 >> (t2 & 31));
-            break;
-        case INDEX_op_sar_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, ((int32_t)t1 >> (t2 & 31)));
-            break;
+    CASE(shl_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 << (t2 & 31));
+        NEXT();
+    CASE(shr_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 >> (t2 & 31));
+        NEXT();
+    CASE(sar_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, ((int32_t)t1 >> (t2 & 31)));
+        NEXT();
 #if TCG_TARGET_HAS_rot_i32
-        case INDEX_op_rotl_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, rol32(t1, t2 & 31));
-            break;
-        case INDEX_op_rotr_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, ror32(t1, t2 & 31));
-            break;
+    CASE(rotl_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, rol32(t1, t2 & 31));
+        NEXT();
+    CASE(rotr_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, ror32(t1, t2 & 31));
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i32
-        case INDEX_op_deposit_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            t2 = tci_read_r32(regs, &tb_ptr);
-            tmp16 = *tb_ptr++;
-            tmp8 = *tb_ptr++;
-            tmp32 = (((1 << tmp8) - 1) << tmp16);
-            tci_write_reg32(regs, t0, (t1 & ~tmp32) | ((t2 << tmp16) & tmp32));
-            break;
+    CASE(deposit_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        t2 = tci_read_r32(regs, &tb_ptr);
+        tmp16 = *tb_ptr++;
+        tmp8 = *tb_ptr++;
+        tmp32 = (((1 << tmp8) - 1) << tmp16);
+        tci_write_reg32(regs, t0, (t1 & ~tmp32) | ((t2 << tmp16) & tmp32));
+        NEXT();
 #endif
-        case INDEX_op_brcond_i32:
-            t0 = tci_read_r32(regs, &tb_ptr);
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare32(t0, t1, condition)) {
-                tci_assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
-            }
-            break;
+    CASE(brcond_i32)
+        t0 = tci_read_r32(regs, &tb_ptr);
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        label = tci_read_label(&tb_ptr);
+        if (tci_compare32(t0, t1, condition)) {
+            tci_assert(tb_ptr == old_code_ptr + op_size);
+            tb_ptr = (uint8_t *)label;
+            DISPATCH();
+        }
+        NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_add2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            tmp64 += tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t1, t0, tmp64);
-            break;
-        case INDEX_op_sub2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            tmp64 -= tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t1, t0, tmp64);
-            break;
-        case INDEX_op_brcond2_i32:
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            v64 = tci_read_ri64(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare64(tmp64, v64, condition)) {
-                tci_assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
-            }
-            break;
-        case INDEX_op_mulu2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            t2 = tci_read_r32(regs, &tb_ptr);
-            tmp64 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg64(regs, t1, t0, t2 * tmp64);
-            break;
+    CASE(add2_i32)
+        t0 = *tb_ptr++;
+        t1 = *tb_ptr++;
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        tmp64 += tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t1, t0, tmp64);
+        NEXT();
+    CASE(sub2_i32)
+        t0 = *tb_ptr++;
+        t1 = *tb_ptr++;
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        tmp64 -= tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t1, t0, tmp64);
+        NEXT();
+    CASE(brcond2_i32)
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        v64 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        label = tci_read_label(&tb_ptr);
+        if (tci_compare64(tmp64, v64, condition)) {
+            tci_assert(tb_ptr == old_code_ptr + op_size);
+            tb_ptr = (uint8_t *)label;
+            DISPATCH();
+        }
+        NEXT();
+    CASE(mulu2_i32)
+        t0 = *tb_ptr++;
+        t1 = *tb_ptr++;
+        t2 = tci_read_r32(regs, &tb_ptr);
+        tmp64 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg64(regs, t1, t0, t2 * tmp64);
+        NEXT();
 #endif /* TCG_TARGET_REG_BITS == 32 */
 #if TCG_TARGET_HAS_ext8s_i32
-        case INDEX_op_ext8s_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8s(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    CASE(ext8s_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r8s(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i32
-        case INDEX_op_ext16s_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16s(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    CASE(ext16s_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16s(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8u_i32
-        case INDEX_op_ext8u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    CASE(ext8u_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r8(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i32
-        case INDEX_op_ext16u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, t1);
-            break;
+    CASE(ext16u_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap16_i32
-        case INDEX_op_bswap16_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, bswap16(t1));
-            break;
+    CASE(bswap16_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, bswap16(t1));
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i32
-        case INDEX_op_bswap32_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, bswap32(t1));
-            break;
+    CASE(bswap32_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, bswap32(t1));
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i32
-        case INDEX_op_not_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, ~t1);
-            break;
+    CASE(not_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, ~t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i32
-        case INDEX_op_neg_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg32(regs, t0, -t1);
-            break;
+    CASE(neg_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, -t1);
+        NEXT();
 #endif
 #if TCG_TARGET_REG_BITS == 64
-        case INDEX_op_mov_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
-        case INDEX_op_movi_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_i64(&tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    CASE(mov_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        NEXT();
+    CASE(movi_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_i64(&tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        NEXT();
 
-            /* Load/store operations (64 bit). */
+        /* Load/store operations (64 bit). */
 
-        case INDEX_op_ld8u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i64:
-            TODO();
-            break;
-        case INDEX_op_ld16u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg16(regs, t0, *(uint16_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld16s_i64:
-            TODO();
-            break;
-        case INDEX_op_ld32u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld32s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg32s(regs, t0, *(int32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_write_reg64(regs, t0, *(uint64_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i64:
-            t0 = tci_read_r8(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i64:
-            t0 = tci_read_r16(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st32_i64:
-            t0 = tci_read_r32(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            *(uint32_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i64:
-            t0 = tci_read_r64(regs, &tb_ptr);
-            t1 = tci_read_r(regs, &tb_ptr);
-            t2 = tci_read_s32(&tb_ptr);
-            tci_assert(t1 != sp_value || (int32_t)t2 < 0);
-            *(uint64_t *)(t1 + t2) = t0;
-            break;
+    CASE(ld8u_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
+        NEXT();
+    CASE(ld8s_i64)
+        TODO();
+        NEXT();
+    CASE(ld16u_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg16(regs, t0, *(uint16_t *)(t1 + t2));
+        NEXT();
+    CASE(ld16s_i64)
+        TODO();
+        NEXT();
+    CASE(ld32u_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
+        NEXT();
+    CASE(ld32s_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg32s(regs, t0, *(int32_t *)(t1 + t2));
+        NEXT();
+    CASE(ld_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg64(regs, t0, *(uint64_t *)(t1 + t2));
+        NEXT();
+    CASE(st8_i64)
+        t0 = tci_read_r8(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint8_t *)(t1 + t2) = t0;
+        NEXT();
+    CASE(st16_i64)
+        t0 = tci_read_r16(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint16_t *)(t1 + t2) = t0;
+        NEXT();
+    CASE(st32_i64)
+        t0 = tci_read_r32(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        *(uint32_t *)(t1 + t2) = t0;
+        NEXT();
+    CASE(st_i64)
+        t0 = tci_read_r64(regs, &tb_ptr);
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_assert(t1 != sp_value || (int32_t)t2 < 0);
+        *(uint64_t *)(t1 + t2) = t0;
+        NEXT();
 
-            /* Arithmetic operations (64 bit). */
+        /* Arithmetic operations (64 bit). */
 
-        case INDEX_op_add_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 * t2);
-            break;
+    CASE(add_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 + t2);
+        NEXT();
+    CASE(sub_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 - t2);
+        NEXT();
+    CASE(mul_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 * t2);
+        NEXT();
 #if TCG_TARGET_HAS_div_i64
-        case INDEX_op_div_i64:
-        case INDEX_op_divu_i64:
-        case INDEX_op_rem_i64:
-        case INDEX_op_remu_i64:
-            TODO();
-            break;
+    CASE(div_i64)
+    CASE(divu_i64)
+    CASE(rem_i64)
+    CASE(remu_i64)
+        TODO();
+        NEXT();
 #elif TCG_TARGET_HAS_div2_i64
-        case INDEX_op_div2_i64:
-        case INDEX_op_divu2_i64:
-            TODO();
-            break;
+    CASE(div2_i64)
+    CASE(divu2_i64)
+        TODO();
+        NEXT();
 #endif
-        case INDEX_op_and_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 & t2);
-            break;
-        case INDEX_op_or_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 ^ t2);
-            break;
+    CASE(and_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 & t2);
+        NEXT();
+    CASE(or_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 | t2);
+        NEXT();
+    CASE(xor_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 ^ t2);
+        NEXT();
 
-            /* Shift/rotate operations (64 bit). */
+        /* Shift/rotate operations (64 bit). */
 
-        case INDEX_op_shl_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 << (t2 & 63));
-            break;
-        case INDEX_op_shr_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1 >> (t2 & 63));
-            break;
-        case INDEX_op_sar_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, ((int64_t)t1 >> (t2 & 63)));
-            break;
+    CASE(shl_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 << (t2 & 63));
+        NEXT();
+    CASE(shr_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 >> (t2 & 63));
+        NEXT();
+    CASE(sar_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, ((int64_t)t1 >> (t2 & 63)));
+        NEXT();
 #if TCG_TARGET_HAS_rot_i64
-        case INDEX_op_rotl_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, rol64(t1, t2 & 63));
-            break;
-        case INDEX_op_rotr_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, ror64(t1, t2 & 63));
-            break;
+    CASE(rotl_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, rol64(t1, t2 & 63));
+        NEXT();
+    CASE(rotr_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, ror64(t1, t2 & 63));
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i64
-        case INDEX_op_deposit_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            t2 = tci_read_r64(regs, &tb_ptr);
-            tmp16 = *tb_ptr++;
-            tmp8 = *tb_ptr++;
-            tmp64 = (((1ULL << tmp8) - 1) << tmp16);
-            tci_write_reg64(regs, t0, (t1 & ~tmp64) | ((t2 << tmp16) & tmp64));
-            break;
+    CASE(deposit_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        t2 = tci_read_r64(regs, &tb_ptr);
+        tmp16 = *tb_ptr++;
+        tmp8 = *tb_ptr++;
+        tmp64 = (((1ULL << tmp8) - 1) << tmp16);
+        tci_write_reg64(regs, t0, (t1 & ~tmp64) | ((t2 << tmp16) & tmp64));
+        NEXT();
 #endif
-        case INDEX_op_brcond_i64:
-            t0 = tci_read_r64(regs, &tb_ptr);
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare64(t0, t1, condition)) {
-                tci_assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
-            }
-            break;
+    CASE(brcond_i64)
+        t0 = tci_read_r64(regs, &tb_ptr);
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        label = tci_read_label(&tb_ptr);
+        if (tci_compare64(t0, t1, condition)) {
+            tci_assert(tb_ptr == old_code_ptr + op_size);
+            tb_ptr = (uint8_t *)label;
+            DISPATCH();
+        }
+        NEXT();
 #if TCG_TARGET_HAS_ext8u_i64
-        case INDEX_op_ext8u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    CASE(ext8u_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r8(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8s_i64
-        case INDEX_op_ext8s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8s(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    CASE(ext8s_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r8s(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i64
-        case INDEX_op_ext16s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16s(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    CASE(ext16s_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16s(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i64
-        case INDEX_op_ext16u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    CASE(ext16u_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_ext32s_i64
-        case INDEX_op_ext32s_i64:
+    CASE(ext32s_i64)
 #endif
-        case INDEX_op_ext_i32_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32s(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    CASE(ext_i32_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32s(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        NEXT();
 #if TCG_TARGET_HAS_ext32u_i64
-        case INDEX_op_ext32u_i64:
+    CASE(ext32u_i64)
 #endif
-        case INDEX_op_extu_i32_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, t1);
-            break;
+    CASE(extu_i32_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1);
+        NEXT();
 #if TCG_TARGET_HAS_bswap16_i64
-        case INDEX_op_bswap16_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, bswap16(t1));
-            break;
+    CASE(bswap16_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r16(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, bswap16(t1));
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i64
-        case INDEX_op_bswap32_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, bswap32(t1));
-            break;
+    CASE(bswap32_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, bswap32(t1));
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap64_i64
-        case INDEX_op_bswap64_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, bswap64(t1));
-            break;
+    CASE(bswap64_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, bswap64(t1));
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i64
-        case INDEX_op_not_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, ~t1);
-            break;
+    CASE(not_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, ~t1);
+        NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i64
-        case INDEX_op_neg_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(regs, &tb_ptr);
-            tci_write_reg64(regs, t0, -t1);
-            break;
+    CASE(neg_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, -t1);
+        NEXT();
 #endif
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
-            /* QEMU specific operations. */
+        /* QEMU specific operations. */
 
-        case INDEX_op_exit_tb:
-            ret = *(uint64_t *)tb_ptr;
-            goto exit;
+    CASE(exit_tb)
+        ret = *(uint64_t *)tb_ptr;
+        goto exit;
+    CASE(goto_tb)
+        /* Jump address is aligned */
+        tb_ptr = QEMU_ALIGN_PTR_UP(tb_ptr, 4);
+        t0 = qatomic_read((int32_t *)tb_ptr);
+        tb_ptr += sizeof(int32_t);
+        tci_assert(tb_ptr == old_code_ptr + op_size);
+        tb_ptr += (int32_t)t0;
+        DISPATCH();
+    CASE(qemu_ld_i32)
+        tci_tb_ptr = (uintptr_t)tb_ptr;
+        t0 = *tb_ptr++;
+        taddr = tci_read_ulong(regs, &tb_ptr);
+        oi = tci_read_i(&tb_ptr);
+        switch (get_memop(oi) & (MO_BSWAP | MO_SSIZE)) {
+        case MO_UB:
+            tmp32 = qemu_ld_ub;
             break;
-        case INDEX_op_goto_tb:
-            /* Jump address is aligned */
-            tb_ptr = QEMU_ALIGN_PTR_UP(tb_ptr, 4);
-            t0 = qatomic_read((int32_t *)tb_ptr);
-            tb_ptr += sizeof(int32_t);
-            tci_assert(tb_ptr == old_code_ptr + op_size);
-            tb_ptr += (int32_t)t0;
-            continue;
-        case INDEX_op_qemu_ld_i32:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(regs, &tb_ptr);
-            oi = tci_read_i(&tb_ptr);
-            switch (get_memop(oi) & (MO_BSWAP | MO_SSIZE)) {
-            case MO_UB:
-                tmp32 = qemu_ld_ub;
-                break;
-            case MO_SB:
-                tmp32 = (int8_t)qemu_ld_ub;
-                break;
-            case MO_LEUW:
-                tmp32 = qemu_ld_leuw;
-                break;
-            case MO_LESW:
-                tmp32 = (int16_t)qemu_ld_leuw;
-                break;
-            case MO_LEUL:
-                tmp32 = qemu_ld_leul;
-                break;
-            case MO_BEUW:
-                tmp32 = qemu_ld_beuw;
-                break;
-            case MO_BESW:
-                tmp32 = (int16_t)qemu_ld_beuw;
-                break;
-            case MO_BEUL:
-                tmp32 = qemu_ld_beul;
-                break;
-            default:
-                tcg_abort();
-            }
-            tci_write_reg(regs, t0, tmp32);
+        case MO_SB:
+            tmp32 = (int8_t)qemu_ld_ub;
+            break;
+        case MO_LEUW:
+            tmp32 = qemu_ld_leuw;
             break;
-        case INDEX_op_qemu_ld_i64:
-            t0 = *tb_ptr++;
-            if (TCG_TARGET_REG_BITS == 32) {
-                t1 = *tb_ptr++;
-            }
-            taddr = tci_read_ulong(regs, &tb_ptr);
-            oi = tci_read_i(&tb_ptr);
-            switch (get_memop(oi) & (MO_BSWAP | MO_SSIZE)) {
-            case MO_UB:
-                tmp64 = qemu_ld_ub;
-                break;
-            case MO_SB:
-                tmp64 = (int8_t)qemu_ld_ub;
-                break;
-            case MO_LEUW:
-                tmp64 = qemu_ld_leuw;
-                break;
-            case MO_LESW:
-                tmp64 = (int16_t)qemu_ld_leuw;
-                break;
-            case MO_LEUL:
-                tmp64 = qemu_ld_leul;
-                break;
-            case MO_LESL:
-                tmp64 = (int32_t)qemu_ld_leul;
-                break;
-            case MO_LEQ:
-                tmp64 = qemu_ld_leq;
-                break;
-            case MO_BEUW:
-                tmp64 = qemu_ld_beuw;
-                break;
-            case MO_BESW:
-                tmp64 = (int16_t)qemu_ld_beuw;
-                break;
-            case MO_BEUL:
-                tmp64 = qemu_ld_beul;
-                break;
-            case MO_BESL:
-                tmp64 = (int32_t)qemu_ld_beul;
-                break;
-            case MO_BEQ:
-                tmp64 = qemu_ld_beq;
-                break;
-            default:
-                tcg_abort();
-            }
-            tci_write_reg(regs, t0, tmp64);
-            if (TCG_TARGET_REG_BITS == 32) {
-                tci_write_reg(regs, t1, tmp64 >> 32);
-            }
+        case MO_LESW:
+            tmp32 = (int16_t)qemu_ld_leuw;
             break;
-        case INDEX_op_qemu_st_i32:
-            t0 = tci_read_r(regs, &tb_ptr);
-            taddr = tci_read_ulong(regs, &tb_ptr);
-            oi = tci_read_i(&tb_ptr);
-            switch (get_memop(oi) & (MO_BSWAP | MO_SIZE)) {
-            case MO_UB:
-                qemu_st_b(t0);
-                break;
-            case MO_LEUW:
-                qemu_st_lew(t0);
-                break;
-            case MO_LEUL:
-                qemu_st_lel(t0);
-                break;
-            case MO_BEUW:
-                qemu_st_bew(t0);
-                break;
-            case MO_BEUL:
-                qemu_st_bel(t0);
-                break;
-            default:
-                tcg_abort();
-            }
+        case MO_LEUL:
+            tmp32 = qemu_ld_leul;
             break;
-        case INDEX_op_qemu_st_i64:
-            tmp64 = tci_read_r64(regs, &tb_ptr);
-            taddr = tci_read_ulong(regs, &tb_ptr);
-            oi = tci_read_i(&tb_ptr);
-            switch (get_memop(oi) & (MO_BSWAP | MO_SIZE)) {
-            case MO_UB:
-                qemu_st_b(tmp64);
-                break;
-            case MO_LEUW:
-                qemu_st_lew(tmp64);
-                break;
-            case MO_LEUL:
-                qemu_st_lel(tmp64);
-                break;
-            case MO_LEQ:
-                qemu_st_leq(tmp64);
-                break;
-            case MO_BEUW:
-                qemu_st_bew(tmp64);
-                break;
-            case MO_BEUL:
-                qemu_st_bel(tmp64);
-                break;
-            case MO_BEQ:
-                qemu_st_beq(tmp64);
-                break;
-            default:
-                tcg_abort();
-            }
+        case MO_BEUW:
+            tmp32 = qemu_ld_beuw;
             break;
-        case INDEX_op_mb:
-            /* Ensure ordering for all kinds */
-            smp_mb();
+        case MO_BESW:
+            tmp32 = (int16_t)qemu_ld_beuw;
+            break;
+        case MO_BEUL:
+            tmp32 = qemu_ld_beul;
             break;
         default:
-            TODO();
+            tcg_abort();
+        }
+        tci_write_reg(regs, t0, tmp32);
+        NEXT();
+    CASE(qemu_ld_i64)
+        tci_tb_ptr = (uintptr_t)tb_ptr;
+        t0 = *tb_ptr++;
+        if (TCG_TARGET_REG_BITS == 32) {
+            t1 = *tb_ptr++;
+        }
+        taddr = tci_read_ulong(regs, &tb_ptr);
+        oi = tci_read_i(&tb_ptr);
+        switch (get_memop(oi) & (MO_BSWAP | MO_SSIZE)) {
+        case MO_UB:
+            tmp64 = qemu_ld_ub;
+            break;
+        case MO_SB:
+            tmp64 = (int8_t)qemu_ld_ub;
+            break;
+        case MO_LEUW:
+            tmp64 = qemu_ld_leuw;
+            break;
+        case MO_LESW:
+            tmp64 = (int16_t)qemu_ld_leuw;
+            break;
+        case MO_LEUL:
+            tmp64 = qemu_ld_leul;
+            break;
+        case MO_LESL:
+            tmp64 = (int32_t)qemu_ld_leul;
+            break;
+        case MO_LEQ:
+            tmp64 = qemu_ld_leq;
+            break;
+        case MO_BEUW:
+            tmp64 = qemu_ld_beuw;
             break;
+        case MO_BESW:
+            tmp64 = (int16_t)qemu_ld_beuw;
+            break;
+        case MO_BEUL:
+            tmp64 = qemu_ld_beul;
+            break;
+        case MO_BESL:
+            tmp64 = (int32_t)qemu_ld_beul;
+            break;
+        case MO_BEQ:
+            tmp64 = qemu_ld_beq;
+            break;
+        default:
+            tcg_abort();
         }
-        tci_assert(tb_ptr == old_code_ptr + op_size);
-    }
+        tci_write_reg(regs, t0, tmp64);
+        if (TCG_TARGET_REG_BITS == 32) {
+            tci_write_reg(regs, t1, tmp64 >> 32);
+        }
+        NEXT();
+    CASE(qemu_st_i32)
+        tci_tb_ptr = (uintptr_t)tb_ptr;
+        t0 = tci_read_r(regs, &tb_ptr);
+        taddr = tci_read_ulong(regs, &tb_ptr);
+        oi = tci_read_i(&tb_ptr);
+        switch (get_memop(oi) & (MO_BSWAP | MO_SIZE)) {
+        case MO_UB:
+            qemu_st_b(t0);
+            break;
+        case MO_LEUW:
+            qemu_st_lew(t0);
+            break;
+        case MO_LEUL:
+            qemu_st_lel(t0);
+            break;
+        case MO_BEUW:
+            qemu_st_bew(t0);
+            break;
+        case MO_BEUL:
+            qemu_st_bel(t0);
+            break;
+        default:
+            tcg_abort();
+        }
+        NEXT();
+    CASE(qemu_st_i64)
+        tci_tb_ptr = (uintptr_t)tb_ptr;
+        tmp64 = tci_read_r64(regs, &tb_ptr);
+        taddr = tci_read_ulong(regs, &tb_ptr);
+        oi = tci_read_i(&tb_ptr);
+        switch (get_memop(oi) & (MO_BSWAP | MO_SIZE)) {
+        case MO_UB:
+            qemu_st_b(tmp64);
+            break;
+        case MO_LEUW:
+            qemu_st_lew(tmp64);
+            break;
+        case MO_LEUL:
+            qemu_st_lel(tmp64);
+            break;
+        case MO_LEQ:
+            qemu_st_leq(tmp64);
+            break;
+        case MO_BEUW:
+            qemu_st_bew(tmp64);
+            break;
+        case MO_BEUL:
+            qemu_st_bel(tmp64);
+            break;
+        case MO_BEQ:
+            qemu_st_beq(tmp64);
+            break;
+        default:
+            tcg_abort();
+        }
+        NEXT();
+    CASE(mb)
+        /* Ensure ordering for all kinds */
+        smp_mb();
+        NEXT();
+
+        /* Superinstructions. */
+
+    CASE(ld_add_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
+        goto op_add_i32;
+    CASE(setcond_brcond_i32)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        tci_write_reg32(regs, t0, tci_compare32(t1, t2, condition));
+        goto op_brcond_i32;
+#if TCG_TARGET_REG_BITS == 64
+    CASE(ld_add_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r(regs, &tb_ptr);
+        t2 = tci_read_s32(&tb_ptr);
+        tci_write_reg64(regs, t0, *(uint64_t *)(t1 + t2));
+        goto op_add_i64;
+    CASE(setcond_brcond_i64)
+        t0 = *tb_ptr++;
+        t1 = tci_read_r64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        condition = *tb_ptr++;
+        tci_write_reg64(regs, t0, tci_compare64(t1, t2, condition));
+        goto op_brcond_i64;
+#endif
+#if TARGET_LONG_BITS <= TCG_TARGET_REG_BITS
+    CASE(add_qemu_ld_i32)
+        t0 = *tb_ptr++;
+#if TARGET_LONG_BITS == 32
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 + t2);
+#else
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 + t2);
+#endif
+        goto op_qemu_ld_i32;
+    CASE(add_qemu_ld_i64)
+        t0 = *tb_ptr++;
+#if TARGET_LONG_BITS == 32
+        t1 = tci_read_ri32(regs, &tb_ptr);
+        t2 = tci_read_ri32(regs, &tb_ptr);
+        tci_write_reg32(regs, t0, t1 + t2);
+#else
+        t1 = tci_read_ri64(regs, &tb_ptr);
+        t2 = tci_read_ri64(regs, &tb_ptr);
+        tci_write_reg64(regs, t0, t1 + t2);
+#endif
+        goto op_qemu_ld_i64;
+#endif
+    op_todo:
+        TODO();
 exit:
     return ret;
 }
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
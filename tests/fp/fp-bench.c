@@ -33,6 +33,13 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_MIN,
+    /* from the other precision; the input is a float, so narrowing is exact */
+    OP_CVT,
+    OP_TOINT32,
+    OP_TOINT64,
+    OP_FROMINT32,
+    OP_FROMINT64,
     OP_MAX_NR,
 };
 
@@ -44,6 +51,12 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_MIN] = "min",
+    [OP_CVT] = "cvt",
+    [OP_TOINT32] = "toint32",
+    [OP_TOINT64] = "toint64",
+    [OP_FROMINT32] = "fromint32",
+    [OP_FROMINT64] = "fromint64",
     [OP_MAX_NR] = NULL,
 };
 
@@ -169,6 +182,8 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
     int i;
 
     for (i = 0; i < n_ops; i++) {
+        /* conversions from integers use all 64 bits */
+        ops[i].u64 = random_ops[i];
         switch (prec) {
         case PREC_SINGLE:
         case PREC_FLOAT32:
@@ -190,6 +205,23 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
     }
 }
 
+static enum precision input_precision(enum precision prec, enum op op)
+{
+    if (op != OP_CVT) {
+        return prec;
+    }
+    switch (prec) {
+    case PREC_SINGLE:
+    case PREC_DOUBLE:
+        return PREC_SINGLE;
+    case PREC_FLOAT32:
+    case PREC_FLOAT64:
+        return PREC_FLOAT32;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 /*
  * The main benchmark function. Instead of (ab)using macros, we rely
  * on the compiler to unfold this at compile-time.
@@ -197,16 +229,20 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
 static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
 {
     int64_t tf = get_clock() + duration * 1000000000LL;
+    enum precision in_prec = input_precision(prec, op);
 
     while (get_clock() < tf) {
         union fp ops[MAX_OPERANDS];
         int64_t t0;
         int i;
 
-        update_random_ops(n_ops, prec);
+        update_random_ops(n_ops, in_prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, in_prec, no_neg);
+            if (op == OP_CVT) {
+                ops[1].d = ops[0].f;
+            }
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -235,13 +271,31 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MIN:
+                    res.f = fminf(a, b);
+                    break;
+                case OP_CVT:
+                    res.f = ops[1].d;
+                    break;
+                case OP_TOINT32:
+                    res.u64 = (int32_t)lrintf(a);
+                    break;
+                case OP_TOINT64:
+                    res.u64 = llrintf(a);
+                    break;
+                case OP_FROMINT32:
+                    res.f = (int32_t)ops[0].u64;
+                    break;
+                case OP_FROMINT64:
+                    res.f = (int64_t)ops[0].u64;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, in_prec, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -270,13 +324,34 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MIN:
+                    res.d = fmin(a, b);
+                    break;
+                case OP_CVT:
+                    res.d = ops[0].f;
+                    break;
+                case OP_TOINT32:
+                    res.u64 = (int32_t)lrint(a);
+                    break;
+                case OP_TOINT64:
+                    res.u64 = llrint(a);
+                    break;
+                case OP_FROMINT32:
+                    res.d = (int32_t)ops[0].u64;
+                    break;
+                case OP_FROMINT64:
+                    res.d = (int64_t)ops[0].u64;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, in_prec, no_neg);
+            if (op == OP_CVT) {
+                ops[1].f64 = float32_to_float64(ops[0].f32, &soft_status);
+            }
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
@@ -305,13 +380,31 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MIN:
+                    res.f32 = float32_minnum(a, b, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f32 = float64_to_float32(ops[1].f64, &soft_status);
+                    break;
+                case OP_TOINT32:
+                    res.u64 = float32_to_int32(a, &soft_status);
+                    break;
+                case OP_TOINT64:
+                    res.u64 = float32_to_int64(a, &soft_status);
+                    break;
+                case OP_FROMINT32:
+                    res.f32 = int32_to_float32(ops[0].u64, &soft_status);
+                    break;
+                case OP_FROMINT64:
+                    res.f32 = int64_to_float32(ops[0].u64, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, in_prec, no_neg);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
@@ -340,6 +433,24 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MIN:
+                    res.f64 = float64_minnum(a, b, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f64 = float32_to_float64(ops[0].f32, &soft_status);
+                    break;
+                case OP_TOINT32:
+                    res.u64 = float64_to_int32(a, &soft_status);
+                    break;
+                case OP_TOINT64:
+                    res.u64 = float64_to_int64(a, &soft_status);
+                    break;
+                case OP_FROMINT32:
+                    res.f64 = int32_to_float64(ops[0].u64, &soft_status);
+                    break;
+                case OP_FROMINT64:
+                    res.f64 = int64_to_float64(ops[0].u64, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -377,6 +488,12 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(min, OP_MIN, 2)
+GEN_BENCH_ALL_TYPES(cvt, OP_CVT, 1)
+GEN_BENCH_ALL_TYPES(toint32, OP_TOINT32, 1)
+GEN_BENCH_ALL_TYPES(toint64, OP_TOINT64, 1)
+GEN_BENCH_ALL_TYPES(fromint32, OP_FROMINT32, 1)
+GEN_BENCH_ALL_TYPES(fromint64, OP_FROMINT64, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -407,6 +524,12 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(min, OP_MIN),
+    GEN_BENCH_FUNCS(cvt, OP_CVT),
+    GEN_BENCH_FUNCS(toint32, OP_TOINT32),
+    GEN_BENCH_FUNCS(toint64, OP_TOINT64),
+    GEN_BENCH_FUNCS(fromint32, OP_FROMINT32),
+    GEN_BENCH_FUNCS(fromint64, OP_FROMINT64),
 };
 
 #undef GEN_BENCH_FUNCS
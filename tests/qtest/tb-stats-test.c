@@ -0,0 +1,125 @@
+/*
+ * QTest testcase for the per-TranslationBlock execution statistics
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqos/libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+/*
+ * Print 'T' to the UART, then spin. The loop goes through jalr, so every
+ * iteration ends in lookup_and_goto_ptr, and its misses return to the
+ * execution loop without a TB (exit_tb(NULL)).
+ */
+static const uint8_t riscv_loop[] = {
+    0xb7, 0x02, 0x00, 0x10,     /* lui     t0, 0x10000 */
+    0x13, 0x03, 0x40, 0x05,     /* li      t1, 'T' */
+    0x23, 0x80, 0x62, 0x00,     /* sb      t1, 0(t0) */
+    0x97, 0x03, 0x00, 0x00,     /* 1: auipc t2, 0 */
+    0x67, 0x80, 0x03, 0x00,     /* jr      t2 */
+};
+
+static void wait_for_serial(int fd)
+{
+    int i;
+    char c;
+
+    for (i = 0; i < 36000; i++) {
+        if (read(fd, &c, 1) == 1 && c == 'T') {
+            return;
+        }
+        g_usleep(10000);
+    }
+    g_error("guest did not run");
+}
+
+static QList *query_tb_stats(QTestState *qts)
+{
+    QDict *rsp = qtest_qmp(qts, "{ 'execute': 'x-query-tb-stats',"
+                           "  'arguments': { 'max': 100 } }");
+    QList *ret;
+
+    g_assert(qdict_haskey(rsp, "return"));
+    ret = qdict_get_qlist(rsp, "return");
+    qobject_ref(ret);
+    qobject_unref(rsp);
+    return ret;
+}
+
+static void set_tb_stats(QTestState *qts, const char *op)
+{
+    QDict *rsp = qtest_qmp(qts, "{ 'execute': 'x-tb-stats',"
+                           "  'arguments': { 'op': %s } }", op);
+
+    g_assert(qdict_haskey(rsp, "return"));
+    qobject_unref(rsp);
+}
+
+static void test_tb_stats(void)
+{
+    char serialtmp[] = "/tmp/qtest-tb-stats-sXXXXXX";
+    char codetmp[] = "/tmp/qtest-tb-stats-cXXXXXX";
+    QTestState *qts;
+    QListEntry *entry;
+    QList *stats;
+    uint64_t executions = 0;
+    int ser_fd, code_fd;
+
+    ser_fd = mkstemp(serialtmp);
+    g_assert(ser_fd != -1);
+    code_fd = mkstemp(codetmp);
+    g_assert(code_fd != -1);
+    g_assert(write(code_fd, riscv_loop, sizeof(riscv_loop)) ==
+             sizeof(riscv_loop));
+    close(code_fd);
+
+    qts = qtest_initf("-M virt -bios %s -accel tcg "
+                      "-chardev file,id=serial0,path=%s "
+                      "-serial chardev:serial0", codetmp, serialtmp);
+    unlink(codetmp);
+
+    /* Statistics are off: the guest must keep running, collecting nothing */
+    wait_for_serial(ser_fd);
+    g_usleep(100000);
+    stats = query_tb_stats(qts);
+    g_assert(qlist_empty(stats));
+    qobject_unref(stats);
+
+    set_tb_stats(qts, "on");
+    g_usleep(100000);
+    set_tb_stats(qts, "off");
+
+    stats = query_tb_stats(qts);
+    QLIST_FOREACH_ENTRY(stats, entry) {
+        QDict *info = qobject_to(QDict, qlist_entry_obj(entry));
+
+        executions += qdict_get_int(info, "executions");
+    }
+    g_assert_cmpuint(executions, >, 0);
+    qobject_unref(stats);
+
+    /* Collection is off again and the guest still runs */
+    g_usleep(100000);
+    g_assert(qtest_probe_child(qts));
+
+    qtest_quit(qts);
+    close(ser_fd);
+    unlink(serialtmp);
+}
+
+int main(int argc, char **argv)
+{
+    const char *arch = qtest_get_arch();
+
+    g_test_init(&argc, &argv, NULL);
+
+    if (g_str_has_prefix(arch, "riscv")) {
+        qtest_add_func("tb-stats/exit-tb-null", test_tb_stats);
+    }
+
+    return g_test_run();
+}